@@ -0,0 +1,440 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "commands.h"
+#include "outputbuffer.h"
+
+// Benchmarks for the simulator's hot paths. Every operation is timed on its own so
+// latency percentiles can be reported next to throughput; the timer itself costs a few
+// tens of nanoseconds, which is included in every sample.
+//
+//   memsim-bench [--quick] [--filter <substring>] [--json <file|->]
+
+typedef std::chrono::steady_clock Clock;
+
+typedef struct BenchResult {
+    std::string name;
+    int page_size;
+    int processes;
+    uint64_t ops;
+    double seconds;
+    double p50;             // latencies in nanoseconds
+    double p90;
+    double p99;
+    double max;
+} BenchResult;
+
+// Per-operation latency samples of one benchmark run
+class Recorder {
+private:
+    std::vector<uint64_t> _samples;
+    Clock::time_point _start;
+    Clock::time_point _op_start;
+
+public:
+    Recorder(size_t expected_ops)
+    {
+        _samples.reserve(expected_ops);
+        _start = Clock::now();
+    }
+
+    inline void begin()
+    {
+        _op_start = Clock::now();
+    }
+
+    inline void end()
+    {
+        _samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _op_start).count());
+    }
+
+    BenchResult finish(std::string name, int page_size, int processes)
+    {
+        BenchResult result;
+        result.seconds = std::chrono::duration<double>(Clock::now() - _start).count();
+        result.name = name;
+        result.page_size = page_size;
+        result.processes = processes;
+        result.ops = _samples.size();
+        result.p50 = result.p90 = result.p99 = result.max = 0;
+        if (!_samples.empty())
+        {
+            std::sort(_samples.begin(), _samples.end());
+            size_t n = _samples.size();
+            result.p50 = _samples[(n - 1) * 50 / 100];
+            result.p90 = _samples[(n - 1) * 90 / 100];
+            result.p99 = _samples[(n - 1) * 99 / 100];
+            result.max = _samples[n - 1];
+        }
+        return result;
+    }
+};
+
+// xorshift, deterministic so runs are comparable
+static uint64_t rng_state = 88172645463325252ull;
+
+static uint32_t nextRandom()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)rng_state;
+}
+
+static const uint32_t mem_size = DEFAULT_MEMORY_SIZE;
+static const uint64_t virtual_size = 1ull << DEFAULT_VA_BITS;
+static bool quick = false;
+static std::string filter;
+static std::vector<BenchResult> results;
+
+static bool selected(std::string name)
+{
+    return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+static void report(BenchResult result)
+{
+    fprintf(stderr, "%-30s page %6d  procs %5d  %12.0f ops/s  p50 %7.0f  p90 %7.0f  p99 %7.0f  max %9.0f ns\n",
+            result.name.c_str(), result.page_size, result.processes,
+            (result.seconds > 0) ? result.ops / result.seconds : 0.0, result.p50, result.p90, result.p99, result.max);
+    results.push_back(result);
+}
+
+/*
+    PageTable: maps pages_per_process pages for each process, translates random addresses
+    in them, then unmaps everything
+*/
+static void benchPageTable(int page_size, int processes)
+{
+    if (!selected("pagetable."))
+    {
+        return;
+    }
+    PageTable page_table(page_size, mem_size, virtual_size);
+    int pages_per_process = std::min<int>(page_table.numFrames() / processes, quick ? 1024 : 8192);
+    uint64_t total = (uint64_t)pages_per_process * processes;
+
+    Recorder add(total);
+    for (int pid = 0; pid < processes; pid++)
+    {
+        for (int page = 0; page < pages_per_process; page++)
+        {
+            add.begin();
+            page_table.addEntry(1024 + pid, page);
+            add.end();
+        }
+    }
+    report(add.finish("pagetable.addEntry", page_size, processes));
+
+    uint64_t lookups = quick ? 200000 : 2000000;
+    uint32_t span = pages_per_process * page_size;
+    volatile int sink = 0;
+    Recorder translate(lookups);
+    for (uint64_t i = 0; i < lookups; i++)
+    {
+        uint32_t pid = 1024 + nextRandom() % processes;
+        uint32_t address = nextRandom() % span;
+        translate.begin();
+        sink += page_table.getPhysicalAddress(pid, address);
+        translate.end();
+    }
+    report(translate.finish("pagetable.getPhysicalAddress", page_size, processes));
+
+    Recorder remove(total);
+    for (int pid = 0; pid < processes; pid++)
+    {
+        for (int page = 0; page < pages_per_process; page++)
+        {
+            remove.begin();
+            page_table.removeEntry(1024 + pid, page);
+            remove.end();
+        }
+    }
+    report(remove.finish("pagetable.removeEntry", page_size, processes));
+}
+
+/*
+    Mmu: looks up random variables by name across all processes, then frees every variable
+    in random order and times handing its range back with mergeFreeSpace
+*/
+static void benchMmu(int page_size, int processes)
+{
+    if (!selected("mmu."))
+    {
+        return;
+    }
+    Mmu mmu(mem_size, virtual_size, page_size);
+    int vars_per_process = std::min<int>((quick ? 20000 : 200000) / processes, 4096);
+    std::vector<std::string> names;
+    for (int i = 0; i < vars_per_process; i++)
+    {
+        names.push_back("var" + std::to_string(i));
+    }
+    std::vector<std::pair<uint32_t, Variable*>> vars;
+    for (int p = 0; p < processes; p++)
+    {
+        uint32_t pid = mmu.createProcess();
+        for (int i = 0; i < vars_per_process; i++)
+        {
+            uint64_t size = 4 * (1 + nextRandom() % 64);
+            mmu.reserveBytes(size);
+            Variable *var = mmu.placeVariable(pid, names[i], DataType::Int, size, 4);
+            if (var != NULL)
+            {
+                vars.push_back(std::make_pair(pid, var));
+            }
+        }
+    }
+
+    uint64_t lookups = quick ? 200000 : 2000000;
+    volatile uintptr_t sink = 0;
+    Recorder find(lookups);
+    for (uint64_t i = 0; i < lookups; i++)
+    {
+        uint32_t pid = 1024 + nextRandom() % processes;
+        const std::string& name = names[nextRandom() % vars_per_process];
+        find.begin();
+        sink += (uintptr_t)mmu.getVariable(pid, name);
+        find.end();
+    }
+    report(find.finish("mmu.getVariable", page_size, processes));
+
+    for (size_t i = vars.size(); i > 1; i--)
+    {
+        std::swap(vars[i - 1], vars[nextRandom() % i]);
+    }
+    Recorder merge(vars.size());
+    for (size_t i = 0; i < vars.size(); i++)
+    {
+        uint32_t pid = vars[i].first;
+        uint64_t address = vars[i].second->virtual_address - vars[i].second->padding;
+        uint64_t size = vars[i].second->size + vars[i].second->padding;
+        mmu.removeVariable(pid, vars[i].second);
+        merge.begin();
+        mmu.mergeFreeSpace(address, size, pid);
+        merge.end();
+    }
+    report(merge.finish("mmu.mergeFreeSpace", page_size, processes));
+}
+
+// Runs text commands through executeCommand exactly like --batch, output is discarded
+static BenchResult runScenario(std::string name, int page_size, int processes, const std::vector<std::string>& commands)
+{
+    PhysicalMemory physical(mem_size, HugePages::HugeOff);
+    void *memory = physical.base();
+    Mmu mmu(mem_size, virtual_size, page_size);
+    PageTable page_table(page_size, mem_size, virtual_size);
+    page_table.setPhysicalMemory(&physical);
+    OutputBuffer output(STDOUT_FILENO, 1 << 16, true);
+    std::streambuf *console = std::cout.rdbuf(&output);
+
+    std::vector<std::string> commandSplit;
+    Recorder recorder(commands.size());
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        recorder.begin();
+        splitString(commands[i], ' ', commandSplit);
+        executeCommand(commandSplit, &mmu, &page_table, memory);
+        recorder.end();
+    }
+    BenchResult result = recorder.finish(name, page_size, processes);
+
+    std::cout.rdbuf(console);
+    return result;
+}
+
+/*
+    End to end: create storms, allocate/free churn, bulk and whole-array sets and terminate-heavy traces
+*/
+static void benchScenarios(int page_size, int processes)
+{
+    int scale = quick ? 1 : 10;
+
+    if (selected("scenario.create"))
+    {
+        // as many processes as fit in memory, over and over
+        std::vector<std::string> commands;
+        for (int round = 0; round < scale; round++)
+        {
+            for (int p = 0; p < 800; p++)
+            {
+                commands.push_back("create 4096 1024");
+            }
+            for (int p = 0; p < 800; p++)
+            {
+                commands.push_back("terminate " + std::to_string(1024 + round * 800 + p));
+            }
+        }
+        report(runScenario("scenario.create_storm", page_size, 800, commands));
+    }
+
+    if (selected("scenario.churn"))
+    {
+        std::vector<std::string> commands;
+        for (int p = 0; p < processes; p++)
+        {
+            commands.push_back("create 2048 512");
+        }
+        std::vector<int> live(processes * 64, 0);
+        for (int i = 0; i < 20000 * scale; i++)
+        {
+            int slot = nextRandom() % live.size();
+            std::string pid = std::to_string(1024 + slot / 64);
+            std::string var = "v" + std::to_string(slot % 64);
+            if (live[slot])
+            {
+                commands.push_back("free " + pid + " " + var);
+            }
+            else
+            {
+                static const char *types[] = {"char", "short", "int", "long", "double"};
+                commands.push_back("allocate " + pid + " " + var + " " + types[nextRandom() % 5] + " " +
+                                   std::to_string(1 + nextRandom() % 512));
+            }
+            live[slot] = !live[slot];
+        }
+        report(runScenario("scenario.alloc_free_churn", page_size, processes, commands));
+    }
+
+    if (selected("scenario.bulk_set"))
+    {
+        std::vector<std::string> commands;
+        for (int p = 0; p < processes; p++)
+        {
+            commands.push_back("create 2048 512");
+            commands.push_back("allocate " + std::to_string(1024 + p) + " data int 4096");
+        }
+        std::string values;
+        for (int v = 0; v < 256; v++)
+        {
+            values += " " + std::to_string(v * 7919);
+        }
+        for (int i = 0; i < 2000 * scale; i++)
+        {
+            int offset = (nextRandom() % 16) * 256;
+            commands.push_back("set " + std::to_string(1024 + nextRandom() % processes) + " data " +
+                               std::to_string(offset) + values);
+        }
+        report(runScenario("scenario.bulk_set", page_size, processes, commands));
+    }
+
+    if (selected("scenario.large_set"))
+    {
+        // whole 100k-element arrays in one set, spanning many pages
+        std::vector<std::string> commands;
+        commands.push_back("create 2048 512");
+        commands.push_back("allocate 1024 ints int 100000");
+        commands.push_back("allocate 1024 reals double 100000");
+        std::string ints;
+        std::string reals;
+        for (int v = 0; v < 100000; v++)
+        {
+            ints += " " + std::to_string(v * 7919);
+            reals += " " + std::to_string(v * 0.25);
+        }
+        for (int i = 0; i < 2 * scale; i++)
+        {
+            commands.push_back("set 1024 ints 0" + ints);
+            commands.push_back("set 1024 reals 0" + reals);
+        }
+        report(runScenario("scenario.large_set", page_size, 1, commands));
+    }
+
+    if (selected("scenario.terminate"))
+    {
+        std::vector<std::string> commands;
+        uint32_t pid = 1024;
+        for (int i = 0; i < 200 * scale; i++, pid++)
+        {
+            commands.push_back("create 2048 512");
+            for (int v = 0; v < 20; v++)
+            {
+                commands.push_back("allocate " + std::to_string(pid) + " v" + std::to_string(v) + " long 100");
+            }
+            commands.push_back("terminate " + std::to_string(pid));
+        }
+        report(runScenario("scenario.terminate_heavy", page_size, 1, commands));
+    }
+}
+
+static void writeJson(std::ostream& out)
+{
+    out << "[" << std::endl;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& r = results[i];
+        char line[512];
+        snprintf(line, sizeof(line),
+                 "  {\"name\": \"%s\", \"page_size\": %d, \"processes\": %d, \"ops\": %llu, \"seconds\": %.6f, "
+                 "\"ops_per_sec\": %.1f, \"latency_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f}}%s",
+                 r.name.c_str(), r.page_size, r.processes, (unsigned long long)r.ops, r.seconds,
+                 (r.seconds > 0) ? r.ops / r.seconds : 0.0, r.p50, r.p90, r.p99, r.max,
+                 (i + 1 < results.size()) ? "," : "");
+        out << line << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    std::string json_file;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (option == "--quick")
+        {
+            quick = true;
+        }
+        else if (option == "--filter" && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (option == "--json" && i + 1 < argc)
+        {
+            json_file = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Error: unrecognized option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // sweep page size x process count
+    static const int page_sizes[] = {1024, 4096, 16384};
+    static const int process_counts[] = {1, 16, 256};
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            benchPageTable(page_sizes[i], process_counts[j]);
+            benchMmu(page_sizes[i], process_counts[j]);
+        }
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        benchScenarios(page_sizes[i], 16);
+    }
+
+    if (json_file == "-")
+    {
+        writeJson(std::cout);
+    }
+    else if (!json_file.empty())
+    {
+        std::ofstream out(json_file.c_str());
+        if (!out.is_open())
+        {
+            fprintf(stderr, "Error: cannot write %s\n", json_file.c_str());
+            return 1;
+        }
+        writeJson(out);
+    }
+    return 0;
+}
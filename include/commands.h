@@ -0,0 +1,70 @@
+#ifndef __COMMANDS_H_
+#define __COMMANDS_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "mmu.h"
+#include "pagetable.h"
+#include "snapshot.h"
+
+enum CommandType : uint8_t {CmdCreate, CmdAllocate, CmdSet, CmdPrint, CmdFree, CmdTerminate, CmdCompact, CmdFill, CmdCopy, CmdReduce, CmdFork,
+                           CmdShm, CmdSnapshot, CmdExit, CmdUnknown, CmdCount};
+
+// Whole-variable reductions (sum, min and max commands)
+enum Reduction : uint8_t {ReduceSum, ReduceMin, ReduceMax};
+
+// How many words (the command's own included) a command needs and its usage line
+#define COMMAND_MAX_WORDS 5
+typedef struct CommandSyntax {
+    const char *name;
+    CommandType type;
+    uint32_t words;
+    const char *usage;
+} CommandSyntax;
+
+// Outcome of one compaction run over one or more processes
+typedef struct CompactionResult {
+    uint32_t processes;
+    uint32_t frames_reclaimed;      // pages that no longer hold live data after sliding
+    uint64_t virtual_bytes;         // bytes of variables that moved in virtual space
+    uint32_t frames_moved;          // frames renumbered to pack memory from frame 0
+    uint64_t physical_bytes;
+} CompactionResult;
+
+CommandType executeCommand(std::vector<std::string>& commandSplit, Mmu *mmu, PageTable *page_table, void *memory);
+const char* commandTypeName(CommandType type);
+const CommandSyntax* commandSyntax(const std::string& name);
+std::ostream& commandOutput();
+void setCommandOutput(std::ostream *output);
+void createProcess(int text_size, int data_size, Mmu *mmu, PageTable *page_table);
+void createProcess(uint32_t pid, int text_size, int data_size, Mmu *mmu, PageTable *page_table);
+void forkProcess(uint32_t parent_pid, Mmu *mmu, PageTable *page_table);
+void createSegment(uint32_t name, uint64_t size, Mmu *mmu, PageTable *page_table);
+void attachSegment(uint32_t pid, uint32_t name, Mmu *mmu, PageTable *page_table);
+void detachSegment(uint32_t pid, Variable *var, Mmu *mmu, PageTable *page_table);
+void allocateVariable(uint32_t pid, std::string var_name, DataType type, uint64_t num_elements, Mmu *mmu, PageTable *page_table);
+void allocateVariable(uint32_t pid, uint32_t name, DataType type, uint64_t num_elements, Mmu *mmu, PageTable *page_table);
+void setVariable(uint32_t pid, std::string var_name, uint64_t offset, void *value, Mmu *mmu, PageTable *page_table, void *memory);
+void setVariableValues(uint32_t pid, Variable *var, uint64_t offset, const std::vector<std::string>& words, size_t first, PageTable *page_table, void *memory);
+bool writeVariable(uint32_t pid, Variable *var, uint64_t offset, const void *values, uint32_t count, PageTable *page_table, void *memory);
+void freeVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table);
+void freeVariable(uint32_t pid, Variable *var, Mmu *mmu, PageTable *page_table);
+void terminateProcess(uint32_t pid, Mmu *mmu, PageTable *page_table);
+CompactionResult compactProcesses(const std::vector<uint32_t>& pids, Mmu *mmu, PageTable *page_table, void *memory, bool pack_frames);
+void printCompaction(CompactionResult result);
+void printTableRange(bool page, uint32_t pid, uint64_t first, uint64_t last, Mmu *mmu, PageTable *page_table);
+void printSnapshot(const char *action, std::string file, const char *error, SnapshotInfo info);
+void autoCompact(uint32_t pid, Mmu *mmu, PageTable *page_table, void *memory);
+Variable* lookupVariable(const std::string& object, Mmu *mmu, uint32_t *pid);
+void fillVariable(uint32_t pid, Variable *var, const std::string& value, PageTable *page_table, void *memory);
+void copyVariable(uint32_t src_pid, Variable *src, uint32_t dst_pid, Variable *dst, PageTable *page_table, void *memory);
+void printReduction(Reduction reduction, uint32_t pid, Variable *var, PageTable *page_table, void *memory);
+void printVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table, void *memory);
+void printVariable(uint32_t pid, Variable *var, PageTable *page_table, void *memory);
+void splitString(std::string text, char d, std::vector<std::string>& result);
+bool parseRange(std::string text, uint64_t *first, uint64_t *last);
+DataType parseDataType(const std::string& type);
+int64_t allNums(std::string checkString);
+
+#endif // __COMMANDS_H_
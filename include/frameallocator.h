@@ -0,0 +1,31 @@
+#ifndef __FRAMEALLOCATOR_H_
+#define __FRAMEALLOCATOR_H_
+
+#include <cstdint>
+#include <vector>
+
+// Free-frame bitmap with a summary level on top: a set bit in _free_bits means the
+// frame is free, a set bit in _summary means that word of _free_bits has a free frame
+class FrameAllocator {
+private:
+    uint32_t _num_frames;
+    uint32_t _num_free;
+    uint32_t _summary_hint;               // no summary word below this index has a free frame
+    std::vector<uint64_t> _free_bits;
+    std::vector<uint64_t> _summary;
+
+public:
+    FrameAllocator(uint32_t num_frames);
+    ~FrameAllocator();
+
+    int32_t allocate();
+    int32_t allocateRun(uint32_t count);
+    void release(uint32_t frame);
+    void claim(uint32_t frame);
+    void reset(uint32_t num_used);
+    bool isFree(uint32_t frame);
+    uint32_t numFrames();
+    uint32_t numFree();
+};
+
+#endif // __FRAMEALLOCATOR_H_
@@ -0,0 +1,40 @@
+#ifndef __FREELIST_H_
+#define __FREELIST_H_
+
+#include <cstdint>
+#include <map>
+#include <set>
+
+enum FitPolicy : uint8_t {FirstFit, BestFit, NextFit};
+
+// Best fit tries at most this many holes that might be too small once padded before taking
+// the smallest one sure to fit
+#define BEST_FIT_PROBES 32
+
+// Free holes of one process's virtual address space, indexed by address (first/next fit)
+// and by size (best fit). Adjacent holes are always coalesced, so no two holes touch.
+class FreeList {
+private:
+    std::map<uint64_t, uint64_t> _by_address;             // start -> size
+    std::set<std::pair<uint64_t, uint64_t>> _by_size;      // (size, start)
+    uint64_t _cursor;                                       // next fit resumes at this address
+    uint64_t _free_bytes;
+
+    void addHole(uint64_t start, uint64_t size);
+    void removeHole(std::map<uint64_t, uint64_t>::iterator hole);
+    bool fits(uint64_t start, uint64_t hole_size, uint64_t size, uint32_t type_size, uint32_t page_size, uint64_t *padding);
+
+public:
+    FreeList();
+    ~FreeList();
+
+    bool allocate(uint64_t size, uint32_t type_size, uint32_t page_size, FitPolicy policy, bool keep_padding, uint64_t *address, uint64_t *padding);
+    void release(uint64_t address, uint64_t size);
+    void clear();
+    uint32_t numHoles();
+    uint64_t freeBytes();
+    void innerHoles(uint64_t end, uint32_t *count, uint64_t *bytes, uint64_t *largest);
+    const std::map<uint64_t, uint64_t>& holes();
+};
+
+#endif // __FREELIST_H_
@@ -0,0 +1,60 @@
+#ifndef __HISTOGRAM_H_
+#define __HISTOGRAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+
+// Latency histogram with HDR-style buckets: values below 2^HIST_SUB_BITS get a bucket each,
+// above that every power of two is split into 2^HIST_SUB_BITS linear steps, so a bucket is
+// never wider than 1/8 of the values it holds and the whole uint64 range fits in 512 counters
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+
+class LatencyHistogram {
+private:
+    uint64_t _buckets[HIST_BUCKETS];
+    uint64_t _count;
+    uint64_t _max;
+
+    static int bucketOf(uint64_t value);
+    static uint64_t bucketValue(int bucket);
+
+public:
+    LatencyHistogram();
+
+    void record(uint64_t value);
+    void merge(const LatencyHistogram& other);
+    uint64_t count();
+    uint64_t max();
+    uint64_t percentile(double p);
+};
+
+inline uint64_t statsNow()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Records the time until the end of its scope into histogram, or does nothing for NULL (timing off)
+class ScopedLatency {
+private:
+    LatencyHistogram *_histogram;
+    uint64_t _start;
+
+public:
+    ScopedLatency(LatencyHistogram *histogram)
+    {
+        _histogram = histogram;
+        _start = (histogram != NULL) ? statsNow() : 0;
+    }
+
+    ~ScopedLatency()
+    {
+        if (_histogram != NULL)
+        {
+            _histogram->record(statsNow() - _start);
+        }
+    }
+};
+
+#endif // __HISTOGRAM_H_
@@ -4,43 +4,195 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include "variableindex.h"
+#include "freelist.h"
+#include "nametable.h"
+#include "pool.h"
+#include "outputbuffer.h"
+#include "histogram.h"
 
 enum DataType : uint8_t {FreeSpace, Char, Short, Int, Float, Long, Double};
 
+// Size in bytes of one element of the given type
+inline uint32_t dataTypeSize(DataType type)
+{
+    static const uint32_t sizes[] = {0, 1, 2, 4, 4, 8, 8};
+    return sizes[type];
+}
+
+// Variable::flags
+#define VAR_SYSTEM 0x01     // <TEXT>, <GLOBALS> or <STACK>
+#define VAR_SHARED 0x02     // a shared memory segment attached at the variable's address
+
 typedef struct Variable {
-    std::string name;
+    uint64_t virtual_address;
+    uint64_t size;
+    uint32_t name;          // id in the Mmu's NameTable
     DataType type;
-    uint32_t virtual_address;
-    uint32_t size;
-} Variable; 
+    uint8_t flags;
+    uint16_t padding;       // bytes before virtual_address skipped so the first element does not straddle a page
+    uint32_t index;         // position in its process's variables
+} Variable;
+
+// Variables by (start address, name): zero-size variables can share an address, the name
+// keeps their order the same in every run and after a snapshot is restored
+typedef std::map<std::pair<uint64_t, uint32_t>, Variable*> AddressIndex;
+
+typedef struct PageUsage {
+    uint32_t live_bytes;
+    uint32_t live_vars;
+} PageUsage;
 
 typedef struct Process {
     uint32_t pid;
     std::vector<Variable*> variables;
+    VariableIndex index;        // variables by name
+    AddressIndex by_address;
+    FreeList holes;             // unallocated ranges of the virtual address space
+    uint64_t padding_bytes;     // page-boundary padding of the live variables
+    uint32_t padded_vars;
+    std::unordered_map<uint64_t, PageUsage> pages;   // virtual pages holding at least one live variable
 } Process;
 
+// A named shared memory segment: whole pages whose frames the page table holds under its
+// id. Attaching it to a process adds a variable with the segment's name spanning those pages
+typedef struct Segment {
+    uint32_t id;
+    uint64_t size;
+    std::vector<uint32_t> pids;     // reverse map: processes it is attached to
+} Segment;
+
+// A variable moved by Mmu::compactProcess and the address it used to start at
+typedef struct Relocation {
+    Variable *var;
+    uint64_t old_address;
+} Relocation;
+
+// Entry point call counts and fragmentation, padding and holes are summed over the live processes
+typedef struct MmuStats {
+    uint64_t placements;
+    uint64_t lookups;
+    uint64_t removals;
+    uint64_t merges;
+    uint64_t padded_variables;  // live variables with page-boundary padding, summed over the processes
+    uint64_t padding_bytes;
+    uint64_t aligned_allocations;
+    uint64_t alignment_bytes;   // skipped to start a huge page variable or a shared segment on its boundary, left as holes
+    uint64_t holes;             // not counting the free rest of each address space above its last variable
+    uint64_t hole_bytes;
+    uint64_t largest_hole;
+    uint64_t compactions;
+    uint64_t frames_reclaimed;
+    uint64_t compaction_bytes;
+    uint64_t segments;
+    uint64_t segment_bytes;
+    uint64_t attachments;
+    uint64_t segment_bytes_saved;   // memory the attached processes would need for copies of their own
+} MmuStats;
+
+// Latencies of the entry points, recorded only once timing is enabled
+typedef struct MmuLatency {
+    LatencyHistogram place;
+    LatencyHistogram lookup;
+    LatencyHistogram remove;
+    LatencyHistogram merge;
+} MmuLatency;
+
 class Mmu {
 private:
+    uint32_t _first_pid;
     uint32_t _next_pid;
-    uint32_t _max_size;
-    std::vector<Process*> _processes;
+    uint64_t _memory_size;                // physical memory (plus swap), bounds the bytes allocated in total
+    uint64_t _virtual_size;               // size of every process's own virtual address space
+    int _page_size;
+    std::atomic<uint32_t> _num_processes;
+    std::atomic<uint64_t> _bytes_used;    // taken with reserveBytes before a variable or segment is placed
+    FitPolicy _fit_policy;
+    uint32_t _compact_threshold;          // compact a process once it has more holes than this, 0 = never
+    uint32_t _huge_alignment;             // variables at least this big start on a multiple of it, 0 = off
+    std::vector<Process*> _processes;     // indexed by pid - _first_pid, NULL once terminated
+    // Everything a process owns lives in the shard of its pid, so commands for pids of
+    // different shards can run on different threads without locking (see setShards)
+    uint32_t _num_shards;
+    std::vector<Pool<Process>*> _process_pools;
+    std::vector<Pool<Variable>*> _variable_pools;
+    std::vector<MmuStats> _stats;
+    std::vector<MmuLatency> _latency;
+    bool _timing;
+    NameTable _names;
+    // Segments by name; detaching can happen on any shard's thread (free, terminate)
+    std::unordered_map<uint32_t, Segment> _segments;
+    std::mutex _segments_lock;
+
+    uint32_t shardOf(uint32_t pid);
+    Process* findProcess(uint32_t pid);
+    void deleteProcess(Process *proc);
+    void accountVariable(Process *proc, Variable *var, int sign);
+    Variable* insertVariable(Process *proc, uint32_t name, DataType type, uint64_t size, uint64_t address, uint8_t flags, uint16_t padding);
+    void printVariables(Process *proc, uint64_t first_address, uint64_t last_address, RowWriter& rows);
 
 public:
-    Mmu(int memory_size);
+    Mmu(uint64_t memory_size, uint64_t virtual_size, int page_size);
     ~Mmu();
 
+    void setShards(uint32_t num_shards);
+    uint32_t numShards();
+    uint32_t reservePids(uint32_t count);
     uint32_t createProcess();
-    void addVariableToProcess(uint32_t pid, std::string var_name, DataType type, uint32_t size, uint32_t address);
+    void createProcess(uint32_t pid);
+    bool forkProcess(uint32_t parent_pid, uint32_t pid);
+    Variable* addVariableToProcess(uint32_t pid, std::string var_name, DataType type, uint64_t size, uint64_t address);
+    Variable* addVariableToProcess(uint32_t pid, uint32_t name, DataType type, uint64_t size, uint64_t address, uint8_t flags = 0, uint16_t padding = 0);
+    Variable* placeVariable(uint32_t pid, std::string var_name, DataType type, uint64_t size, uint32_t type_size);
+    Variable* placeVariable(uint32_t pid, uint32_t name, DataType type, uint64_t size, uint32_t type_size, uint8_t flags = 0);
+    void setFitPolicy(FitPolicy policy);
+    void setCompactThreshold(uint32_t holes);
+    void setHugeAlignment(uint32_t bytes);
+    bool needsCompaction(uint32_t pid);
+    std::vector<Relocation> compactProcess(uint32_t pid);
+    void recordCompaction(uint32_t pid, uint32_t frames_reclaimed, uint64_t bytes_moved);
     void print();
+    void print(uint32_t pid, uint64_t first_address, uint64_t last_address);
     Variable* getVariable(uint32_t pid, std::string var_name);
+    Variable* getVariable(uint32_t pid, uint32_t name);
+    const std::string& getVariableName(Variable *var);
+    uint32_t internName(std::string var_name);
+    void removeVariable(uint32_t pid, Variable *var);
     bool processExists(uint32_t pid);
     void printProcesses();
-    bool spaceLeft(int size);
-    void mergeFreeSpace(uint32_t address, uint32_t size, uint32_t pid);
-    void numVarsOnPage(uint32_t address, uint32_t size, uint32_t pid);
+    bool reserveBytes(uint64_t size);
+    void releaseBytes(uint64_t size);
+    uint64_t bytesUsed();
+    uint64_t memorySize();
+    uint64_t virtualSize();
+    void mergeFreeSpace(uint64_t address, uint64_t size, uint32_t pid);
     std::vector<Variable*> getAllVars(uint32_t);
-    int getRemainingSpaceOnPage(uint32_t pid, uint32_t virtual_address, int page_size, int page_num);
+    uint32_t liveBytesOnPage(uint32_t pid, uint64_t page_num);
+    uint32_t liveVariablesOnPage(uint32_t pid, uint64_t page_num);
     void removeProcess(uint32_t pid);
+    void addSegment(uint32_t name, uint64_t size, uint32_t id);
+    Segment* findSegment(uint32_t name);
+    Variable* attachSegment(uint32_t pid, uint32_t name);
+    int64_t detachSegment(uint32_t pid, uint32_t name);
+    uint32_t numProcesses();
+    std::vector<uint32_t> getPids();
+    uint32_t firstPid();
+    uint32_t nextPid();
+    uint32_t numNames();
+    const std::string& getName(uint32_t name);
+    const std::map<uint64_t, uint64_t>& getHoles(uint32_t pid);
+    std::vector<std::pair<uint32_t, Segment>> getSegments();
+    void clear();
+    void restoreHoles(uint32_t pid, const std::vector<std::pair<uint64_t, uint64_t>>& holes);
+    void restoreSegment(uint32_t name, const Segment& segment);
+    MmuStats getStats();
+    void enableTiming(bool timing);
+    MmuLatency getLatency();
 };
 
 #endif // __MMU_H_
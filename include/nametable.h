@@ -0,0 +1,32 @@
+#ifndef __NAMETABLE_H_
+#define __NAMETABLE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Ids of the names every process starts with, interned up front so that a
+// variable can be recognized as one of them by comparing its id
+#define NAME_TEXT 0
+#define NAME_GLOBALS 1
+#define NAME_STACK 2
+#define NAME_FIRST_USER 3
+
+// Interns variable names: each distinct name is stored once and variables refer to it by id
+class NameTable {
+private:
+    std::unordered_map<std::string, uint32_t> _ids;
+    std::vector<std::string> _names;
+
+public:
+    NameTable();
+    ~NameTable();
+
+    uint32_t intern(const std::string& name);
+    int64_t find(const std::string& name);
+    const std::string& name(uint32_t id);
+    uint32_t size();
+};
+
+#endif // __NAMETABLE_H_
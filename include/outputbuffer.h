@@ -0,0 +1,49 @@
+#ifndef __OUTPUTBUFFER_H_
+#define __OUTPUTBUFFER_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define ROW_WRITER_BYTES 65536      // rows collected before they are handed to the stream
+
+// Stream buffer for non-interactive runs: output collects in one large buffer that is
+// written to the file descriptor only when it fills up or finish() is called, so a
+// std::endl after every command no longer costs a write. With discard set, everything
+// written is dropped.
+class OutputBuffer : public std::streambuf {
+private:
+    std::vector<char> _buffer;
+    int _fd;
+    bool _discard;
+
+    void drain();
+
+protected:
+    int overflow(int c);
+    int sync();
+
+public:
+    OutputBuffer(int fd, size_t size, bool discard);
+    ~OutputBuffer();
+
+    void finish();
+};
+
+// Formats the rows of a large table (print page, print mmu) straight into one buffer and
+// hands it to the stream in big pieces, instead of one formatted insert per row. Whatever
+// is left is written when it goes out of scope.
+class RowWriter {
+private:
+    std::ostream& _out;
+    std::string _rows;
+
+public:
+    RowWriter(std::ostream& out);
+    ~RowWriter();
+
+    void row(const char *format, ...);
+    void flush();
+};
+
+#endif // __OUTPUTBUFFER_H_
@@ -4,42 +4,270 @@
 #include <iostream>
 #include <string>
 #include <vector>
-#include <map>
 #include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include "frameallocator.h"
+#include "tlb.h"
+#include "replacer.h"
+#include "swapfile.h"
+#include "physicalmemory.h"
+#include "outputbuffer.h"
+#include "histogram.h"
 
-struct PageTableKeyComparator
+// Combination of pid and virtual page number packed into one integer: the page number in
+// the low PAGE_KEY_PAGE_BITS bits, the pid above it (so pids must stay below 2^24)
+#define PAGE_KEY_PAGE_BITS 40
+#define PAGE_KEY_PAGE_MASK ((1ull << PAGE_KEY_PAGE_BITS) - 1)
+typedef uint64_t PageKey;
+
+inline PageKey makePageKey(uint32_t pid, uint64_t page_number)
 {
-    inline bool operator() (const std::string& str1, const std::string& str2)
-    {
-        size_t sep1 = str1.find("|");
-        uint32_t pid1 = std::stoi(str1.substr(0, sep1));
-        int page1 = std::stoi(str1.substr(sep1 + 1));
-        size_t sep2 = str2.find("|");
-        uint32_t pid2 = std::stoi(str2.substr(0, sep2));
-        int page2 = std::stoi(str2.substr(sep2 + 1));
+    return ((uint64_t)pid << PAGE_KEY_PAGE_BITS) | page_number;
+}
 
-        return (pid1 < pid2 || (pid1 == pid2 && page1 < page2));
-    }
-};
+inline uint32_t pageKeyPid(PageKey key)
+{
+    return (uint32_t)(key >> PAGE_KEY_PAGE_BITS);
+}
+
+inline uint64_t pageKeyPage(PageKey key)
+{
+    return key & PAGE_KEY_PAGE_MASK;
+}
+
+// Default size of each process's virtual address space, as on x86-64 and arm64 (256 TB)
+#define DEFAULT_VA_BITS 48
+
+// Each process gets its own radix tree: the page number is split into groups of PT_BITS,
+// the last group indexes a leaf of frame numbers. The depth follows from the size of the
+// virtual address space (4 levels for 48 bits and 4 KB pages, like x86-64), and levels
+// are only built under pages that are mapped, so a mostly-empty space costs one node
+// per level for each region in use
+#define PT_BITS 9
+#define PT_MAX_LEVELS ((PAGE_KEY_PAGE_BITS + PT_BITS - 1) / PT_BITS)
+#define PT_FANOUT (1 << PT_BITS)
+#define PT_MASK (PT_FANOUT - 1)
+
+// Leaf entries hold the frame number of a resident page, PT_UNMAPPED, or the swap slot of
+// a page that was paged out encoded as a value below PT_UNMAPPED
+#define PT_UNMAPPED -1
+
+inline int32_t swapEntry(uint32_t slot)
+{
+    return -2 - (int32_t)slot;
+}
+
+inline uint32_t swapSlot(int32_t entry)
+{
+    return (uint32_t)(-2 - entry);
+}
+
+typedef struct PageTableLeaf {
+    uint32_t used;
+    int32_t frames[PT_FANOUT];
+} PageTableLeaf;
+
+typedef struct PageTableNode {
+    uint32_t used;
+    void *children[PT_FANOUT];   // PageTableNode* on upper levels, PageTableLeaf* or a huge page on the last one
+} PageTableNode;
+
+// A huge page maps the PT_FANOUT pages a leaf would cover with as many contiguous frames
+// starting at a multiple of PT_FANOUT (2 MB with 4 KB pages, as x86-64's PMD mappings), so
+// its parent node holds it instead of a leaf. It is stored in the parent's slot as a
+// tagged pointer (low bit set). Its pages are all translatable while it exists;
+// `mapped` marks those the process asked for
+typedef struct PageTableHuge {
+    int32_t frame;
+    uint32_t used;
+    uint64_t mapped[PT_FANOUT / 64];
+} PageTableHuge;
+
+inline bool isHugeSlot(void *child)
+{
+    return ((uintptr_t)child & 1) != 0;
+}
+
+inline PageTableHuge* hugeOf(void *child)
+{
+    return (PageTableHuge*)((uintptr_t)child & ~(uintptr_t)1);
+}
+
+inline void* hugeSlot(PageTableHuge *huge)
+{
+    return (void*)((uintptr_t)huge | 1);
+}
+
+// When a range of pages gets huge pages: never; when it is mapped, for every huge-page
+// span it covers whole (eager); or once every page of a span is mapped, by copying them
+// into one (usage, like khugepaged)
+enum PromotePolicy : uint8_t {PromoteNever, PromoteEager, PromoteUsage};
+
+// What unmapping part of a huge page does: split it into base pages at once, freeing the
+// frames of the unmapped ones (split); or keep it whole until all of it is unmapped or
+// frames run out (keep)
+enum DemotePolicy : uint8_t {DemoteSplit, DemoteKeep};
+
+// Calls into the page table's entry points since it was created
+typedef struct PageTableStats {
+    uint64_t adds;
+    uint64_t failed_adds;       // addEntry calls that found no free frame
+    uint64_t translations;
+    uint64_t removes;
+    uint64_t faults;            // swapped-out pages brought back in
+    uint64_t page_outs;
+    uint64_t shared_pages;      // pages a fork mapped onto its parent's frames
+    uint64_t cow_faults;        // writes to a shared frame that gave the page a copy of its own
+    uint64_t huge_promotions;   // huge pages mapped for new pages
+    uint64_t huge_collapses;    // huge pages made from base pages already mapped
+    uint64_t huge_splits;       // huge pages demoted to base pages
+} PageTableStats;
+
+// Latencies of the entry points, recorded only once timing is enabled
+typedef struct PageTableLatency {
+    LatencyHistogram add;
+    LatencyHistogram translate;
+    LatencyHistogram remove;
+} PageTableLatency;
+
+// Frames a shard's cache takes from (or hands back to) the shared allocator at a time
+#define FRAME_BATCH 32
 
 class PageTable {
 private:
     int _page_size;
-    std::map<std::string, int> _table;
+    int _levels;                          // depth of every radix tree, at least 2
+    std::atomic<uint32_t> _num_entries;
+    std::atomic<uint32_t> _num_dirs;      // upper-level nodes (roots included) of all trees
+    std::atomic<uint32_t> _num_leaves;
+    std::atomic<uint32_t> _num_huge;      // huge pages of all trees, each in place of a leaf
+    std::atomic<uint32_t> _sparse_huge;   // huge pages kept whole with pages no longer mapped
+    PromotePolicy _promote;
+    DemotePolicy _demote;
+    // Page table entries mapping each frame: above one the frame is shared, copy-on-write
+    // (the first write through any of its entries copies it) unless it belongs to a shared
+    // memory segment. A segment's frames belong to it, mapped or not, until it is released
+    std::atomic<uint32_t> *_frame_refs;
+    std::atomic<uint32_t> _shared_mappings;   // sum of refs - 1 over all frames, i.e. frames saved
+    uint8_t *_frame_shared;               // 1 for frames of a shared memory segment, written in place
+    // 1 for frames whose contents changed since clearDirty(): written through
+    // getWritableAddress, filled by a copy-on-write, a move or a page-in, or freed
+    std::atomic<uint8_t> *_frame_dirty;
+    std::vector<std::vector<int32_t>> _segments;   // frames of each shared memory segment by id, empty once released
+    std::vector<PageTableNode*> _roots;   // indexed by pid
+    std::vector<uint32_t> _pid_entries;   // mapped pages of each pid
+    std::vector<uint8_t> _pid_shares;     // 1 once a pid may map frames another pid maps (see sharesFrames)
+    FrameAllocator _frames;
+    TlbConfig _tlb_config;
+
+    // A pid's tree, TLB and counters belong to the shard of the pid (see setShards); with
+    // more than one shard, frames come from per-shard caches refilled under _frames_lock,
+    // or only from the frames handed out to them while _handed_out (see handOutFrames)
+    uint32_t _num_shards;
+    std::vector<Tlb> _tlbs;
+    std::vector<PageTableStats> _stats;
+    std::vector<PageTableLatency> _latency;
+    bool _timing;
+    std::vector<std::vector<int32_t>> _frame_caches;
+    std::mutex _frames_lock;
+    bool _handed_out;
+    void *_memory;                        // for copy-on-write and moving pages to and from swap
+    PhysicalMemory *_physical;            // freed frames are discarded from it, if set
+    SwapFile *_swap;                      // NULL unless demand paging is enabled
+    PageReplacer *_replacer;
+    ReplacementPolicy _policy;
+    std::vector<PageKey> _frame_owner;    // page held by each resident frame (with swap only)
 
-    std::vector<std::string> sortedKeys();
+    int32_t* lookupEntry(PageKey key, PageTableHuge **huge = NULL);
+    int32_t* lookup(PageKey key);
+    void insert(PageKey key, int32_t frame);
+    PageTableNode* hugeParent(uint32_t pid, uint64_t page, bool create);
+    bool mapHuge(uint32_t pid, uint64_t page);
+    bool collapseHuge(uint32_t pid, uint64_t page);
+    PageTableLeaf* splitHuge(PageTableNode *parent, uint32_t pid, uint64_t page);
+    void dropHuge(PageTableHuge *huge, uint32_t pid);
+    bool splitSparseHuge(void *node, int level, uint32_t pid, uint64_t page_prefix);
+    bool reclaimHuge(uint32_t pid);
+    void freeNode(void *node, int level);
+    uint32_t shardOf(uint32_t pid);
+    int32_t obtainFrame(PageKey key);
+    int32_t takeFrame(PageKey key);
+    int32_t takeFrameRun();
+    void unrefFrame(uint32_t pid, int32_t frame);
+    void releaseFrame(uint32_t pid, int32_t frame);
+    void markDirty(int32_t first, int32_t count = 1);
+    void pageOut(int32_t frame);
+    int32_t faultIn(PageKey key, int32_t *entry);
+    int32_t copyOnWrite(uint32_t pid, uint64_t page_number, int32_t shared_frame);
+    void* cloneNode(void *node, int level);
+    int indexAt(uint64_t page, int level);
+    void collectEntries(void *node, int level, uint32_t pid, uint64_t page_prefix, std::vector<std::pair<PageKey, int>>& entries,
+                        std::vector<std::pair<PageKey, PageTableHuge*>> *huge = NULL);
+    void collectHuge(void *node, int level, std::vector<PageTableHuge*>& huge);
+    void printEntries(void *node, int level, uint32_t pid, uint64_t page_prefix, uint64_t first_page, uint64_t last_page,
+                      RowWriter& rows);
 
 public:
-    PageTable(int page_size);
+    PageTable(int page_size, uint64_t memory_size, uint64_t virtual_size);
     ~PageTable();
 
-    void addEntry(uint32_t pid, int page_number);
-    int getPhysicalAddress(uint32_t pid, uint32_t virtual_address);
+    int addEntry(uint32_t pid, uint64_t page_number);
+    bool mapRange(uint32_t pid, uint64_t first_page, uint64_t last_page);
+    int64_t getPhysicalAddress(uint32_t pid, uint64_t virtual_address);
+    int64_t getWritableAddress(uint32_t pid, uint64_t virtual_address);
     void print();
-    int getPageNumber(uint32_t virtual_address);
+    void print(uint32_t pid, uint64_t first_page, uint64_t last_page);
+    uint64_t getPageNumber(uint64_t virtual_address);
     int getPageSize();
-    void removeEntry(uint32_t pid, int page_number);
+    int numLevels();
+    uint32_t numNodes();
+    uint64_t nodeBytes();
+    void removeEntry(uint32_t pid, uint64_t page_number);
+    uint32_t numEntries();
+    uint32_t numEntries(uint32_t pid);
+    uint32_t numFreeFrames();
+    uint32_t numFrames();
+    void configureTlb(TlbConfig config);
+    void flushTlb(uint32_t pid);
+    void printTlb();
+    PageTableStats getStats();
+    void enableTiming(bool timing);
+    PageTableLatency getLatency();
+    uint32_t compactFrames(void *memory, uint64_t *bytes_moved);
+    void setPhysicalMemory(PhysicalMemory *physical);
+    PhysicalMemory* physicalMemory();
+    void setShards(uint32_t num_shards);
+    void reservePids(uint32_t last_pid);
+    void handOutFrames(const std::vector<uint64_t>& counts);
+    void drainFrameCaches();
+    bool enableSwap(std::string path, uint32_t num_slots, ReplacementPolicy policy, void *memory);
+    void printPaging();
+    bool canShareFrames();
+    void forkEntries(uint32_t parent_pid, uint32_t pid);
+    int32_t createSegment(uint64_t num_pages);
+    void mapSegment(uint32_t segment, uint32_t pid, uint64_t first_page);
+    void releaseSegment(uint32_t segment, uint32_t pid);
+    uint32_t sharedMappings();
+    bool sharesFrames(uint32_t pid);
+    void printSharing();
+    void setHugePolicy(PromotePolicy promote, DemotePolicy demote);
+    uint64_t hugePageSize();
+    void printHuge();
+    std::vector<std::pair<PageKey, int>> sortedEntries();
+    bool swapEnabled();
+    bool hugePagesEnabled();
+    void collectMappings(std::vector<std::pair<PageKey, int>>& entries, std::vector<std::pair<PageKey, PageTableHuge*>>& huge);
+    void frameState(int32_t frame, uint32_t *refs, bool *used, bool *shared);
+    const std::vector<int32_t>& segmentFrames(uint32_t segment);
+    void clear();
+    void restoreFrame(int32_t frame, uint32_t refs, bool used, bool shared);
+    void restoreMapping(PageKey key, int32_t frame);
+    void restoreHuge(PageKey key, const PageTableHuge& huge);
+    uint32_t restoreSegment(const int32_t *frames, uint32_t count);
+    bool frameDirty(int32_t frame);
+    void clearDirty();
 };
 
 #endif // __PAGETABLE_H_
- 
\ No newline at end of file
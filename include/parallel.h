@@ -0,0 +1,27 @@
+#ifndef __PARALLEL_H_
+#define __PARALLEL_H_
+
+#include <string>
+#include <cstdint>
+#include "commands.h"
+
+// Batch runs on several threads: commands are routed to a worker by pid (pid % threads),
+// so each process's commands still run in trace order on one thread. Commands that look
+// at every process (print mmu/page/processes/tlb/stats, compact, save, checkpoint, load,
+// exit), at two of them (copy between processes, fork) or at shared memory segments
+// (shm_create, shm_attach) are barriers: the workers finish everything before them, then
+// they run alone on the calling thread. So is a create or allocate that might not fit in
+// the memory (or the frames) left if everything before it in its segment took all it asked
+// for, so whether an allocation near the limit succeeds never depends on how the threads
+// interleave. So are writes and frees (set, fill, copy, free, terminate, shm_detach) of a
+// process that forked, was forked or attached a segment: the frames it maps may be
+// another process's too.
+// Output is written in trace order, and is the same every run: each worker maps frames
+// only from those handed to it when its segment starts (see PageTable::handOutFrames),
+// and gets no huge page from the allocator until the next barrier.
+#define PARALLEL_MAX_THREADS 64
+#define PARALLEL_SEGMENT_LINES 65536     // most commands handed to the workers at once
+
+int runParallel(std::string trace_file, uint32_t threads, Mmu *mmu, PageTable *page_table, void *memory, uint64_t counts[CmdCount]);
+
+#endif // __PARALLEL_H_
@@ -0,0 +1,45 @@
+#ifndef __PHYSICALMEMORY_H_
+#define __PHYSICALMEMORY_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+
+#define DEFAULT_MEMORY_SIZE 67108864        // 64 MB
+#define HUGETLB_PAGE_SIZE (2 << 20)         // default x86-64/arm64 huge page
+
+enum HugePages : uint8_t {HugeOff, HugeThp, HugeTlb};
+
+// The simulated physical memory: one anonymous private mapping reserved up front but
+// committed by the kernel only as frames are first written, so untouched frames cost no
+// RSS and multi-GB memories start instantly. Optionally backed by transparent huge pages
+// (MADV_HUGEPAGE) or hugetlbfs (MAP_HUGETLB, falling back to THP if none are available).
+// discard() hands the host pages under a freed range back with MADV_DONTNEED. mapImage()
+// replaces the contents with a file's, mapped copy-on-write so pages are read in as touched.
+class PhysicalMemory {
+private:
+    uint8_t *_base;
+    uint64_t _size;
+    size_t _mapped;            // _size rounded up to whole host (or huge) pages
+    size_t _granule;           // smallest range that can be discarded
+    HugePages _huge;
+    bool _image;               // a file is mapped over the memory (see mapImage)
+    std::atomic<uint64_t> _discards;          // worker threads discard concurrently
+    std::atomic<uint64_t> _discarded_bytes;
+
+public:
+    PhysicalMemory(uint64_t size, HugePages huge);
+    ~PhysicalMemory();
+
+    bool isMapped();
+    void* base();
+    uint64_t size();
+    HugePages hugePages();
+    void discard(uint64_t offset, uint64_t length);
+    bool mapImage(int fd, uint64_t offset);
+    uint64_t residentBytes();
+    uint64_t discards();
+    uint64_t discardedBytes();
+};
+
+#endif // __PHYSICALMEMORY_H_
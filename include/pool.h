@@ -0,0 +1,82 @@
+#ifndef __POOL_H_
+#define __POOL_H_
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Slab allocator for fixed-size records: objects are carved out of chunks of CHUNK
+// slots and released slots are reused through an intrusive free list, so records
+// of one kind stay packed together and are never returned to the heap piecemeal
+template <typename T, size_t CHUNK = 256>
+class Pool {
+private:
+    union Slot {
+        Slot *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::vector<Slot*> _chunks;
+    Slot *_free;
+    size_t _live;
+
+    void grow()
+    {
+        Slot *chunk = new Slot[CHUNK];
+        _chunks.push_back(chunk);
+        for (size_t i = CHUNK; i > 0; i--)
+        {
+            chunk[i - 1].next = _free;
+            _free = &chunk[i - 1];
+        }
+    }
+
+public:
+    Pool()
+    {
+        _free = NULL;
+        _live = 0;
+    }
+
+    // Records still live are not destroyed, owners release them first
+    ~Pool()
+    {
+        for (size_t i = 0; i < _chunks.size(); i++)
+        {
+            delete[] _chunks[i];
+        }
+    }
+
+    T* allocate()
+    {
+        if (_free == NULL)
+        {
+            grow();
+        }
+        Slot *slot = _free;
+        _free = slot->next;
+        _live++;
+        return new (slot->storage) T();
+    }
+
+    void release(T *obj)
+    {
+        obj->~T();
+        Slot *slot = reinterpret_cast<Slot*>(obj);
+        slot->next = _free;
+        _free = slot;
+        _live--;
+    }
+
+    size_t live()
+    {
+        return _live;
+    }
+
+    size_t capacity()
+    {
+        return _chunks.size() * CHUNK;
+    }
+};
+
+#endif // __POOL_H_
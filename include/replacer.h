@@ -0,0 +1,120 @@
+#ifndef __REPLACER_H_
+#define __REPLACER_H_
+
+#include <cstdint>
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+enum ReplacementPolicy : uint8_t {ReplaceFifo, ReplaceLru, ReplaceClock, ReplaceArc};
+
+// Doubly linked list threaded through arrays indexed by frame number, so frames can be
+// appended, unlinked and moved in constant time without allocating
+class FrameList {
+private:
+    std::vector<int32_t> _prev;
+    std::vector<int32_t> _next;
+    std::vector<bool> _linked;
+    int32_t _head;
+    int32_t _tail;
+    uint32_t _size;
+
+public:
+    FrameList(uint32_t num_frames);
+
+    void pushBack(uint32_t frame);
+    void remove(uint32_t frame);
+    int32_t front();
+    bool contains(uint32_t frame);
+    uint32_t size();
+};
+
+// Chooses which resident page to evict when no frame is free. Frames are reported as
+// pages are brought in (insert), referenced (touch) and unmapped (remove); keys are
+// PageKeys of the pages, used by policies that remember evicted pages
+class PageReplacer {
+public:
+    virtual ~PageReplacer() {}
+
+    virtual void insert(uint32_t frame, uint64_t key) = 0;
+    virtual void touch(uint32_t frame) = 0;
+    virtual void remove(uint32_t frame) = 0;
+    virtual int32_t victim(uint64_t incoming) = 0;     // detaches and returns the frame to evict, -1 if none
+};
+
+class FifoReplacer : public PageReplacer {
+private:
+    FrameList _queue;
+
+public:
+    FifoReplacer(uint32_t num_frames);
+
+    void insert(uint32_t frame, uint64_t key);
+    void touch(uint32_t frame);
+    void remove(uint32_t frame);
+    int32_t victim(uint64_t incoming);
+};
+
+class LruReplacer : public PageReplacer {
+private:
+    FrameList _order;     // least recently used at the front
+
+public:
+    LruReplacer(uint32_t num_frames);
+
+    void insert(uint32_t frame, uint64_t key);
+    void touch(uint32_t frame);
+    void remove(uint32_t frame);
+    int32_t victim(uint64_t incoming);
+};
+
+// Second chance: the hand sweeps the frames, clearing reference bits until it finds an
+// unreferenced resident frame
+class ClockReplacer : public PageReplacer {
+private:
+    std::vector<uint8_t> _referenced;
+    std::vector<uint8_t> _resident;
+    uint32_t _num_resident;
+    uint32_t _hand;
+
+public:
+    ClockReplacer(uint32_t num_frames);
+
+    void insert(uint32_t frame, uint64_t key);
+    void touch(uint32_t frame);
+    void remove(uint32_t frame);
+    int32_t victim(uint64_t incoming);
+};
+
+// Adaptive replacement cache: T1 holds pages seen once, T2 pages seen again; B1/B2
+// remember recently evicted keys of each and steer the target size of T1 (_target)
+class ArcReplacer : public PageReplacer {
+private:
+    uint32_t _capacity;
+    uint32_t _target;
+    FrameList _t1;
+    FrameList _t2;
+    std::vector<uint64_t> _keys;          // page held by each resident frame
+    std::list<uint64_t> _b1;
+    std::list<uint64_t> _b2;
+    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> _b1_index;
+    std::unordered_map<uint64_t, std::list<uint64_t>::iterator> _b2_index;
+    int _pending_ghost;                   // 1 or 2 if the key passed to victim() was in B1/B2
+    uint64_t _pending_key;
+
+    int adapt(uint64_t key);
+    void remember(std::list<uint64_t>& ghosts, std::unordered_map<uint64_t, std::list<uint64_t>::iterator>& index, uint64_t key);
+
+public:
+    ArcReplacer(uint32_t num_frames);
+
+    void insert(uint32_t frame, uint64_t key);
+    void touch(uint32_t frame);
+    void remove(uint32_t frame);
+    int32_t victim(uint64_t incoming);
+};
+
+PageReplacer* createReplacer(ReplacementPolicy policy, uint32_t num_frames);
+const char* replacementPolicyName(ReplacementPolicy policy);
+
+#endif // __REPLACER_H_
@@ -0,0 +1,139 @@
+#ifndef __SNAPSHOT_H_
+#define __SNAPSHOT_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "mmu.h"
+#include "pagetable.h"
+
+// Snapshot file layout: a chain of records, each starting on a multiple of SNAPSHOT_ALIGN
+// right after the one before. The first is a full snapshot; each checkpoint appends one
+// with only what changed since the record before it. Records hold fixed-size structs in
+// host byte order, so a restore reads them in place from a read-only mapping of the file.
+// Every section starts on a multiple of 8 bytes and the header gives its offset from the
+// start of the record and its record count:
+//   SnapshotHeader
+//   names           each as uint32 length + bytes (ids are positions in this table)
+//   processes       SnapshotProcess, in pid order
+//   variables       SnapshotVariable, each process's in its own order
+//   holes           SnapshotHole, each process's in address order
+//   segments        SnapshotSegment, then their frames (int32) and attached pids (uint32)
+//   mappings        SnapshotMapping of every base page, in (pid, page) order
+//   huge pages      SnapshotHuge, in (pid, page) order
+//   frames          SnapshotFrame for every frame (full snapshots only)
+//   frame changes   SnapshotFrameChange for each frame that changed (checkpoints only)
+//   memory image    at image_offset (a multiple of SNAPSHOT_ALIGN). In a full snapshot one
+//                   page per frame, free frames left as holes in the file; in a checkpoint
+//                   the pages of the frame changes that carry data, one after the other
+// The processes, variables, holes and segments of a checkpoint are all of them; its
+// mappings and huge pages are only the ones that changed, a removed one with frame
+// PT_UNMAPPED. A restore maps the full snapshot's image over physical memory copy-on-write
+// instead of reading it, then reads in the frames the checkpoints changed.
+#define SNAPSHOT_MAGIC "MSSN"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_ALIGN 65536        // covers host pages of up to 64 KB
+
+enum SnapshotSection : uint8_t {SecNames, SecProcesses, SecVariables, SecHoles, SecSegments, SecSegmentFrames,
+                                SecAttachments, SecMappings, SecHuge, SecFrames, SecFrameChanges, SectionCount};
+
+typedef struct SnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t num_frames;
+    uint64_t memory_size;
+    uint64_t virtual_size;
+    uint32_t first_pid;
+    uint32_t next_pid;
+    uint32_t sequence;              // 0 for the full snapshot, n for the nth checkpoint after it
+    uint32_t reserved;
+    uint64_t offsets[SectionCount];
+    uint64_t counts[SectionCount];
+    uint64_t image_offset;
+    uint64_t length;                // bytes from the start of this record to the next
+} SnapshotHeader;
+
+typedef struct SnapshotProcess {
+    uint32_t pid;
+    uint32_t num_variables;
+    uint32_t num_holes;
+    uint32_t reserved;
+} SnapshotProcess;
+
+typedef struct SnapshotVariable {
+    uint64_t virtual_address;
+    uint64_t size;
+    uint32_t name;
+    uint8_t type;
+    uint8_t flags;
+    uint16_t padding;       // page-boundary padding before virtual_address (0 in files from before it was kept)
+} SnapshotVariable;
+
+typedef struct SnapshotHole {
+    uint64_t address;
+    uint64_t size;
+} SnapshotHole;
+
+typedef struct SnapshotSegment {
+    uint32_t name;
+    uint32_t num_frames;
+    uint64_t size;
+    uint32_t num_pids;
+    uint32_t reserved;
+} SnapshotSegment;
+
+typedef struct SnapshotMapping {
+    PageKey key;
+    int32_t frame;
+    uint32_t reserved;
+} SnapshotMapping;
+
+typedef struct SnapshotHuge {
+    PageKey key;                    // first page
+    int32_t frame;
+    uint32_t used;
+    uint64_t mapped[PT_FANOUT / 64];
+} SnapshotHuge;
+
+typedef struct SnapshotFrame {
+    uint32_t refs;
+    uint8_t used;
+    uint8_t shared;
+    uint16_t reserved;
+} SnapshotFrame;
+
+typedef struct SnapshotFrameChange {
+    uint32_t frame;
+    uint32_t refs;
+    uint8_t used;
+    uint8_t shared;
+    uint8_t data;                   // 1 if the frame's page is in the record's image
+    uint8_t reserved;
+} SnapshotFrameChange;
+
+// What a save or checkpoint wrote, or a load restored
+typedef struct SnapshotInfo {
+    uint32_t processes;
+    uint64_t pages;                 // mapped pages
+    uint64_t image_bytes;           // bytes of pages written (restored: of the frames in use)
+    uint32_t sequence;              // of the last record
+} SnapshotInfo;
+
+// A variable of a snapshot, for tools that only need to know what exists in it
+typedef struct SnapshotListing {
+    uint32_t pid;
+    std::string name;
+    DataType type;
+} SnapshotListing;
+
+// All return NULL on success, else what went wrong (the state is left as it was if a load
+// fails before the memory image is mapped)
+const char* saveSnapshot(std::string file, Mmu *mmu, PageTable *page_table, void *memory, SnapshotInfo *info);
+const char* checkpointSnapshot(std::string file, Mmu *mmu, PageTable *page_table, void *memory, SnapshotInfo *info);
+const char* loadSnapshot(std::string file, Mmu *mmu, PageTable *page_table, void *memory, SnapshotInfo *info);
+const char* mergeSnapshot(std::string chain_file, std::string out_file, SnapshotInfo *info);
+bool readSnapshotHeader(std::string file, SnapshotHeader *header);
+bool listSnapshot(std::string file, uint32_t *next_pid, std::vector<uint32_t>& pids, std::vector<SnapshotListing>& variables);
+
+#endif // __SNAPSHOT_H_
@@ -0,0 +1,32 @@
+#ifndef __STATS_H_
+#define __STATS_H_
+
+#include <cstdint>
+#include "histogram.h"
+#include "commands.h"
+
+// Per-command counts (always on) and latency histograms (only once timing is enabled)
+class CommandStats {
+private:
+    uint64_t _counts[CmdCount];
+    LatencyHistogram _latency[CmdCount];
+    bool _timing;
+
+public:
+    CommandStats();
+
+    void enableTiming(bool timing);
+    bool timing();
+    void record(CommandType type, uint64_t nanoseconds);
+    void merge(const CommandStats& other);
+    void clear();
+    void print();
+};
+
+// Each thread records the commands it runs; worker threads merge theirs into the main
+// thread's at every barrier (see parallel.cpp)
+extern thread_local CommandStats command_stats;
+
+void printStats(Mmu *mmu, PageTable *page_table);
+
+#endif // __STATS_H_
@@ -0,0 +1,32 @@
+#ifndef __SWAPFILE_H_
+#define __SWAPFILE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Backing store for evicted pages: a scratch file divided into page-sized slots that
+// are read and written with pread/pwrite. The file is removed when the SwapFile closes
+class SwapFile {
+private:
+    std::string _path;
+    int _fd;
+    int _page_size;
+    uint32_t _num_slots;
+    uint32_t _next_slot;                 // slots at or above this have never been used
+    std::vector<uint32_t> _free_slots;
+
+public:
+    SwapFile(std::string path, int page_size, uint32_t num_slots);
+    ~SwapFile();
+
+    bool isOpen();
+    int32_t allocate();
+    void release(uint32_t slot);
+    bool write(uint32_t slot, const void *data);
+    bool read(uint32_t slot, void *data);
+    uint32_t numSlots();
+    uint32_t numUsed();
+};
+
+#endif // __SWAPFILE_H_
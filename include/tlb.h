@@ -0,0 +1,71 @@
+#ifndef __TLB_H_
+#define __TLB_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+enum TlbPolicy : uint8_t {Lru, Random};
+
+#define TLB_MAX_ENTRIES 1048576     // most entries (and ways) --tlb-entries/--tlb-ways accept
+
+typedef struct TlbConfig {
+    uint32_t entries;     // 0 disables the TLB
+    uint32_t ways;        // 0 (or >= entries) means fully associative
+    TlbPolicy policy;
+    bool asid;            // tag entries with the pid instead of flushing on every pid switch
+    uint8_t huge_shift;   // base pages per huge page as a power of two, 0 if there are none
+} TlbConfig;
+
+// A huge page takes one entry: page and frame are then those of the huge page's first base page
+typedef struct TlbEntry {
+    uint64_t page;
+    uint32_t pid;
+    int32_t frame;
+    bool valid;
+    bool huge;
+    uint64_t last_used;
+} TlbEntry;
+
+class Tlb {
+private:
+    TlbConfig _config;
+    uint32_t _num_sets;
+    uint32_t _ways;
+    std::vector<TlbEntry> _entries;
+    uint64_t _clock;
+    uint32_t _random_state;
+    uint32_t _current_pid;
+    uint64_t _hits;
+    uint64_t _misses;
+    uint64_t _evictions;
+    uint64_t _flushes;
+    uint64_t _huge_hits;
+
+    uint32_t setIndex(uint32_t pid, uint64_t page);
+    void contextSwitch(uint32_t pid);
+    TlbEntry* find(uint32_t pid, uint64_t page, bool huge);
+    void fill(uint32_t pid, uint64_t page, int32_t frame, bool huge);
+
+public:
+    Tlb(TlbConfig config);
+    ~Tlb();
+
+    static TlbConfig defaultConfig();
+
+    bool lookup(uint32_t pid, uint64_t page, int32_t *frame);
+    void insert(uint32_t pid, uint64_t page, int32_t frame);
+    void insertHuge(uint32_t pid, uint64_t page, int32_t frame);
+    void invalidate(uint32_t pid, uint64_t page);
+    void flush(uint32_t pid);
+    void flushAll();
+    void print();
+    uint64_t getHits();
+    uint64_t getMisses();
+    uint64_t getEvictions();
+    uint64_t reachPages();
+    uint32_t numValid();
+};
+
+#endif // __TLB_H_
@@ -0,0 +1,44 @@
+#ifndef __TRACEFILE_H_
+#define __TRACEFILE_H_
+
+#include <string>
+#include <cstdint>
+#include "commands.h"
+
+// Binary trace layout:
+//   "MSTR" magic, one version byte
+//   varint name count, then each name as varint length + bytes (ids are positions in this table)
+//   records: one opcode byte followed by its operands, numbers are LEB128 varints
+//     OpCreate         text_size data_size
+//     OpAllocate       pid name type(byte, 0 = unrecognized) num_elements
+//     OpSet            pid name offset type(byte) count values...
+//     OpPrintVariable  pid name
+//     OpFree           pid name
+//     OpTerminate      pid
+//     OpCompact        pid
+//     OpFill           pid name value (varint length + the value as typed)
+//     OpCopy           src_pid src_name dst_pid dst_name
+//     OpSum/Min/Max    pid name
+//     OpFork           pid
+//     OpShmCreate      name size
+//     OpShmAttach      pid name
+//     OpShmDetach      pid name
+//     OpSave/Load      file (varint length + bytes)
+//     OpCheckpoint     file (varint length + bytes)
+//     OpPrintMmuRange/PageRange  pid first last (an unreadable range as first 1, last 0)
+//     OpUsage          command (varint length + bytes) of a line too short for it
+//   set values are stored in the type of the variable at conversion time: chars as one
+//   byte, shorts/ints/longs as zigzag varints, floats and doubles as raw IEEE bytes
+#define TRACE_MAGIC "MSTR"
+#define TRACE_VERSION 1
+
+enum TraceOp : uint8_t {OpCreate, OpAllocate, OpSet, OpPrintMmu, OpPrintPage, OpPrintProcesses, OpPrintTlb,
+                        OpPrintVariable, OpFree, OpTerminate, OpExit, OpUnknown, OpPrintStats,
+                        OpCompact, OpCompactAll, OpFill, OpCopy, OpSum, OpMin, OpMax, OpFork,
+                        OpShmCreate, OpShmAttach, OpShmDetach, OpSave, OpLoad, OpCheckpoint,
+                        OpPrintMmuRange, OpPrintPageRange, OpUsage};
+
+int convertTrace(std::string text_file, std::string binary_file);
+int replayTrace(std::string binary_file, Mmu *mmu, PageTable *page_table, void *memory, uint64_t counts[CmdCount]);
+
+#endif // __TRACEFILE_H_
@@ -0,0 +1,150 @@
+#ifndef __TYPEDMEMORY_H_
+#define __TYPEDMEMORY_H_
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include "mmu.h"
+#include "pagetable.h"
+
+// Typed access to the elements of a variable in simulated memory. Every read and write
+// goes through transferVirtual, which translates once per page and moves each page run
+// with one memcpy, so elements that straddle a page boundary come out whole. The element
+// type is a template parameter: visitElementType turns a variable's DataType into it once
+// per command, and the loops below are then plain loops over T that the compiler can
+// vectorize. Whole-variable operations stream through a stack buffer of TYPED_CHUNK_BYTES.
+#define TYPED_CHUNK_BYTES 16384
+
+void transferVirtual(uint32_t pid, uint64_t address, uint8_t *buffer, uint64_t size, bool to_memory, PageTable *page_table, void *memory);
+
+// Text to element parsers in the manner of std::from_chars: no allocation and no exceptions,
+// the number must start at text and parsing stops at the first character not part of it;
+// false if text does not start with a number (a char takes the first character as is)
+bool parseElement(const char *text, char *value);
+bool parseElement(const char *text, short *value);
+bool parseElement(const char *text, int *value);
+bool parseElement(const char *text, float *value);
+bool parseElement(const char *text, long *value);
+bool parseElement(const char *text, double *value);
+
+/*
+    visitor: any object with a `template <typename T> void visit()` member
+    calls visitor.visit<T>() with T the C++ type of the elements of `type`
+*/
+template <typename Visitor>
+void visitElementType(DataType type, Visitor& visitor)
+{
+    switch (type)
+    {
+        case DataType::Char:   visitor.template visit<char>(); break;
+        case DataType::Short:  visitor.template visit<short>(); break;
+        case DataType::Int:    visitor.template visit<int>(); break;
+        case DataType::Float:  visitor.template visit<float>(); break;
+        case DataType::Long:   visitor.template visit<long>(); break;
+        case DataType::Double: visitor.template visit<double>(); break;
+        default: break;
+    }
+}
+
+template <typename T>
+inline uint64_t numElements(Variable *var)
+{
+    return var->size / sizeof(T);
+}
+
+template <typename T>
+void readElements(uint32_t pid, Variable *var, uint64_t first, uint64_t count, T *out, PageTable *page_table, void *memory)
+{
+    transferVirtual(pid, var->virtual_address + first * sizeof(T), (uint8_t*)out, count * sizeof(T), false, page_table, memory);
+}
+
+template <typename T>
+void writeElements(uint32_t pid, Variable *var, uint64_t first, uint64_t count, const T *values, PageTable *page_table, void *memory)
+{
+    transferVirtual(pid, var->virtual_address + first * sizeof(T), (uint8_t*)values, count * sizeof(T), true, page_table, memory);
+}
+
+// Sets every element of the variable to value
+template <typename T>
+void fillElements(uint32_t pid, Variable *var, T value, PageTable *page_table, void *memory)
+{
+    const uint64_t chunk_size = TYPED_CHUNK_BYTES / sizeof(T);
+    T chunk[chunk_size];
+    uint64_t total = numElements<T>(var);
+    std::fill(chunk, chunk + std::min(chunk_size, total), value);
+    for (uint64_t first = 0; first < total; first += chunk_size)
+    {
+        writeElements(pid, var, first, std::min(chunk_size, total - first), chunk, page_table, memory);
+    }
+}
+
+/*
+    copies the first min(source, destination) elements of src into dst, converting each
+    element with a cast when the types differ; returns the number of elements copied
+*/
+template <typename S, typename D>
+uint64_t copyElements(uint32_t src_pid, Variable *src, uint32_t dst_pid, Variable *dst, PageTable *page_table, void *memory)
+{
+    const uint64_t chunk_size = TYPED_CHUNK_BYTES / std::max(sizeof(S), sizeof(D));
+    S in[chunk_size];
+    D out[chunk_size];
+    uint64_t total = std::min(numElements<S>(src), numElements<D>(dst));
+    for (uint64_t first = 0; first < total; first += chunk_size)
+    {
+        uint64_t count = std::min(chunk_size, total - first);
+        readElements(src_pid, src, first, count, in, page_table, memory);
+        for (uint64_t i = 0; i < count; i++)
+        {
+            out[i] = (D)in[i];
+        }
+        writeElements(dst_pid, dst, first, count, out, page_table, memory);
+    }
+    return total;
+}
+
+// Sum (64-bit integer or double), minimum and maximum of the elements of a variable
+template <typename T>
+struct ElementSummary {
+    typedef typename std::conditional<std::is_floating_point<T>::value, double, int64_t>::type Sum;
+
+    uint64_t count;
+    Sum sum;
+    T min;
+    T max;
+};
+
+template <typename T>
+ElementSummary<T> summarizeElements(uint32_t pid, Variable *var, PageTable *page_table, void *memory)
+{
+    const uint64_t chunk_size = TYPED_CHUNK_BYTES / sizeof(T);
+    T chunk[chunk_size];
+    ElementSummary<T> summary;
+    summary.count = numElements<T>(var);
+    summary.sum = 0;
+    summary.min = summary.max = T();
+    for (uint64_t first = 0; first < summary.count; first += chunk_size)
+    {
+        uint64_t count = std::min(chunk_size, summary.count - first);
+        readElements(pid, var, first, count, chunk, page_table, memory);
+        if (first == 0)
+        {
+            summary.min = summary.max = chunk[0];
+        }
+        typename ElementSummary<T>::Sum sum = 0;
+        T low = summary.min;
+        T high = summary.max;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            sum += chunk[i];
+            low = std::min(low, chunk[i]);
+            high = std::max(high, chunk[i]);
+        }
+        summary.sum += sum;
+        summary.min = low;
+        summary.max = high;
+    }
+    return summary;
+}
+
+#endif // __TYPEDMEMORY_H_
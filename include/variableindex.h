@@ -0,0 +1,32 @@
+#ifndef __VARIABLEINDEX_H_
+#define __VARIABLEINDEX_H_
+
+#include <vector>
+#include <cstdint>
+
+struct Variable;
+
+// Open-addressing (linear probing) hash index from interned variable name id to
+// Variable*. The key is read from the variable itself, so a variable must be
+// erased before its name changes.
+class VariableIndex {
+private:
+    std::vector<Variable*> _slots;    // NULL = empty, tombstone() = erased
+    uint32_t _size;
+    uint32_t _used;                   // live entries + tombstones
+
+    static Variable* tombstone();
+    static uint32_t hash(uint32_t name);
+    void rehash(uint32_t capacity);
+
+public:
+    VariableIndex();
+    ~VariableIndex();
+
+    void insert(Variable *var);
+    Variable* find(uint32_t name);
+    bool erase(uint32_t name);
+    uint32_t size();
+};
+
+#endif // __VARIABLEINDEX_H_
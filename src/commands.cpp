@@ -0,0 +1,1009 @@
+#include <cstring>
+#include "commands.h"
+#include "stats.h"
+#include "typedmemory.h"
+
+static CommandType dispatchCommand(std::vector<std::string>& commandSplit, Mmu *mmu, PageTable *page_table, void *memory);
+
+// Where this thread's commands print to (worker threads capture their output, see parallel.cpp)
+static thread_local std::ostream *command_output = &std::cout;
+
+std::ostream& commandOutput()
+{
+    return *command_output;
+}
+
+void setCommandOutput(std::ostream *output)
+{
+    command_output = output;
+}
+
+/*
+    commandSplit: a command line already split into words (must not be empty)
+    runs the command, records it in command_stats and returns which kind of command it was
+*/
+CommandType executeCommand(std::vector<std::string>& commandSplit, Mmu *mmu, PageTable *page_table, void *memory)
+{
+    uint64_t start = command_stats.timing() ? statsNow() : 0;
+    CommandType command = dispatchCommand(commandSplit, mmu, page_table, memory);
+    command_stats.record(command, command_stats.timing() ? statsNow() - start : 0);
+    return command;
+}
+
+static CommandType dispatchCommand(std::vector<std::string>& commandSplit, Mmu *mmu, PageTable *page_table, void *memory)
+{
+    CommandType command;
+    //a line too short for its command gets its usage instead of running (no command needs
+    //more than COMMAND_MAX_WORDS words, so longer lines skip the lookup)
+    if(commandSplit.size() < COMMAND_MAX_WORDS){
+        const CommandSyntax *syntax = commandSyntax(commandSplit.at(0));
+        if(syntax != NULL && commandSplit.size() < syntax->words){
+            commandOutput() << "error: usage is " << syntax->usage << std::endl;
+            return syntax->type;
+        }
+    }
+
+    if(commandSplit.at(0) == "exit"){
+        return CommandType::CmdExit;
+    }
+
+    if(commandSplit.at(0) == "create"){ //create <text_size> <data_size>
+        command = CommandType::CmdCreate;
+        int textSize = allNums(commandSplit.at(1));
+        int dataSize = allNums(commandSplit.at(2));
+        createProcess(textSize, dataSize, mmu, page_table);
+        
+        //assign a process id
+        //allocate some amount of startup memory for the process
+            //text/code: size of binary executable - user specified number (2048-16384 bytes)
+            //Data/Globals: size of global variables - user specified number (0 - 1024 bytes)
+            //Stack: constant (65536 bytes)
+        //prints the PID
+        commandOutput() << std::endl;
+    }else if(commandSplit.at(0) == "allocate"){ //allocate <PID> <var_name> <data_type> <number_of_elements>
+        command = CommandType::CmdAllocate;
+        //Allocated memory on the heap (how mcuch depends on the data type and the number of elements)
+            //N chars (N bytes)
+            //N shorts (N * 2 bytes)
+            //N ints/floats (N * 4 bytes)
+            //N longs/doubles (N * 8 bytes)
+        //print the virtual memory address
+        uint32_t pid = allNums(commandSplit.at(1));
+        if(mmu->processExists(pid)){
+            std::string varName = commandSplit.at(2);
+            Variable *var = mmu->getVariable(pid, varName);
+            if(var == NULL){
+                DataType type = parseDataType(commandSplit.at(3));
+                uint64_t numElements = allNums(commandSplit.at(4));
+                if(type == DataType::FreeSpace){
+                    commandOutput() << "error: data type not recognized";
+                }else {
+                    allocateVariable(pid, varName, type, numElements, mmu, page_table);
+                }
+            }else {
+                commandOutput() << "error: variable already exists";
+            }                
+        }else {
+            commandOutput() << "error: process not found";
+        }
+        commandOutput() << std::endl;
+    }else if(commandSplit.at(0) == "set"){ //set <PID> <var_name> <offset> <value_0> <value_2> ... <value_N>
+        command = CommandType::CmdSet;
+        uint32_t pid = allNums(commandSplit.at(1));
+        if(mmu->processExists(pid)){
+            std::string varName = commandSplit.at(2);
+            Variable *var = mmu->getVariable(pid, varName);
+            if(var != NULL){
+                //do setting process here (all values at once, see setVariableValues)
+                uint64_t offset = allNums(commandSplit.at(3));
+                setVariableValues(pid, var, offset, commandSplit, 4, page_table, memory);
+            }else {
+                commandOutput() << "error: variable not found"<<std::endl;
+            }
+        }else {
+            commandOutput() << "error: process not found" <<std::endl;
+        }
+        //sote integer, float, or character values in memeory
+        //Set the value for the variable <var_name> starting at <offset>
+        //NOTE: multiple contiguous values can be set with one command
+    }else if(commandSplit.at(0) == "print"){ //print <object>
+        command = CommandType::CmdPrint;
+        //if <object> is "mmu", print the MMU memory table
+        //if <object> is "page", print the page table (do not need to print anything for free frames)
+        //either can be narrowed to one process: print mmu|page <PID> [<first>[-<last>]]
+        if(commandSplit.at(1) == "mmu" || commandSplit.at(1) == "page"){
+            bool page = (commandSplit.at(1) == "page");
+            if(commandSplit.size() == 2 && page){
+                page_table->print();
+            }else if(commandSplit.size() == 2){
+                mmu->print();
+            }else{
+                uint64_t first = 0;
+                uint64_t last = UINT64_MAX;
+                if(commandSplit.size() > 3 && !parseRange(commandSplit.at(3), &first, &last)){
+                    first = 1;
+                    last = 0;
+                }
+                printTableRange(page, (uint32_t)allNums(commandSplit.at(2)), first, last, mmu, page_table);
+            }
+        }else if(commandSplit.at(1) == "processes"){//if <object> is "process", print a list of PID's for processes that are still running
+            mmu->printProcesses();
+        }else if(commandSplit.at(1) == "tlb"){ //if <object> is "tlb", print TLB hit/miss/eviction counts
+            page_table->printTlb();
+        }else if(commandSplit.at(1) == "stats"){ //if <object> is "stats", print counters, latency and fragmentation
+            printStats(mmu, page_table);
+        }else{ 
+            //if <object> is a "<PID>":<var_name>", print the value of the variable for that process"
+            //If variable has more than 4 elements, just print the first 4 followed by "... [N items]" (where N is the number of elements)
+            std::string toSplit = ":";
+            std::string tempString = commandSplit.at(1);
+            size_t position = tempString.find(toSplit);
+            std::string stringPid = tempString.substr(0,position);
+            uint32_t pid = allNums(stringPid);
+            tempString.erase(0, (position + toSplit.length()));
+            printVariable(pid, tempString, mmu, page_table, memory);
+        }
+    }else if(commandSplit.at(0) == "free"){ //free <PID> <var_name>
+        command = CommandType::CmdFree;
+        uint32_t pid = allNums(commandSplit.at(1));
+        if(mmu->processExists(pid)){
+            std::string varName = commandSplit.at(2);
+            Variable *var = mmu->getVariable(pid, varName);
+            if(var != NULL){
+                //do freeing process here
+                freeVariable(pid, var, mmu, page_table);
+                autoCompact(pid, mmu, page_table, memory);
+            }else {
+                commandOutput() << "error: variable not found" << std::endl;
+            }
+        }else {
+            commandOutput() << "error: process not found" << std::endl;
+        }
+        //Deallocate memory on the heap that is associated with <var_name>
+            //N chars (N bytes)
+            //N shorts (N * 2 bytes)
+            //N ints/floats (N * 4 bytes)
+            //N longs/doubles (N * 8 bytes)
+            //Can multiple contiguous vales be deallocated with one command?
+    }else if(commandSplit.at(0) == "terminate"){ //terminate <PID>
+        command = CommandType::CmdTerminate;
+        uint32_t pid = allNums(commandSplit.at(1));
+        if(mmu->processExists(pid)){
+            //do termination process here
+            terminateProcess(pid, mmu, page_table);
+        }else {
+            commandOutput() << "error: process not found" << std::endl;
+        }
+        //Kill the specified process
+        //Free all memory associated with this process
+        //Deallocate all memory associated with the process
+    }else if(commandSplit.at(0) == "compact"){ //compact [<PID>]
+        command = CommandType::CmdCompact;
+        if(commandSplit.size() > 1){
+            uint32_t pid = allNums(commandSplit.at(1));
+            if(mmu->processExists(pid)){
+                printCompaction(compactProcesses(std::vector<uint32_t>(1, pid), mmu, page_table, memory, true));
+            }else {
+                commandOutput() << "error: process not found" << std::endl;
+            }
+        }else {
+            printCompaction(compactProcesses(mmu->getPids(), mmu, page_table, memory, true));
+        }
+    }else if(commandSplit.at(0) == "fork"){ //fork <PID>
+        command = CommandType::CmdFork;
+        //create a child process that shares every page of the parent until either writes it
+        uint32_t pid = allNums(commandSplit.at(1));
+        if(mmu->processExists(pid)){
+            forkProcess(pid, mmu, page_table);
+        }else {
+            commandOutput() << "error: process not found";
+        }
+        commandOutput() << std::endl;
+    }else if(commandSplit.at(0) == "shm_create"){ //shm_create <name> <size>
+        command = CommandType::CmdShm;
+        //create a named segment of whole pages that processes can attach to and share
+        createSegment(mmu->internName(commandSplit.at(1)), allNums(commandSplit.at(2)), mmu, page_table);
+        commandOutput() << std::endl;
+    }else if(commandSplit.at(0) == "shm_attach"){ //shm_attach <PID> <name>
+        command = CommandType::CmdShm;
+        //map the segment's frames into the process's virtual space, print its virtual address
+        uint32_t pid = allNums(commandSplit.at(1));
+        if(mmu->processExists(pid)){
+            attachSegment(pid, mmu->internName(commandSplit.at(2)), mmu, page_table);
+        }else {
+            commandOutput() << "error: process not found";
+        }
+        commandOutput() << std::endl;
+    }else if(commandSplit.at(0) == "shm_detach"){ //shm_detach <PID> <name>
+        command = CommandType::CmdShm;
+        uint32_t pid = allNums(commandSplit.at(1));
+        if(mmu->processExists(pid)){
+            detachSegment(pid, mmu->getVariable(pid, commandSplit.at(2)), mmu, page_table);
+        }else {
+            commandOutput() << "error: process not found" << std::endl;
+        }
+    }else if(commandSplit.at(0) == "fill"){ //fill <PID> <var_name> <value>
+        command = CommandType::CmdFill;
+        //set every element of the variable to <value>
+        uint32_t pid = allNums(commandSplit.at(1));
+        if(mmu->processExists(pid)){
+            Variable *var = mmu->getVariable(pid, commandSplit.at(2));
+            if(var != NULL){
+                fillVariable(pid, var, commandSplit.at(3), page_table, memory);
+            }else {
+                commandOutput() << "error: variable not found" << std::endl;
+            }
+        }else {
+            commandOutput() << "error: process not found" << std::endl;
+        }
+    }else if(commandSplit.at(0) == "copy"){ //copy <PID>:<var_name> <PID>:<var_name>
+        command = CommandType::CmdCopy;
+        //copy the elements of the first variable into the second, converting to its type
+        uint32_t srcPid;
+        uint32_t dstPid;
+        Variable *src = lookupVariable(commandSplit.at(1), mmu, &srcPid);
+        Variable *dst = (src != NULL) ? lookupVariable(commandSplit.at(2), mmu, &dstPid) : NULL;
+        if(dst != NULL){
+            copyVariable(srcPid, src, dstPid, dst, page_table, memory);
+        }
+    }else if(commandSplit.at(0) == "sum" || commandSplit.at(0) == "min" || commandSplit.at(0) == "max"){ //sum|min|max <PID>:<var_name>
+        command = CommandType::CmdReduce;
+        Reduction reduction = (commandSplit.at(0) == "sum") ? Reduction::ReduceSum :
+                              (commandSplit.at(0) == "min") ? Reduction::ReduceMin : Reduction::ReduceMax;
+        uint32_t pid;
+        Variable *var = lookupVariable(commandSplit.at(1), mmu, &pid);
+        if(var != NULL){
+            printReduction(reduction, pid, var, page_table, memory);
+        }
+    }else if(commandSplit.at(0) == "save"){ //save <file>
+        command = CommandType::CmdSnapshot;
+        //write every process, page mapping and the memory image to a snapshot file
+        SnapshotInfo info;
+        const char *error = saveSnapshot(commandSplit.at(1), mmu, page_table, memory, &info);
+        printSnapshot("saved", commandSplit.at(1), error, info);
+    }else if(commandSplit.at(0) == "checkpoint"){ //checkpoint <file>
+        command = CommandType::CmdSnapshot;
+        //append what changed since the last save, checkpoint or load of the same file
+        SnapshotInfo info;
+        const char *error = checkpointSnapshot(commandSplit.at(1), mmu, page_table, memory, &info);
+        printSnapshot("checkpointed", commandSplit.at(1), error, info);
+    }else if(commandSplit.at(0) == "load"){ //load <file>
+        command = CommandType::CmdSnapshot;
+        //replace every process with the ones in a snapshot file, mapping its memory image
+        SnapshotInfo info;
+        const char *error = loadSnapshot(commandSplit.at(1), mmu, page_table, memory, &info);
+        printSnapshot("loaded", commandSplit.at(1), error, info);
+    }else{ //error
+        command = CommandType::CmdUnknown;
+        commandOutput() << "error: command not recognized" << std::endl;
+    }
+
+
+    return command;
+}
+
+const char* commandTypeName(CommandType type)
+{
+    static const char *names[] = {"create", "allocate", "set", "print", "free", "terminate", "compact", "fill", "copy", "reduce",
+                                  "fork", "shm", "snapshot", "exit", "unknown"};
+    return names[type];
+}
+
+static const CommandSyntax COMMAND_SYNTAX[] = {
+    {"create", CmdCreate, 3, "create <text_size> <data_size>"},
+    {"allocate", CmdAllocate, 5, "allocate <PID> <var_name> <data_type> <number_of_elements>"},
+    {"set", CmdSet, 5, "set <PID> <var_name> <offset> <value_0> ... <value_N>"},
+    {"print", CmdPrint, 2, "print <object>"},
+    {"free", CmdFree, 3, "free <PID> <var_name>"},
+    {"terminate", CmdTerminate, 2, "terminate <PID>"},
+    {"compact", CmdCompact, 1, "compact [<PID>]"},
+    {"fork", CmdFork, 2, "fork <PID>"},
+    {"shm_create", CmdShm, 3, "shm_create <name> <size>"},
+    {"shm_attach", CmdShm, 3, "shm_attach <PID> <name>"},
+    {"shm_detach", CmdShm, 3, "shm_detach <PID> <name>"},
+    {"fill", CmdFill, 4, "fill <PID> <var_name> <value>"},
+    {"copy", CmdCopy, 3, "copy <PID>:<var_name> <PID>:<var_name>"},
+    {"sum", CmdReduce, 2, "sum <PID>:<var_name>"},
+    {"min", CmdReduce, 2, "min <PID>:<var_name>"},
+    {"max", CmdReduce, 2, "max <PID>:<var_name>"},
+    {"save", CmdSnapshot, 2, "save <file>"},
+    {"checkpoint", CmdSnapshot, 2, "checkpoint <file>"},
+    {"load", CmdSnapshot, 2, "load <file>"},
+    {"exit", CmdExit, 1, "exit"}
+};
+
+// The syntax of a command by its name, NULL if there is no such command
+const CommandSyntax* commandSyntax(const std::string& name)
+{
+    for(size_t i = 0; i < sizeof(COMMAND_SYNTAX) / sizeof(COMMAND_SYNTAX[0]); i++){
+        if(name == COMMAND_SYNTAX[i].name){
+            return &COMMAND_SYNTAX[i];
+        }
+    }
+    return NULL;
+}
+
+void createProcess(int text_size, int data_size, Mmu *mmu, PageTable *page_table)
+{
+    //   - create new process in the MMU 
+    uint32_t pid = mmu->reservePids(1);
+    createProcess(pid, text_size, data_size, mmu, page_table);
+}
+
+// Same as above for a pid already taken with Mmu::reservePids
+void createProcess(uint32_t pid, int text_size, int data_size, Mmu *mmu, PageTable *page_table)
+{
+    mmu->createProcess(pid);
+    //   - allocate new variables for the <TEXT>, <GLOBALS>, and <STACK>
+    //find first space that is big enough for them (1 + pages)
+    allocateVariable(pid, NAME_TEXT, DataType::Char, text_size, mmu, page_table);
+    allocateVariable(pid, NAME_GLOBALS, DataType::Char, data_size, mmu, page_table);
+    allocateVariable(pid, NAME_STACK, DataType::Char, 65536, mmu, page_table);
+    //   - print pid
+    commandOutput() << pid;
+}
+
+/*
+    parent_pid: a live process
+    creates a child with the parent's variables, its pages mapped onto the parent's frames
+    copy-on-write, and prints its pid (the pid is used up even if the child does not fit)
+*/
+void forkProcess(uint32_t parent_pid, Mmu *mmu, PageTable *page_table)
+{
+    if(!page_table->canShareFrames()){
+        commandOutput() << "error: fork needs every page resident (not supported with swap)";
+        return;
+    }
+    uint32_t pid = mmu->reservePids(1);
+    if(!mmu->forkProcess(parent_pid, pid)){
+        commandOutput() << "error: fork would exceed system memory";
+        return;
+    }
+    page_table->forkEntries(parent_pid, pid);
+    commandOutput() << pid;
+}
+
+/*
+    name: the segment's name, size: bytes (rounded up to whole pages)
+    takes the segment's frames now, so the bytes count towards memory even before any
+    process attaches it; prints the size it got. The segment lives until the last process
+    attached to it detaches or terminates
+*/
+void createSegment(uint32_t name, uint64_t size, Mmu *mmu, PageTable *page_table)
+{
+    if(!page_table->canShareFrames()){
+        commandOutput() << "error: shared memory needs every page resident (not supported with swap)";
+        return;
+    }
+    if(mmu->findSegment(name) != NULL){
+        commandOutput() << "error: segment already exists";
+        return;
+    }
+    int pageSize = page_table->getPageSize();
+    uint64_t pages = (size + pageSize - 1) / pageSize;
+    if(pages == 0 || !mmu->reserveBytes(pages * pageSize)){
+        commandOutput() << "Allocation would exceed system memory";
+        return;
+    }
+    int32_t segment = page_table->createSegment(pages);
+    if(segment < 0){
+        mmu->releaseBytes(pages * pageSize);
+        commandOutput() << "error: not enough free frames";
+        return;
+    }
+    mmu->addSegment(name, pages * pageSize, segment);
+    commandOutput() << pages * pageSize;
+}
+
+// Maps a segment into pid at a page boundary of its virtual space and prints the address
+void attachSegment(uint32_t pid, uint32_t name, Mmu *mmu, PageTable *page_table)
+{
+    Segment *segment = mmu->findSegment(name);
+    if(segment == NULL){
+        commandOutput() << "error: segment not found";
+        return;
+    }
+    if(mmu->getVariable(pid, name) != NULL){
+        commandOutput() << "error: variable already exists";
+        return;
+    }
+    Variable *var = mmu->attachSegment(pid, name);
+    if(var == NULL){
+        return;
+    }
+    page_table->mapSegment(segment->id, pid, page_table->getPageNumber(var->virtual_address));
+    commandOutput() << var->virtual_address;
+}
+
+// Unmaps the segment attached to pid as var; its frames are freed with the last process's mapping
+void detachSegment(uint32_t pid, Variable *var, Mmu *mmu, PageTable *page_table)
+{
+    if(var == NULL){
+        commandOutput() << "error: variable not found" << std::endl;
+    }else if(!(var->flags & VAR_SHARED)){
+        commandOutput() << "error: variable is not a shared memory segment" << std::endl;
+    }else {
+        freeVariable(pid, var, mmu, page_table);
+    }
+}
+
+void allocateVariable(uint32_t pid, std::string var_name, DataType type, uint64_t num_elements, Mmu *mmu, PageTable *page_table)
+{
+    allocateVariable(pid, mmu->internName(var_name), type, num_elements, mmu, page_table);
+}
+
+void allocateVariable(uint32_t pid, uint32_t name, DataType type, uint64_t num_elements, Mmu *mmu, PageTable *page_table)
+{
+    uint32_t typeSize = dataTypeSize(type);
+    if(typeSize == 0){
+        commandOutput() << "error: unknown data type" << std::endl;
+        return;
+    }
+    if(num_elements > UINT64_MAX / typeSize){
+        commandOutput() << "Allocation would exceed system memory" << std::endl;
+        return;
+    }
+    uint64_t newVarSize = num_elements * typeSize;
+
+    //CHECK FOR IF THIS ALLOCATION WOULD EXCEED SYSTEM MEMOMRY (in bytes), taking the bytes
+    //if it does not so another thread cannot take them first
+    if(!mmu->reserveBytes(newVarSize)){
+        commandOutput() << "Allocation would exceed system memory"<<std::endl;
+        return;
+    }
+
+    //   - find a hole (per the fit policy) large enough for the variable, a variable whose
+    //     first element would straddle a page boundary starts on the next page instead
+    //   - insert variable into MMU
+    Variable *var = mmu->placeVariable(pid, name, type, newVarSize, typeSize);
+    if(var == NULL){
+        mmu->releaseBytes(newVarSize);
+        return;
+    }
+    uint64_t newVarAddress = var->virtual_address;
+
+    //   - map any page(s) of the variable that are not mapped yet (with huge pages where the
+    //     promotion policy allows); out of frames, undo the allocation as a free would (this
+    //     unmaps the pages it did map and hands its bytes back)
+    if(newVarSize > 0){
+        uint64_t startPage = page_table->getPageNumber(newVarAddress);
+        uint64_t endPage = page_table->getPageNumber(newVarAddress + newVarSize - 1);
+        if(!page_table->mapRange(pid, startPage, endPage)){
+            freeVariable(pid, var, mmu, page_table);
+            commandOutput() << "error: out of frames" << std::endl;
+            return;
+        }
+    }
+
+    //   - print virtual memory address
+    if(!(var->flags & VAR_SYSTEM)){
+        commandOutput() << newVarAddress;
+    }
+}
+
+void setVariable(uint32_t pid, std::string var_name, uint64_t offset, void *value, Mmu *mmu, PageTable *page_table, void *memory)
+{
+    //   - look up the variable, then parse and store `value` as one element of its type
+    Variable *var = mmu->getVariable(pid, var_name);
+    std::vector<std::string> values(1, *static_cast<std::string*>(value));
+    setVariableValues(pid, var, offset, values, 0, page_table, memory);
+}
+
+// Parses the values of a set command into a staging buffer of T, then writes them
+typedef struct SetValues {
+    uint32_t pid;
+    Variable *var;
+    uint64_t offset;
+    const std::vector<std::string> *words;
+    size_t first;
+    PageTable *page_table;
+    void *memory;
+
+    template <typename T>
+    void visit()
+    {
+        static thread_local std::vector<T> staging;
+        staging.resize(words->size() - first);
+        for(size_t i = first; i < words->size(); i++){
+            if(!parseElement((*words)[i].c_str(), &staging[i - first])){
+                commandOutput() << "error: value is not a number: " << (*words)[i] << std::endl;
+                return;
+            }
+        }
+        if(!writeVariable(pid, var, offset, staging.data(), staging.size(), page_table, memory)){
+            commandOutput() << "error: values past the end of the variable" << std::endl;
+        }
+    }
+} SetValues;
+
+/*
+    words[first..]: the values to store, as typed in a set command
+    parses all of them, then writes them from element `offset` of the variable with one
+    translation and one memcpy per page; nothing is written if a value is not a number
+*/
+void setVariableValues(uint32_t pid, Variable *var, uint64_t offset, const std::vector<std::string>& words, size_t first, PageTable *page_table, void *memory)
+{
+    SetValues set = {pid, var, offset, &words, first, page_table, memory};
+    visitElementType(var->type, set);
+}
+
+/*
+    values: count elements already in the variable's own type (e.g. doubles for a Double variable)
+    writes them from element `offset` on, one page run at a time; false (and nothing
+    written) if they do not fit in the variable
+*/
+bool writeVariable(uint32_t pid, Variable *var, uint64_t offset, const void *values, uint32_t count, PageTable *page_table, void *memory)
+{
+    uint32_t size = dataTypeSize(var->type);
+    if(count == 0){
+        return true;
+    }
+    if(offset > var->size / size || count > var->size / size - offset){
+        return false;
+    }
+    transferVirtual(pid, var->virtual_address + offset * size, (uint8_t*)values, (uint64_t)count * size, true, page_table, memory);
+    return true;
+}
+
+void freeVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table)
+{
+    freeVariable(pid, mmu->getVariable(pid, var_name), mmu, page_table);
+}
+
+void freeVariable(uint32_t pid, Variable *var, Mmu *mmu, PageTable *page_table)
+{
+    //   - remove entry from MMU (this also drops it from the per-page live counts)
+    uint64_t address = var->virtual_address;
+    uint64_t size = var->size;
+    uint64_t padding = var->padding;
+    uint32_t name = var->name;
+    bool shared = (var->flags & VAR_SHARED) != 0;
+    mmu->removeVariable(pid, var);
+
+    //   - free page if this variable was the only one on a given page
+    if(size > 0){
+        uint64_t pageNumStart = page_table->getPageNumber(address);
+        uint64_t pageNumEnd = page_table->getPageNumber(address + size - 1);
+        for(uint64_t page = pageNumStart; page <= pageNumEnd; page++){
+            if(mmu->liveVariablesOnPage(pid, page) == 0){
+                page_table->removeEntry(pid, page);
+            }
+        }
+    }
+
+    //   - a shared memory segment (and its frames) goes with the last process attached to it
+    if(shared){
+        int64_t segment = mmu->detachSegment(pid, name);
+        if(segment >= 0){
+            page_table->releaseSegment(segment, pid);
+        }
+    }
+
+    //   - hand the range and its padding back to the process's free holes (coalescing with its neighbours)
+    mmu->mergeFreeSpace(address - padding, size + padding, pid);
+}
+
+void terminateProcess(uint32_t pid, Mmu *mmu, PageTable *page_table)
+{
+    //   - free all pages associated with given process
+    std::vector<Variable*> processVars = mmu->getAllVars(pid);
+    for(int i = 0; i < processVars.size(); i++){
+        if(processVars[i]->size > 0){
+            uint64_t pageNumStart = page_table->getPageNumber(processVars[i]->virtual_address);
+            uint64_t pageNumEnd = page_table->getPageNumber(processVars[i]->virtual_address + processVars[i]->size - 1);
+            for(uint64_t page = pageNumStart; page <= pageNumEnd; page++){
+                page_table->removeEntry(pid, page);
+            }
+        }
+        if(processVars[i]->flags & VAR_SHARED){
+            int64_t segment = mmu->detachSegment(pid, processVars[i]->name);
+            if(segment >= 0){
+                page_table->releaseSegment(segment, pid);
+            }
+        }
+    }
+    //   - remove process (and all of its variables) from MMU and drop its cached translations
+    mmu->removeProcess(pid);
+    page_table->flushTlb(pid);
+}
+
+/*
+    pids: processes to compact
+    pack_frames: also renumber frames (touches every process, so only when no other thread runs)
+    slides each process's variables to the bottom of its virtual space, unmapping pages left
+    without live data, then packs every mapped frame down from frame 0
+*/
+CompactionResult compactProcesses(const std::vector<uint32_t>& pids, Mmu *mmu, PageTable *page_table, void *memory, bool pack_frames)
+{
+    CompactionResult result = {0, 0, 0, 0, 0};
+    std::vector<uint8_t> staging;
+    for(size_t p = 0; p < pids.size(); p++){
+        uint32_t pid = pids[p];
+        std::vector<Relocation> moves = mmu->compactProcess(pid);
+        result.processes++;
+        uint32_t entriesBefore = page_table->numEntries(pid);
+        if(moves.empty()){
+            continue;
+        }
+
+        //   - copy the moved variables out while the page table still maps the old layout
+        //     (a variable can land on a page another moved variable is read from, so stage them all;
+        //     a shared memory segment is not copied, its frames are just mapped at the new address)
+        size_t total = 0;
+        for(size_t i = 0; i < moves.size(); i++){
+            if(!(moves[i].var->flags & VAR_SHARED)){
+                total += moves[i].var->size;
+            }
+        }
+        staging.resize(total);
+        size_t position = 0;
+        for(size_t i = 0; i < moves.size(); i++){
+            if(!(moves[i].var->flags & VAR_SHARED)){
+                transferVirtual(pid, moves[i].old_address, &staging[position], moves[i].var->size, false, page_table, memory);
+                position += moves[i].var->size;
+            }
+        }
+
+        //   - unmap old pages with no live variable left (and every old page of a segment, whatever
+        //     lands there must not write into it), then map the new ranges and copy back
+        for(size_t i = 0; i < moves.size(); i++){
+            uint64_t size = moves[i].var->size;
+            if(size == 0){
+                continue;
+            }
+            bool shared = (moves[i].var->flags & VAR_SHARED) != 0;
+            uint64_t startPage = page_table->getPageNumber(moves[i].old_address);
+            uint64_t endPage = page_table->getPageNumber(moves[i].old_address + size - 1);
+            for(uint64_t page = startPage; page <= endPage; page++){
+                if(shared || mmu->liveVariablesOnPage(pid, page) == 0){
+                    page_table->removeEntry(pid, page);
+                }
+            }
+        }
+        position = 0;
+        for(size_t i = 0; i < moves.size(); i++){
+            Variable *var = moves[i].var;
+            if(var->flags & VAR_SHARED){
+                page_table->mapSegment(mmu->findSegment(var->name)->id, pid, page_table->getPageNumber(var->virtual_address));
+                continue;
+            }
+            uint64_t size = var->size;
+            if(size > 0){
+                uint64_t startPage = page_table->getPageNumber(var->virtual_address);
+                uint64_t endPage = page_table->getPageNumber(var->virtual_address + size - 1);
+                if(page_table->mapRange(pid, startPage, endPage)){
+                    transferVirtual(pid, var->virtual_address, &staging[position], size, true, page_table, memory);
+                }else {
+                    //out of frames (pages held by huge pages kept whole): the variable cannot be
+                    //put back, so drop it rather than keep one whose writes go nowhere
+                    commandOutput() << "error: out of frames, dropped " << pid << ":" << mmu->getName(var->name) << std::endl;
+                    freeVariable(pid, var, mmu, page_table);
+                }
+            }
+            position += size;
+        }
+        result.virtual_bytes += total;
+        result.frames_reclaimed += entriesBefore - page_table->numEntries(pid);
+    }
+
+    //   - renumber frames densely from 0 so the free frames form one block at the top
+    if(pack_frames){
+        result.frames_moved = page_table->compactFrames(memory, &result.physical_bytes);
+    }
+    mmu->recordCompaction(pids.empty() ? 0 : pids[0], result.frames_reclaimed, result.virtual_bytes + result.physical_bytes);
+    return result;
+}
+
+void printCompaction(CompactionResult result)
+{
+    commandOutput() << "compacted " << result.processes << " process(es): reclaimed " << result.frames_reclaimed
+              << " frame(s), moved " << (result.virtual_bytes + result.physical_bytes) << " bytes ("
+              << result.virtual_bytes << " virtual, " << result.physical_bytes << " physical in "
+              << result.frames_moved << " frame(s))" << std::endl;
+}
+
+/*
+    page: print the page table (range of page numbers) rather than the MMU table (range of
+    virtual addresses)
+    prints the rows of one process in [first, last]; first > last is an unreadable range
+*/
+void printTableRange(bool page, uint32_t pid, uint64_t first, uint64_t last, Mmu *mmu, PageTable *page_table)
+{
+    if(!mmu->processExists(pid)){
+        commandOutput() << "error: process not found" << std::endl;
+    }else if(first > last){
+        commandOutput() << "error: invalid range" << std::endl;
+    }else if(page){
+        page_table->print(pid, first, last);
+    }else{
+        mmu->print(pid, first, last);
+    }
+}
+
+void printSnapshot(const char *action, std::string file, const char *error, SnapshotInfo info)
+{
+    if(error != NULL){
+        commandOutput() << "error: " << error << std::endl;
+        return;
+    }
+    commandOutput() << action << " " << file << ": " << info.processes << " process(es), " << info.pages
+              << " mapped page(s), " << info.image_bytes << " bytes of memory";
+    if(info.sequence > 0){
+        commandOutput() << " (checkpoint " << info.sequence << ")";
+    }
+    commandOutput() << std::endl;
+}
+
+// Background policy: silently compact a process once frees have left it with too many holes
+// (frames are only packed when a single thread runs commands)
+void autoCompact(uint32_t pid, Mmu *mmu, PageTable *page_table, void *memory)
+{
+    if(mmu->needsCompaction(pid)){
+        compactProcesses(std::vector<uint32_t>(1, pid), mmu, page_table, memory, mmu->numShards() == 1);
+    }
+}
+
+/*
+    object: "<PID>:<var_name>"
+    returns the variable and sets *pid, or prints why there is none and returns NULL
+*/
+Variable* lookupVariable(const std::string& object, Mmu *mmu, uint32_t *pid)
+{
+    size_t position = object.find(':');
+    *pid = allNums(object.substr(0, position));
+    if(!mmu->processExists(*pid)){
+        commandOutput() << "error: process not found" << std::endl;
+        return NULL;
+    }
+    Variable *var = (position == std::string::npos) ? NULL : mmu->getVariable(*pid, object.substr(position + 1));
+    if(var == NULL){
+        commandOutput() << "error: variable not found" << std::endl;
+    }
+    return var;
+}
+
+void printVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table, void *memory){
+    Variable *var = mmu->getVariable(pid, var_name);
+    if(var == NULL){
+        commandOutput() << "error: variable not found" << std::endl;
+        return;
+    }
+    printVariable(pid, var, page_table, memory);
+}
+
+// Prints up to the first 4 elements of a variable, then "... [N items]" if there are more
+typedef struct PrintElements {
+    uint32_t pid;
+    Variable *var;
+    PageTable *page_table;
+    void *memory;
+
+    template <typename T>
+    void visit()
+    {
+        T values[4];
+        uint64_t count = numElements<T>(var);
+        uint32_t shown = std::min<uint64_t>(count, 4);
+        readElements(pid, var, 0, shown, values, page_table, memory);
+        std::ostream& out = commandOutput();
+        for(uint32_t i = 0; i < shown; i++){
+            if(i > 0){
+                out << ", ";
+            }
+            out << values[i];
+        }
+        if(count > 4){
+            out << ", ... [" << count << " items]";
+        }
+    }
+} PrintElements;
+
+void printVariable(uint32_t pid, Variable *var, PageTable *page_table, void *memory){
+    PrintElements print = {pid, var, page_table, memory};
+    visitElementType(var->type, print);
+    commandOutput() << std::endl;
+}
+
+// Parses value as an element of the variable's type and stores it in every element
+typedef struct FillElements {
+    uint32_t pid;
+    Variable *var;
+    const std::string *value;
+    PageTable *page_table;
+    void *memory;
+
+    template <typename T>
+    void visit()
+    {
+        T element;
+        if(!parseElement(value->c_str(), &element)){
+            commandOutput() << "error: value is not a number: " << *value << std::endl;
+            return;
+        }
+        fillElements(pid, var, element, page_table, memory);
+    }
+} FillElements;
+
+void fillVariable(uint32_t pid, Variable *var, const std::string& value, PageTable *page_table, void *memory)
+{
+    FillElements fill = {pid, var, &value, page_table, memory};
+    visitElementType(var->type, fill);
+}
+
+// Instantiates copyElements for the source type S and every destination type
+template <typename S>
+struct CopyTo {
+    uint32_t src_pid;
+    Variable *src;
+    uint32_t dst_pid;
+    Variable *dst;
+    PageTable *page_table;
+    void *memory;
+
+    template <typename D>
+    void visit()
+    {
+        copyElements<S, D>(src_pid, src, dst_pid, dst, page_table, memory);
+    }
+};
+
+typedef struct CopyFrom {
+    uint32_t src_pid;
+    Variable *src;
+    uint32_t dst_pid;
+    Variable *dst;
+    PageTable *page_table;
+    void *memory;
+
+    template <typename S>
+    void visit()
+    {
+        CopyTo<S> to = {src_pid, src, dst_pid, dst, page_table, memory};
+        visitElementType(dst->type, to);
+    }
+} CopyFrom;
+
+/*
+    copies the elements of src into dst (as many as both have), converting them to dst's
+    type if it differs
+*/
+void copyVariable(uint32_t src_pid, Variable *src, uint32_t dst_pid, Variable *dst, PageTable *page_table, void *memory)
+{
+    CopyFrom copy = {src_pid, src, dst_pid, dst, page_table, memory};
+    visitElementType(src->type, copy);
+}
+
+// Prints the sum, minimum or maximum of a variable's elements
+typedef struct PrintReduction {
+    Reduction reduction;
+    uint32_t pid;
+    Variable *var;
+    PageTable *page_table;
+    void *memory;
+
+    template <typename T>
+    void visit()
+    {
+        ElementSummary<T> summary = summarizeElements<T>(pid, var, page_table, memory);
+        std::ostream& out = commandOutput();
+        if(reduction == Reduction::ReduceSum){
+            out << summary.sum << std::endl;
+        }else if(summary.count == 0){
+            out << "error: variable has no elements" << std::endl;
+        }else {
+            out << ((reduction == Reduction::ReduceMin) ? summary.min : summary.max) << std::endl;
+        }
+    }
+} PrintReduction;
+
+void printReduction(Reduction reduction, uint32_t pid, Variable *var, PageTable *page_table, void *memory)
+{
+    PrintReduction print = {reduction, pid, var, page_table, memory};
+    visitElementType(var->type, print);
+}
+
+void splitString(std::string text, char d, std::vector<std::string>& result)
+{
+    enum states { NONE, IN_WORD, IN_STRING } state = NONE;
+
+    int i;
+    std::string token;
+    result.clear();
+    for (i = 0; i < text.length(); i++)
+    {
+        char c = text[i];
+        switch (state) {
+            case NONE:
+                if (c != d)
+                {
+                    if (c == '\"')
+                    {
+                        state = IN_STRING;
+                        token = "";
+                    }
+                    else
+                    {
+                        state = IN_WORD;
+                        token = c;
+                    }
+                }
+                break;
+            case IN_WORD:
+                if (c == d)
+                {
+                    result.push_back(token);
+                    state = NONE;
+                }
+                else
+                {
+                    token += c;
+                }
+                break;
+            case IN_STRING:
+                if (c == '\"')
+                {
+                    result.push_back(token);
+                    state = NONE;
+                }
+                else
+                {
+                    token += c;
+                }
+                break;
+        }
+    }
+    if (state != NONE)
+    {
+        result.push_back(token);
+    }
+}
+
+/*
+    text: "<first>-<last>" or a single "<first>", each decimal or 0x hex
+    returns false if text is not a range with first <= last
+*/
+bool parseRange(std::string text, uint64_t *first, uint64_t *last){
+    const char *pos = text.c_str();
+    char *end;
+    if(!isdigit(*pos)){
+        return false;
+    }
+    *first = strtoull(pos, &end, 0);
+    *last = *first;
+    if(*end == '-' && isdigit(end[1])){
+        *last = strtoull(end + 1, &end, 0);
+    }
+    return *end == '\0' && *first <= *last;
+}
+
+// Element type named in an allocate command, FreeSpace if it is not one
+DataType parseDataType(const std::string& type)
+{
+    if(type == "char"){
+        return DataType::Char;
+    }else if(type == "double"){
+        return DataType::Double;
+    }else if(type == "Float"){
+        return DataType::Float;
+    }else if(type == "int"){
+        return DataType::Int;
+    }else if(type == "long"){
+        return DataType::Long;
+    }else if(type == "short"){
+        return DataType::Short;
+    }
+    return DataType::FreeSpace;
+}
+
+/*
+    checkString: text to check if it is all numbers
+    returns the string as an int if checkString is an int and -1 if it is not
+*/
+int64_t allNums(std::string checkString){
+    for(int i = 0; i < checkString.length(); i++){
+        if(isdigit(checkString[i]) == false){
+            return -1;
+        }
+    }
+    return atoll(checkString.c_str());
+}
\ No newline at end of file
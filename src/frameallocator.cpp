@@ -0,0 +1,147 @@
+#include "frameallocator.h"
+
+FrameAllocator::FrameAllocator(uint32_t num_frames)
+{
+    _num_frames = num_frames;
+    _num_free = num_frames;
+    _summary_hint = 0;
+
+    uint32_t num_words = (num_frames + 63) / 64;
+    _free_bits.assign(num_words, ~0ULL);
+    if (num_frames % 64 != 0)
+    {
+        // frames past the end of memory are never handed out
+        _free_bits[num_words - 1] = (1ULL << (num_frames % 64)) - 1;
+    }
+
+    uint32_t num_summary = (num_words + 63) / 64;
+    _summary.assign(num_summary, 0);
+    for (uint32_t w = 0; w < num_words; w++)
+    {
+        if (_free_bits[w] != 0)
+        {
+            _summary[w / 64] |= 1ULL << (w % 64);
+        }
+    }
+}
+
+FrameAllocator::~FrameAllocator()
+{
+}
+
+// Returns the lowest free frame, or -1 if every frame is in use
+int32_t FrameAllocator::allocate()
+{
+    while (_summary_hint < _summary.size() && _summary[_summary_hint] == 0)
+    {
+        _summary_hint++;
+    }
+    if (_summary_hint == _summary.size())
+    {
+        return -1;
+    }
+
+    uint32_t w = _summary_hint * 64 + __builtin_ctzll(_summary[_summary_hint]);
+    uint32_t bit = __builtin_ctzll(_free_bits[w]);
+    _free_bits[w] &= ~(1ULL << bit);
+    if (_free_bits[w] == 0)
+    {
+        _summary[w / 64] &= ~(1ULL << (w % 64));
+    }
+    _num_free--;
+    return w * 64 + bit;
+}
+
+/*
+    count: a multiple of 64 frames (a power of two)
+    returns the lowest of count free frames in a row starting at a multiple of count, so a
+    huge page can map them, or -1 if memory holds no such run
+*/
+int32_t FrameAllocator::allocateRun(uint32_t count)
+{
+    uint32_t words = count / 64;
+    for (uint32_t w = 0; w + words <= _free_bits.size(); w += words)
+    {
+        uint32_t j = 0;
+        while (j < words && _free_bits[w + j] == ~0ULL)
+        {
+            j++;
+        }
+        if (j < words)
+        {
+            continue;
+        }
+        for (j = 0; j < words; j++)
+        {
+            _free_bits[w + j] = 0;
+            _summary[(w + j) / 64] &= ~(1ULL << ((w + j) % 64));
+        }
+        _num_free -= count;
+        return w * 64;
+    }
+    return -1;
+}
+
+void FrameAllocator::release(uint32_t frame)
+{
+    if (frame >= _num_frames || isFree(frame))
+    {
+        return;
+    }
+    uint32_t w = frame / 64;
+    _free_bits[w] |= 1ULL << (frame % 64);
+    _summary[w / 64] |= 1ULL << (w % 64);
+    if (w / 64 < _summary_hint)
+    {
+        _summary_hint = w / 64;
+    }
+    _num_free++;
+}
+
+// Mark one free frame in use (restoring a snapshot of the allocator)
+void FrameAllocator::claim(uint32_t frame)
+{
+    if (frame >= _num_frames || !isFree(frame))
+    {
+        return;
+    }
+    uint32_t w = frame / 64;
+    _free_bits[w] &= ~(1ULL << (frame % 64));
+    if (_free_bits[w] == 0)
+    {
+        _summary[w / 64] &= ~(1ULL << (w % 64));
+    }
+    _num_free--;
+}
+
+// Mark frames [0, num_used) in use and every other frame free (after the frames were packed)
+void FrameAllocator::reset(uint32_t num_used)
+{
+    *this = FrameAllocator(_num_frames);
+    for (uint32_t frame = 0; frame < num_used; frame += 64)
+    {
+        uint32_t w = frame / 64;
+        uint32_t count = num_used - frame;
+        _free_bits[w] &= (count >= 64) ? 0 : ~((1ULL << count) - 1);
+        if (_free_bits[w] == 0)
+        {
+            _summary[w / 64] &= ~(1ULL << (w % 64));
+        }
+    }
+    _num_free = _num_frames - num_used;
+}
+
+bool FrameAllocator::isFree(uint32_t frame)
+{
+    return (_free_bits[frame / 64] >> (frame % 64)) & 1;
+}
+
+uint32_t FrameAllocator::numFrames()
+{
+    return _num_frames;
+}
+
+uint32_t FrameAllocator::numFree()
+{
+    return _num_free;
+}
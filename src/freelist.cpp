@@ -0,0 +1,204 @@
+#include "freelist.h"
+
+FreeList::FreeList()
+{
+    _cursor = 0;
+    _free_bytes = 0;
+}
+
+FreeList::~FreeList()
+{
+}
+
+void FreeList::addHole(uint64_t start, uint64_t size)
+{
+    _by_address[start] = size;
+    _by_size.insert(std::make_pair(size, start));
+    _free_bytes += size;
+}
+
+void FreeList::removeHole(std::map<uint64_t, uint64_t>::iterator hole)
+{
+    _by_size.erase(std::make_pair(hole->second, hole->first));
+    _free_bytes -= hole->second;
+    _by_address.erase(hole);
+}
+
+// A variable is not started in the last few bytes of a page if its first element would
+// straddle the boundary; those bytes are skipped and returned as padding
+bool FreeList::fits(uint64_t start, uint64_t hole_size, uint64_t size, uint32_t type_size, uint32_t page_size, uint64_t *padding)
+{
+    uint64_t room = page_size - (start % page_size);
+    *padding = 0;
+    if (room < type_size && type_size <= page_size)
+    {
+        *padding = room;
+    }
+    return *padding + size <= hole_size;
+}
+
+// Take a range for a variable out of a hole chosen by policy. keep_padding leaves the bytes
+// skipped before it free (an alignment gap), otherwise they go with the variable and come
+// back when it is released
+bool FreeList::allocate(uint64_t size, uint32_t type_size, uint32_t page_size, FitPolicy policy, bool keep_padding, uint64_t *address, uint64_t *padding)
+{
+    std::map<uint64_t, uint64_t>::iterator chosen = _by_address.end();
+    std::map<uint64_t, uint64_t>::iterator it;
+
+    if (policy == FitPolicy::BestFit)
+    {
+        // smallest hole that is big enough. Padding is less than type_size, so any hole of
+        // size + type_size - 1 fits; only the holes below that can fail, which with a huge page
+        // alignment can be a lot of them, so only the first few are tried
+        uint64_t sure = (type_size > 0 && type_size <= page_size) ? size + type_size - 1 : size;
+        std::set<std::pair<uint64_t, uint64_t>>::iterator candidate = _by_size.lower_bound(std::make_pair(size, (uint64_t)0));
+        for (int probes = 0; candidate != _by_size.end() && candidate->first < sure && probes < BEST_FIT_PROBES; candidate++, probes++)
+        {
+            if (fits(candidate->second, candidate->first, size, type_size, page_size, padding))
+            {
+                chosen = _by_address.find(candidate->second);
+                break;
+            }
+        }
+        if (chosen == _by_address.end())
+        {
+            candidate = _by_size.lower_bound(std::make_pair(sure, (uint64_t)0));
+            if (candidate != _by_size.end() && fits(candidate->second, candidate->first, size, type_size, page_size, padding))
+            {
+                chosen = _by_address.find(candidate->second);
+            }
+        }
+    }
+    else
+    {
+        // first fit scans from the lowest address, next fit from where the last allocation ended
+        std::map<uint64_t, uint64_t>::iterator begin = _by_address.begin();
+        if (policy == FitPolicy::NextFit)
+        {
+            begin = _by_address.lower_bound(_cursor);
+            if (begin != _by_address.begin())
+            {
+                // the hole containing the cursor starts before it
+                std::map<uint64_t, uint64_t>::iterator prev = begin;
+                prev--;
+                if (prev->first + prev->second > _cursor)
+                {
+                    begin = prev;
+                }
+            }
+        }
+        for (it = begin; it != _by_address.end() && chosen == _by_address.end(); it++)
+        {
+            if (fits(it->first, it->second, size, type_size, page_size, padding))
+            {
+                chosen = it;
+            }
+        }
+        for (it = _by_address.begin(); it != begin && chosen == _by_address.end(); it++)
+        {
+            if (fits(it->first, it->second, size, type_size, page_size, padding))
+            {
+                chosen = it;
+            }
+        }
+    }
+
+    if (chosen == _by_address.end())
+    {
+        return false;
+    }
+
+    // carve the variable out of the hole, keeping the tail (and an alignment gap) as holes
+    uint64_t start = chosen->first;
+    uint64_t hole_size = chosen->second;
+    removeHole(chosen);
+    if (*padding > 0 && keep_padding)
+    {
+        addHole(start, *padding);
+    }
+    *address = start + *padding;
+    uint64_t tail = hole_size - *padding - size;
+    if (tail > 0)
+    {
+        addHole(*address + size, tail);
+    }
+    _cursor = *address + size;
+    return true;
+}
+
+// Return a range to the free list; its neighbours are found with one lookup in the address
+// index and merged with it, so a free costs O(log n) in the number of holes (the map lookup
+// plus the size index erase/insert), with at most two merges
+void FreeList::release(uint64_t address, uint64_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    std::map<uint64_t, uint64_t>::iterator next = _by_address.lower_bound(address);
+    if (next != _by_address.begin())
+    {
+        std::map<uint64_t, uint64_t>::iterator prev = next;
+        prev--;
+        if (prev->first + prev->second == address)
+        {
+            address = prev->first;
+            size += prev->second;
+            removeHole(prev);
+        }
+    }
+    if (next != _by_address.end() && next->first == address + size)
+    {
+        size += next->second;
+        removeHole(next);
+    }
+    addHole(address, size);
+}
+
+void FreeList::clear()
+{
+    _by_address.clear();
+    _by_size.clear();
+    _cursor = 0;
+    _free_bytes = 0;
+}
+
+uint32_t FreeList::numHoles()
+{
+    return _by_address.size();
+}
+
+uint64_t FreeList::freeBytes()
+{
+    return _free_bytes;
+}
+
+// Count, bytes and largest of the holes, less the one that runs up to `end` (the rest of the
+// address space above the last variable, which says nothing about fragmentation)
+void FreeList::innerHoles(uint64_t end, uint32_t *count, uint64_t *bytes, uint64_t *largest)
+{
+    *count = _by_address.size();
+    *bytes = _free_bytes;
+    uint64_t tail_start = end;
+    if (!_by_address.empty() && _by_address.rbegin()->first + _by_address.rbegin()->second == end)
+    {
+        tail_start = _by_address.rbegin()->first;
+        *count -= 1;
+        *bytes -= _by_address.rbegin()->second;
+    }
+    *largest = 0;
+    for (std::set<std::pair<uint64_t, uint64_t>>::reverse_iterator it = _by_size.rbegin(); it != _by_size.rend(); it++)
+    {
+        if (it->second != tail_start)
+        {
+            *largest = it->first;
+            break;
+        }
+    }
+}
+
+const std::map<uint64_t, uint64_t>& FreeList::holes()
+{
+    return _by_address;
+}
@@ -0,0 +1,83 @@
+#include "histogram.h"
+#include <algorithm>
+#include <cstring>
+
+LatencyHistogram::LatencyHistogram()
+{
+    memset(_buckets, 0, sizeof(_buckets));
+    _count = 0;
+    _max = 0;
+}
+
+int LatencyHistogram::bucketOf(uint64_t value)
+{
+    if (value < (1u << HIST_SUB_BITS))
+    {
+        return (int)value;
+    }
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + (int)((value >> shift) & ((1u << HIST_SUB_BITS) - 1));
+}
+
+// Largest value that lands in the bucket
+uint64_t LatencyHistogram::bucketValue(int bucket)
+{
+    if (bucket < (1 << HIST_SUB_BITS))
+    {
+        return bucket;
+    }
+    int shift = (bucket >> HIST_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)((1 << HIST_SUB_BITS) + (bucket & ((1 << HIST_SUB_BITS) - 1))) << shift;
+    return low + ((1ull << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    _buckets[bucketOf(value)]++;
+    _count++;
+    if (value > _max)
+    {
+        _max = value;
+    }
+}
+
+// Add the values recorded by another histogram (e.g. one kept by a worker thread)
+void LatencyHistogram::merge(const LatencyHistogram& other)
+{
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        _buckets[i] += other._buckets[i];
+    }
+    _count += other._count;
+    _max = std::max(_max, other._max);
+}
+
+uint64_t LatencyHistogram::count()
+{
+    return _count;
+}
+
+uint64_t LatencyHistogram::max()
+{
+    return _max;
+}
+
+// p in [0, 100]; reported to bucket precision, never above the recorded maximum
+uint64_t LatencyHistogram::percentile(double p)
+{
+    if (_count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(p / 100.0 * (_count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += _buckets[i];
+        if (seen >= rank)
+        {
+            return std::min(bucketValue(i), _max);
+        }
+    }
+    return _max;
+}
@@ -1,19 +1,25 @@
 #include <iostream>
+#include <fstream>
 #include <string>
-#include <cstring>
-#include "mmu.h"
-#include "pagetable.h"
-#include <math.h>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include "commands.h"
+#include "outputbuffer.h"
+#include "tracefile.h"
+#include "stats.h"
+#include "parallel.h"
+#include "physicalmemory.h"
+#include "snapshot.h"
 
 void printStartMessage(int page_size);
-void createProcess(int text_size, int data_size, Mmu *mmu, PageTable *page_table);
-void allocateVariable(uint32_t pid, std::string var_name, DataType type, uint32_t num_elements, Mmu *mmu, PageTable *page_table);
-void setVariable(uint32_t pid, std::string var_name, uint32_t offset, void *value, Mmu *mmu, PageTable *page_table, void *memory);
-void freeVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table);
-void terminateProcess(uint32_t pid, Mmu *mmu, PageTable *page_table);
-void splitString(std::string text, char d, std::vector<std::string>& result);
-int allNums(std::string checkString);
-void printVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table, void *memory);
+int runBatch(std::string trace_file, bool quiet, Mmu *mmu, PageTable *page_table, void *memory);
+int runReplay(std::string trace_file, bool quiet, Mmu *mmu, PageTable *page_table, void *memory);
+int runThreads(std::string trace_file, uint32_t threads, bool quiet, Mmu *mmu, PageTable *page_table, void *memory);
+void printThroughput(uint64_t counts[CmdCount], double seconds);
+bool parseSize(std::string text, uint64_t *value);
 
 int main(int argc, char **argv)
 {
@@ -24,163 +30,413 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    // Print opening instuction message
+    // memsim --convert <trace.txt> <trace.bin>: write the binary form of a text trace and exit
+    if (std::string(argv[1]) == "--convert")
+    {
+        if (argc != 4)
+        {
+            fprintf(stderr, "Error: usage is --convert <text_trace> <binary_trace>\n");
+            return 1;
+        }
+        return convertTrace(argv[2], argv[3]);
+    }
+
+    // memsim --merge <snapshot> <out>: fold a snapshot's checkpoints into one full snapshot
+    if (std::string(argv[1]) == "--merge")
+    {
+        if (argc != 4)
+        {
+            fprintf(stderr, "Error: usage is --merge <snapshot> <merged_snapshot>\n");
+            return 1;
+        }
+        SnapshotInfo info;
+        const char *error = mergeSnapshot(argv[2], argv[3], &info);
+        if (error != NULL)
+        {
+            fprintf(stderr, "Error: cannot merge %s: %s\n", argv[2], error);
+            return 1;
+        }
+        printf("merged %s up to checkpoint %u into %s: %u process(es), %lu mapped page(s), %lu bytes of memory\n",
+               argv[2], info.sequence, argv[3], info.processes, (unsigned long)info.pages, (unsigned long)info.image_bytes);
+        return 0;
+    }
+
+    // Optional settings: --batch <trace_file> [--quiet] [--threads <n>]
+    //                   --replay <binary_trace_file> [--quiet]
+    //                   --fit <first|best|next>
+    //                   --auto-compact <holes> (compact a process once it has more free holes than this)
+    //                   --memory <bytes> (physical memory, K/M/G suffixes allowed, default 64M)
+    //                   --huge-pages <off|thp|hugetlb>
+    //                   --promote <never|eager|usage> [--demote split|keep] (simulated huge pages of
+    //                   512 pages: mapped for large variables, or made once a span is fully mapped)
+    //                   --va-bits <n> (size of each process's virtual address space, default 48)
+    //                   --swap <file> [--swap-size <bytes>] [--replace fifo|lru|clock|arc]
+    //                   --latency (per-command and Mmu/PageTable entry point latency histograms for print stats)
+    //                   --restore <snapshot> (start from a snapshot written by save, as of its
+    //                   last checkpoint; its memory and virtual address space sizes replace
+    //                   --memory and --va-bits)
+    //                   --tlb-entries <n> --tlb-ways <n> --tlb-policy <lru|random> --tlb-no-asid
     int page_size = std::stoi(argv[1]);
-    printStartMessage(page_size);
+    std::string batch_file;
+    std::string replay_file;
+    bool quiet = false;
+    uint32_t threads = 1;
+    FitPolicy fit_policy = FitPolicy::FirstFit;
+    uint32_t compact_threshold = 0;
+    uint64_t mem_size = DEFAULT_MEMORY_SIZE;
+    HugePages huge_pages = HugePages::HugeOff;
+    uint32_t va_bits = DEFAULT_VA_BITS;
+    std::string swap_file;
+    std::string restore_file;
+    uint64_t swap_size = 268435456;
+    ReplacementPolicy replace_policy = ReplacementPolicy::ReplaceClock;
+    TlbConfig tlb_config = Tlb::defaultConfig();
+    PromotePolicy promote = PromotePolicy::PromoteNever;
+    DemotePolicy demote = DemotePolicy::DemoteSplit;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (option == "--batch" && i + 1 < argc)
+        {
+            batch_file = argv[++i];
+        }
+        else if (option == "--replay" && i + 1 < argc)
+        {
+            replay_file = argv[++i];
+        }
+        else if (option == "--quiet")
+        {
+            quiet = true;
+        }
+        else if (option == "--threads" && i + 1 < argc)
+        {
+            threads = allNums(argv[++i]);
+            if (threads < 1 || threads > PARALLEL_MAX_THREADS)
+            {
+                fprintf(stderr, "Error: --threads must be between 1 and %d\n", PARALLEL_MAX_THREADS);
+                return 1;
+            }
+        }
+        else if (option == "--auto-compact" && i + 1 < argc)
+        {
+            compact_threshold = allNums(argv[++i]);
+        }
+        else if (option == "--swap" && i + 1 < argc)
+        {
+            swap_file = argv[++i];
+        }
+        else if (option == "--swap-size" && i + 1 < argc)
+        {
+            if (!parseSize(argv[++i], &swap_size))
+            {
+                fprintf(stderr, "Error: --swap-size must be a byte count with an optional K, M or G suffix\n");
+                return 1;
+            }
+        }
+        else if (option == "--memory" && i + 1 < argc)
+        {
+            // frame numbers are 31 bits
+            if (!parseSize(argv[++i], &mem_size))
+            {
+                fprintf(stderr, "Error: --memory must be a byte count with an optional K, M or G suffix\n");
+                return 1;
+            }
+            if (mem_size < (uint64_t)page_size || mem_size / page_size > 0x7FFFFFFF)
+            {
+                fprintf(stderr, "Error: --memory must be between one page and 2^31 pages\n");
+                return 1;
+            }
+        }
+        else if (option == "--va-bits" && i + 1 < argc)
+        {
+            va_bits = allNums(argv[++i]);
+            if (va_bits < 20 || va_bits > 63)
+            {
+                fprintf(stderr, "Error: --va-bits must be between 20 and 63\n");
+                return 1;
+            }
+        }
+        else if (option == "--huge-pages" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            if (mode == "off")
+            {
+                huge_pages = HugePages::HugeOff;
+            }
+            else if (mode == "thp")
+            {
+                huge_pages = HugePages::HugeThp;
+            }
+            else if (mode == "hugetlb")
+            {
+                huge_pages = HugePages::HugeTlb;
+            }
+            else
+            {
+                fprintf(stderr, "Error: unknown huge page mode %s\n", mode.c_str());
+                return 1;
+            }
+        }
+        else if (option == "--promote" && i + 1 < argc)
+        {
+            std::string policy = argv[++i];
+            if (policy == "never")
+            {
+                promote = PromotePolicy::PromoteNever;
+            }
+            else if (policy == "eager")
+            {
+                promote = PromotePolicy::PromoteEager;
+            }
+            else if (policy == "usage")
+            {
+                promote = PromotePolicy::PromoteUsage;
+            }
+            else
+            {
+                fprintf(stderr, "Error: unknown promotion policy %s\n", policy.c_str());
+                return 1;
+            }
+        }
+        else if (option == "--demote" && i + 1 < argc)
+        {
+            std::string policy = argv[++i];
+            if (policy == "split")
+            {
+                demote = DemotePolicy::DemoteSplit;
+            }
+            else if (policy == "keep")
+            {
+                demote = DemotePolicy::DemoteKeep;
+            }
+            else
+            {
+                fprintf(stderr, "Error: unknown demotion policy %s\n", policy.c_str());
+                return 1;
+            }
+        }
+        else if (option == "--replace" && i + 1 < argc)
+        {
+            std::string policy = argv[++i];
+            if (policy == "fifo")
+            {
+                replace_policy = ReplacementPolicy::ReplaceFifo;
+            }
+            else if (policy == "lru")
+            {
+                replace_policy = ReplacementPolicy::ReplaceLru;
+            }
+            else if (policy == "clock")
+            {
+                replace_policy = ReplacementPolicy::ReplaceClock;
+            }
+            else if (policy == "arc")
+            {
+                replace_policy = ReplacementPolicy::ReplaceArc;
+            }
+            else
+            {
+                fprintf(stderr, "Error: unknown replacement policy %s\n", policy.c_str());
+                return 1;
+            }
+        }
+        else if (option == "--restore" && i + 1 < argc)
+        {
+            restore_file = argv[++i];
+        }
+        else if (option == "--latency")
+        {
+            command_stats.enableTiming(true);
+        }
+        else if (option == "--fit" && i + 1 < argc)
+        {
+            std::string policy = argv[++i];
+            if (policy == "first")
+            {
+                fit_policy = FitPolicy::FirstFit;
+            }
+            else if (policy == "best")
+            {
+                fit_policy = FitPolicy::BestFit;
+            }
+            else if (policy == "next")
+            {
+                fit_policy = FitPolicy::NextFit;
+            }
+            else
+            {
+                fprintf(stderr, "Error: unknown fit policy %s\n", policy.c_str());
+                return 1;
+            }
+        }
+        else if ((option == "--tlb-entries" || option == "--tlb-ways") && i + 1 < argc)
+        {
+            int64_t value = allNums(argv[++i]);
+            if (value < 1 || value > TLB_MAX_ENTRIES)
+            {
+                fprintf(stderr, "Error: %s must be between 1 and %d\n", option.c_str(), TLB_MAX_ENTRIES);
+                return 1;
+            }
+            if (option == "--tlb-entries")
+            {
+                tlb_config.entries = value;
+            }
+            else
+            {
+                tlb_config.ways = value;
+            }
+        }
+        else if (option == "--tlb-policy" && i + 1 < argc)
+        {
+            std::string policy = argv[++i];
+            if (policy == "lru")
+            {
+                tlb_config.policy = TlbPolicy::Lru;
+            }
+            else if (policy == "random")
+            {
+                tlb_config.policy = TlbPolicy::Random;
+            }
+            else
+            {
+                fprintf(stderr, "Error: unknown TLB policy %s\n", policy.c_str());
+                return 1;
+            }
+        }
+        else if (option == "--tlb-no-asid")
+        {
+            tlb_config.asid = false;
+        }
+        else
+        {
+            fprintf(stderr, "Error: unrecognized option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // Worker threads only run text batches, and paging to swap is single threaded
+    if (threads > 1 && (batch_file.empty() || !swap_file.empty()))
+    {
+        fprintf(stderr, "Error: --threads needs --batch and cannot be used with --swap\n");
+        return 1;
+    }
+
+    // Huge pages are never paged out, a page is swapped on its own
+    if (promote != PromotePolicy::PromoteNever && (!swap_file.empty() || ((uint64_t)page_size << PT_BITS) > 0x80000000))
+    {
+        fprintf(stderr, "Error: --promote cannot be used with --swap or pages over 4 MB\n");
+        return 1;
+    }
+
+    // A restored run is sized like the run that saved the snapshot
+    uint64_t virtual_size = std::min<uint64_t>(1ull << va_bits, (uint64_t)page_size << PAGE_KEY_PAGE_BITS);
+    if (!restore_file.empty())
+    {
+        SnapshotHeader header;
+        if (!readSnapshotHeader(restore_file, &header))
+        {
+            fprintf(stderr, "Error: %s is not a memsim snapshot\n", restore_file.c_str());
+            return 1;
+        }
+        if (header.page_size != (uint32_t)page_size || !swap_file.empty())
+        {
+            fprintf(stderr, "Error: --restore needs the snapshot's page size (%u) and cannot be used with --swap\n", header.page_size);
+            return 1;
+        }
+        mem_size = header.memory_size;
+        virtual_size = header.virtual_size;
+    }
 
-    // Create physical 'memory'
-    uint32_t mem_size = 67108864;
-    void *memory = malloc(mem_size); // 64 MB (64 * 1024 * 1024)
+    // Create physical 'memory' (reserved now, committed by the host as frames get used)
+    PhysicalMemory physical(mem_size, huge_pages);
+    if (!physical.isMapped())
+    {
+        fprintf(stderr, "Error: cannot map %llu bytes of physical memory\n", (unsigned long long)mem_size);
+        return 1;
+    }
+    void *memory = physical.base();
     //for setting or printing a variable
 
-    // Create MMU and Page Table
-    Mmu *mmu = new Mmu(mem_size);
-    PageTable *page_table = new PageTable(page_size);
+    // Create MMU and Page Table (with swap, allocations may use physical memory + swap). Every
+    // process gets a virtual address space of its own, as large as page keys can number
+    uint64_t capacity = swap_file.empty() ? mem_size : mem_size + swap_size;
+    Mmu *mmu = new Mmu(capacity, virtual_size, page_size);
+    mmu->setFitPolicy(fit_policy);
+    mmu->setCompactThreshold(compact_threshold);
+    PageTable *page_table = new PageTable(page_size, mem_size, virtual_size);
+    page_table->configureTlb(tlb_config);
+    page_table->setPhysicalMemory(&physical);
+    if (promote != PromotePolicy::PromoteNever)
+    {
+        page_table->setHugePolicy(promote, demote);
+        mmu->setHugeAlignment(page_table->hugePageSize());
+    }
+    mmu->setShards(threads);
+    page_table->setShards(threads);
+    mmu->enableTiming(command_stats.timing());
+    page_table->enableTiming(command_stats.timing());
+    if (!swap_file.empty() && !page_table->enableSwap(swap_file, swap_size / page_size, replace_policy, memory))
+    {
+        fprintf(stderr, "Error: cannot create swap file %s\n", swap_file.c_str());
+        delete mmu;
+        delete page_table;
+        return 1;
+    }
 
-    // Prompt loop
-    std::string command;
-    std::cout << "> ";
-    std::getline (std::cin, command);
-    std::vector<std::string> commandSplit;
-    splitString(command, ' ', commandSplit);
-    while (commandSplit.at(0) != "exit") {
-        // Handle command
-        if(commandSplit.at(0) == "create"){ //create <text_size> <data_size>
-            int textSize = allNums(commandSplit.at(1));
-            int dataSize = allNums(commandSplit.at(2));
-            createProcess(textSize, dataSize, mmu, page_table);
-            
-            //assign a process id
-            //allocate some amount of startup memory for the process
-                //text/code: size of binary executable - user specified number (2048-16384 bytes)
-                //Data/Globals: size of global variables - user specified number (0 - 1024 bytes)
-                //Stack: constant (65536 bytes)
-            //prints the PID
-            std::cout << std::endl;
-        }else if(commandSplit.at(0) == "allocate"){ //allocate <PID> <var_name> <data_type> <number_of_elements>
-            //Allocated memory on the heap (how mcuch depends on the data type and the number of elements)
-                //N chars (N bytes)
-                //N shorts (N * 2 bytes)
-                //N ints/floats (N * 4 bytes)
-                //N longs/doubles (N * 8 bytes)
-            //print the virtual memory address
-            uint32_t pid = allNums(commandSplit.at(1));
-            if(mmu->processExists(pid)){
-                std::string varName = commandSplit.at(2);
-                Variable *var = mmu->getVariable(pid, varName);
-                if(var == NULL){
-                    DataType type;
-                    if(commandSplit.at(3) == "char"){
-                        type = DataType::Char;
-                    }else if(commandSplit.at(3) == "double"){
-                        type = DataType::Double;
-                    }else if(commandSplit.at(3) == "Float"){
-                        type = DataType::Float;
-                    }else if(commandSplit.at(3) == "int"){
-                        type = DataType::Int;
-                    }else if(commandSplit.at(3) == "long"){
-                        type = DataType::Long;
-                    }else if(commandSplit.at(3) == "short"){
-                        type = DataType::Short;
-                    }
-                    uint32_t numElements = allNums(commandSplit.at(4));
-                    allocateVariable(pid, varName, type, numElements, mmu, page_table);
-                }else {
-                    std::cout << "error: variable already exists";
-                }                
-            }else {
-                std::cout << "error: process not found";
-            }
-            std::cout << std::endl;
-        }else if(commandSplit.at(0) == "set"){ //set <PID> <var_name> <offset> <value_0> <value_2> ... <value_N>
-            uint32_t pid = allNums(commandSplit.at(1));
-            if(mmu->processExists(pid)){
-                std::string varName = commandSplit.at(2);
-                Variable *var = mmu->getVariable(pid, varName);
-                if(var != NULL){
-                    //do setting process here
-                    uint32_t offset = allNums(commandSplit.at(3));
-                    uint32_t offsetInc = offset;
-                    for(int i = 4; i < commandSplit.size(); i++){
-                        std::string value = commandSplit.at(i);
-                        setVariable(pid, varName, offsetInc, &value, mmu, page_table, memory);
-                        offsetInc++;
-                    }
-                }else {
-                    std::cout << "error: variable not found"<<std::endl;
-                }
-            }else {
-                std::cout << "error: process not found" <<std::endl;
-            }
-            //sote integer, float, or character values in memeory
-            //Set the value for the variable <var_name> starting at <offset>
-            //NOTE: multiple contiguous values can be set with one command
-        }else if(commandSplit.at(0) == "print"){ //print <object>
-            //if <object> is "mmu", print the MMU memory table
-            if(commandSplit.at(1) == "mmu"){
-                mmu->print();
-            }else if(commandSplit.at(1) == "page"){  //if <object> is "page", print the page table (do not need to print anything for free frames)
-                page_table->print();
-            }else if(commandSplit.at(1) == "processes"){//if <object> is "process", print a list of PID's for processes that are still running
-                mmu->printProcesses();
-            }else{ 
-                //if <object> is a "<PID>":<var_name>", print the value of the variable for that process"
-                //If variable has more than 4 elements, just print the first 4 followed by "... [N items]" (where N is the number of elements)
-                std::string toSplit = ":";
-                std::string tempString = commandSplit.at(1);
-                size_t position = tempString.find(toSplit);
-                std::string stringPid = tempString.substr(0,position);
-                uint32_t pid = allNums(stringPid);
-                tempString.erase(0, (position + toSplit.length()));
-                printVariable(pid, tempString, mmu, page_table, memory);
-            }
-        }else if(commandSplit.at(0) == "free"){ //free <PID> <var_name>
-            uint32_t pid = allNums(commandSplit.at(1));
-            if(mmu->processExists(pid)){
-                std::string varName = commandSplit.at(2);
-                Variable *var = mmu->getVariable(pid, varName);
-                if(var != NULL){
-                    //do freeing process here
-                    freeVariable(pid, var->name, mmu, page_table);
-                }else {
-                    std::cout << "error: variable not found" << std::endl;
-                }
-            }else {
-                std::cout << "error: process not found" << std::endl;
-            }
-            //Deallocate memory on the heap that is associated with <var_name>
-                //N chars (N bytes)
-                //N shorts (N * 2 bytes)
-                //N ints/floats (N * 4 bytes)
-                //N longs/doubles (N * 8 bytes)
-                //Can multiple contiguous vales be deallocated with one command?
-        }else if(commandSplit.at(0) == "terminate"){ //terminate <PID>
-            uint32_t pid = allNums(commandSplit.at(1));
-            if(mmu->processExists(pid)){
-                //do termination process here
-                terminateProcess(pid, mmu, page_table);
-            }else {
-                std::cout << "error: process not found" << std::endl;
-            }
-            //Kill the specified process
-            //Free all memory associated with this process
-            //Deallocate all memory associated with the process
-        }else{ //error
-            std::cout << "error: command not recognized" << std::endl;
+    if (!restore_file.empty())
+    {
+        SnapshotInfo info;
+        const char *error = loadSnapshot(restore_file, mmu, page_table, memory, &info);
+        if (error != NULL)
+        {
+            fprintf(stderr, "Error: cannot restore %s: %s\n", restore_file.c_str(), error);
+            delete mmu;
+            delete page_table;
+            return 1;
         }
+    }
 
-        // Get next command
+    int status = 0;
+    if (threads > 1)
+    {
+        status = runThreads(batch_file, threads, quiet, mmu, page_table, memory);
+    }
+    else if (!batch_file.empty())
+    {
+        // Replay a trace without prompts or banner
+        status = runBatch(batch_file, quiet, mmu, page_table, memory);
+    }
+    else if (!replay_file.empty())
+    {
+        status = runReplay(replay_file, quiet, mmu, page_table, memory);
+    }
+    else
+    {
+        // Print opening instuction message
+        printStartMessage(page_size);
+
+        // Prompt loop
+        std::string command;
+        std::vector<std::string> commandSplit;
         std::cout << "> ";
-        std::getline (std::cin, command);
-        splitString(command, ' ', commandSplit);
+        while (std::getline(std::cin, command))
+        {
+            splitString(command, ' ', commandSplit);
+            if (!commandSplit.empty() && executeCommand(commandSplit, mmu, page_table, memory) == CommandType::CmdExit)
+            {
+                break;
+            }
+
+            // Get next command
+            std::cout << "> ";
+        }
     }
 
     // Clean up
-    free(memory);
     delete mmu;
     delete page_table;
 
-    return 0;
+    return status;
 }
 
 void printStartMessage(int page_size)
@@ -188,449 +444,176 @@ void printStartMessage(int page_size)
     std::cout << "Welcome to the Memory Allocation Simulator! Using a page size of " << page_size << " bytes." << std:: endl;
     std::cout << "Commands:" << std:: endl;
     std::cout << "  * create <text_size> <data_size> (initializes a new process)" << std:: endl;
+    std::cout << "  * fork <PID> (create a child process sharing the parent's pages copy-on-write)" << std:: endl;
     std::cout << "  * allocate <PID> <var_name> <data_type> <number_of_elements> (allocated memory on the heap)" << std:: endl;
     std::cout << "  * set <PID> <var_name> <offset> <value_0> <value_1> <value_2> ... <value_N> (set the value for a variable)" << std:: endl;
     std::cout << "  * free <PID> <var_name> (deallocate memory on the heap that is associated with <var_name>)" << std:: endl;
     std::cout << "  * terminate <PID> (kill the specified process)" << std:: endl;
+    std::cout << "  * shm_create <name> <size> (create a shared memory segment of whole pages)" << std:: endl;
+    std::cout << "  * shm_attach <PID> <name> (map a shared memory segment into a process, prints its address)" << std:: endl;
+    std::cout << "  * shm_detach <PID> <name> (unmap a shared memory segment, the last detach frees it)" << std:: endl;
+    std::cout << "  * fill <PID> <var_name> <value> (set every element of a variable)" << std:: endl;
+    std::cout << "  * copy <PID>:<var_name> <PID>:<var_name> (copy the elements of one variable into another)" << std:: endl;
+    std::cout << "  * sum|min|max <PID>:<var_name> (print the sum, smallest or largest element of a variable)" << std:: endl;
+    std::cout << "  * compact [<PID>] (slide variables together and pack frames, all processes if no PID)" << std:: endl;
+    std::cout << "  * save <file> (write every process and the memory image to a snapshot file)" << std:: endl;
+    std::cout << "  * checkpoint <file> (append the pages and mappings changed since the last save, checkpoint or load of <file>)" << std:: endl;
+    std::cout << "  * load <file> (replace every process with the ones in a snapshot file)" << std:: endl;
     std::cout << "  * print <object> (prints data)" << std:: endl;
     std::cout << "    * If <object> is \"mmu\", print the MMU memory table" << std:: endl;
     std::cout << "    * if <object> is \"page\", print the page table" << std:: endl;
+    std::cout << "    * \"mmu <PID> [<first>[-<last>]]\" and \"page <PID> [<first>[-<last>]]\" print one process, optionally only"
+              << " the variables overlapping an address range or the pages in a page number range" << std:: endl;
     std::cout << "    * if <object> is \"processes\", print a list of PIDs for processes that are still running" << std:: endl;
+    std::cout << "    * if <object> is \"tlb\", print the TLB statistics" << std:: endl;
+    std::cout << "    * if <object> is \"stats\", print command counts/latency, frame usage and fragmentation" << std:: endl;
     std::cout << "    * if <object> is a \"<PID>:<var_name>\", print the value of the variable for that process" << std:: endl;
     std::cout << std::endl;
 }
 
-void createProcess(int text_size, int data_size, Mmu *mmu, PageTable *page_table)
-{
-    //   - create new process in the MMU 
-    uint32_t pid = mmu->createProcess();
-    //   - allocate new variables for the <TEXT>, <GLOBALS>, and <STACK>
-    //find first space that is big enough for them (1 + pages)
-    allocateVariable(pid, "<TEXT>", DataType::Char, text_size, mmu, page_table);
-    allocateVariable(pid, "<GLOBALS>", DataType::Char, data_size, mmu, page_table);
-    allocateVariable(pid, "<STACK>", DataType::Char, 65536, mmu, page_table);
-    //   - print pid
-    std::cout << pid;
-}
 
-void allocateVariable(uint32_t pid, std::string var_name, DataType type, uint32_t num_elements, Mmu *mmu, PageTable *page_table)
+/*
+    trace_file: text file with one command per line (same syntax as the prompt)
+    runs every command, buffering output (or dropping it if quiet) and reports
+    throughput on stderr at the end
+*/
+int runBatch(std::string trace_file, bool quiet, Mmu *mmu, PageTable *page_table, void *memory)
 {
-    //CHECK FOR IF THIS ALLOCATION WOULD EXCEED SYSTEM MEMOMRY (in bytes) 67108864!!
-    // mmu->_processes->variables --> see if this equals free space then get the variable and call the size. Have a check fo PID;
-    // If space is big enough then put variable there. 
-    uint32_t newVarSize;
-    int typeSize;
-    if(type == DataType::Char){
-        newVarSize = num_elements;
-        typeSize = 1;
-    }else if(type == DataType::Double || type == DataType::Long){
-        newVarSize = num_elements * 8;
-        typeSize = 8;
-    }else if(type == DataType::Float || type == DataType::Int){
-        newVarSize = num_elements * 4;
-        typeSize = 4;
-    }else if(type == DataType::Short){
-        newVarSize = num_elements * 2;
-        typeSize = 2;
+    std::ifstream trace(trace_file.c_str());
+    if (!trace.is_open())
+    {
+        fprintf(stderr, "Error: cannot open trace file %s\n", trace_file.c_str());
+        return 1;
     }
 
-    //Variable* freeSpace = mmu->getVariable(pid, "<FREE_SPACE>");
-    std::vector<Variable*> allProcessVars = mmu->getAllVars(pid);
-
-    for(int m = 0; m < allProcessVars.size(); m++){  //checks all vars bc there can be multiple free space vars
-        if(allProcessVars[m]->name == "<FREE_SPACE>"){ 
-            Variable* freeSpace = allProcessVars[m];
-            uint32_t newVarAddress = freeSpace->virtual_address;
-            int newVarPageNum = page_table->getPageNumber(newVarAddress);
-            if(freeSpace->size >= newVarSize){
-                //add var to mmu
-                if(mmu->spaceLeft(newVarSize)){
-                    // freeSpace->size = (freeSpace->size - newVarSize);
-                    // freeSpace->virtual_address = (freeSpace->virtual_address + newVarSize);
-                    //do a check to see if there is space left on the page.
-                        //get remaining page space
-                    int remainingPageSpace = mmu->getRemainingSpaceOnPage(pid, newVarAddress, page_table->getPageSize(), newVarPageNum);
-                    //if page can fit one element ->put on page 
-                    if(remainingPageSpace >= typeSize){
-                        freeSpace->size = (freeSpace->size - newVarSize);
-                        freeSpace->virtual_address = (freeSpace->virtual_address + newVarSize);
-                        //at lease 1 element of var will fit on page
-                        mmu->addVariableToProcess(pid, var_name, type, newVarSize, newVarAddress);
-                        //update page table
-                        int startPage = page_table->getPageNumber(newVarAddress);
-                        float pageSizeForRounding = page_table->getPageSize();
-                        int endPage = ceil(freeSpace->virtual_address / pageSizeForRounding);
-                        int difference = endPage - startPage;
-                        if(!difference == 0){
-                            for(int i = startPage; i < endPage; i++){
-                                page_table->addEntry(pid, i);
-                            }
-                        }
-                        //print virtual address
-                        if(var_name != "<TEXT>" && var_name != "<GLOBALS>" && var_name != "<STACK>"){
-                            std::cout << newVarAddress;
-                        }
-                    }else{
-                        //page does not have room for 1 element of var
-                        //if remaining space size > 0
-                        if(remainingPageSpace > 0){
-                            if(freeSpace->size - remainingPageSpace >= newVarSize){ 
-                                freeSpace->size = (freeSpace->size - remainingPageSpace - newVarSize);
-                                freeSpace->virtual_address = (freeSpace->virtual_address + remainingPageSpace + newVarSize);
-                                //create smaller free space var (virtual address same)->size = remainingSpaceOnPage
-                                mmu->addVariableToProcess(pid, "<FREE_SPACE>", DataType::FreeSpace, remainingPageSpace, newVarAddress);
-                                //move newVarVirtualAddress to be newVarVirtualAddress + remainingPageSpace
-                                newVarAddress = newVarAddress + remainingPageSpace;
-                                mmu->addVariableToProcess(pid, var_name, type, newVarSize, newVarAddress);
-                                //update page table
-                                int startPage = page_table->getPageNumber(newVarAddress);
-                                float pageSizeForRounding = page_table->getPageSize();
-                                int endPage = ceil(freeSpace->virtual_address / pageSizeForRounding);
-                                int difference = endPage - startPage;
-                                if(!difference == 0){
-                                    for(int i = startPage; i < endPage; i++){
-                                        page_table->addEntry(pid, i);
-                                    }
-                                }
-                                //print virtual address
-                                if(var_name != "<TEXT>" && var_name != "<GLOBALS>" && var_name != "<STACK>"){
-                                    std::cout << newVarAddress;
-                                }
-                            } //else free space is no longer big enough so we do can't add var to this freespace
-                        }
-                    }   
-                }else {
-                    std::cout << "Allocation would exceed system memory"<<std::endl;
-                    break;
-                }
-            }
+    OutputBuffer output(STDOUT_FILENO, 1 << 20, quiet);
+    std::streambuf *console = std::cout.rdbuf(&output);
+
+    uint64_t counts[CommandType::CmdCount] = {0};
+    std::string command;
+    std::vector<std::string> commandSplit;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while (std::getline(trace, command))
+    {
+        splitString(command, ' ', commandSplit);
+        if (commandSplit.empty())
+        {
+            continue;
+        }
+        CommandType type = executeCommand(commandSplit, mmu, page_table, memory);
+        counts[type]++;
+        if (type == CommandType::CmdExit)
+        {
+            break;
         }
     }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    //first search the page table to see if there is a location your variable will fit w/o allocating a new page.
-    //if there is space then dont need to touch page table at all.
-    //2 bytes left on page but trying to allocate 2 byte integer -> DO NOt SPLit an individual item accros pages. need to have contiguous memory addresses
-    //in mmu loop through adn find the free space variables.  
-    //to know what page to pass in to the page table.addentry -> add methods to page table
-    //   - find first free space within a page already allocated to this process that is large enough to fit the new variable
-    //   - if no hole is large enough, allocate new page(s)
-    //   - insert variable into MMU
-    //   - print virtual memory address (adding on the size in hex)
-    // only use actual memory when setting and printing a variable.
-}
+    output.finish();
+    std::cout.rdbuf(console);
 
-void setVariable(uint32_t pid, std::string var_name, uint32_t offset, void *value, Mmu *mmu, PageTable *page_table, void *memory)
-{
-    //   - look up physical address for variable based on its virtual address / offset
-    Variable *var = mmu->getVariable(pid, var_name);
-    DataType type = var->type;
-    uint32_t size;
-    std::string *x = static_cast<std::string*>(value);
-    std::string::size_type sz;
-    
-    if(type == DataType::Char){
-        size = 1;
-        char val = *x->c_str();
-        int offsetMultiplied = offset * size;
-        int physicalAddress = page_table->getPhysicalAddress(pid, (var->virtual_address + offsetMultiplied));
-        memcpy((uint8_t*)memory + physicalAddress, &val, size);
-    }else if(type == DataType::Double){
-        size = 8;
-        double val = std::stod(*x, &sz);
-        int offsetMultiplied = offset * size;
-        int physicalAddress = page_table->getPhysicalAddress(pid, (var->virtual_address + offsetMultiplied));
-        memcpy((uint8_t*)memory + physicalAddress, &val, size);
-    }else if(type == DataType::Long){
-        size = 8;
-        long val = std::stol(*x, &sz);
-        int offsetMultiplied = offset * size;
-        uint32_t virtAddress = (var->virtual_address + offsetMultiplied);
-        int physicalAddress = page_table->getPhysicalAddress(pid, virtAddress);
-        int t = page_table->getPhysicalAddress(pid, var->virtual_address);
-
-        memcpy((uint8_t*)memory + physicalAddress, &val, size);
-    }
-    else if(type == DataType::Float){
-        size = 4;
-        float val = std::stof(*x, &sz);
-        int offsetMultiplied = offset * size;
-        int physicalAddress = page_table->getPhysicalAddress(pid, (var->virtual_address + offsetMultiplied));
-        memcpy((uint8_t*)memory + physicalAddress, &val, size);
-    }else if(type == DataType::Int){
-        size = 4;
-        int val = std::stoi(*x, &sz);
-        int offsetMultiplied = offset * size;
-        int physicalAddress = page_table->getPhysicalAddress(pid, (var->virtual_address + offsetMultiplied));
-        memcpy((uint8_t*)memory + physicalAddress, &val, size);
-    }else if(type == DataType::Short){
-        size = 2;
-        short val = std::stoi(*x, &sz);
-        int offsetMultiplied = offset * size;
-        int physicalAddress = page_table->getPhysicalAddress(pid, (var->virtual_address + offsetMultiplied));
-        memcpy((uint8_t*)memory + physicalAddress, &val, size);
-    }
-    //std::string *x = static_cast<std::string*>(value);
-    //int *x = static_cast<int*>(value);
-    //int val = *x;
-    // int val = allNums(*x);
-    
-    //int val = *(int*)value;
-    // std::cout << "value is: " << value << " &value is " << &value <<std::endl;
-    // std::cout << "VAL is: "<< val << " &VAL is: "<< &val <<std::endl;
-    //   - insert `value` into `memory` at physical address
-    //   * note: this function only handles a single element (i.e. you'll need to call this within a loop when setting
-    //           multiple elements of an array)
+    printThroughput(counts, seconds);
+    return 0;
 }
 
-void freeVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table)
+/*
+    trace_file: binary trace written by --convert
+    same as runBatch but the commands come pre-parsed from the mapped file
+*/
+int runReplay(std::string trace_file, bool quiet, Mmu *mmu, PageTable *page_table, void *memory)
 {
-    //   - remove entry from MMU
-    Variable *var = mmu->getVariable(pid, var_name);
-    var->name = "<FREE_SPACE>";
-    var->type = DataType::FreeSpace;
-    int pageNumStart = page_table->getPageNumber(var->virtual_address);
-    int pageNumEnd = page_table->getPageNumber(var->virtual_address + var->size);
-    int countOfVarsOnPage[(pageNumEnd-pageNumStart)+1] = {0};
-    int countStartPage = 0;
-    int countEndPage = 0;
-
-    // figure out if the page (s) that the var to be freed is on have more than just that var
-    std::vector<Variable*> allVarsForProcess = mmu->getAllVars(pid);
-    for(int i = 0; i < allVarsForProcess.size(); i++){
-        if(allVarsForProcess[i]->name != "<FREE_SPACE>"){
-            int varsStartPageNum = page_table->getPageNumber(allVarsForProcess[i]->virtual_address);
-            int varsEndPageNum = page_table->getPageNumber(allVarsForProcess[i]->virtual_address + allVarsForProcess[i]->size);
-            // if(varsStartPageNum == pageNumStart || varsEndPageNum == pageNumStart){
-            //     countStartPage++;
-            // }else if(varsStartPageNum == pageNumEnd || varsEndPageNum == pageNumEnd){
-            //     countEndPage++;
-            // }
-            if((varsStartPageNum - pageNumStart >= 0) && (varsStartPageNum - pageNumStart < (pageNumEnd-pageNumStart)+1)){
-                countOfVarsOnPage[varsStartPageNum - pageNumStart]++;
-            }else if((varsStartPageNum - pageNumEnd >= 0) && (varsStartPageNum - pageNumEnd < (pageNumEnd-pageNumStart)+1)){
-                countOfVarsOnPage[varsStartPageNum - pageNumStart]++;
-            }else if((varsEndPageNum - pageNumStart >= 0) && (varsEndPageNum - pageNumStart < (pageNumEnd-pageNumStart)+1)){
-                countOfVarsOnPage[varsStartPageNum - pageNumStart]++;
-            }else if((varsEndPageNum - pageNumEnd >= 0) && (varsEndPageNum - pageNumEnd < (pageNumEnd-pageNumStart)+1)){
-                countOfVarsOnPage[varsStartPageNum - pageNumStart]++;
-            }
-        }
-    }
+    OutputBuffer output(STDOUT_FILENO, 1 << 20, quiet);
+    std::streambuf *console = std::cout.rdbuf(&output);
 
-    for(int j = 0; j < (pageNumEnd-pageNumStart+1); j++){
-        if(countOfVarsOnPage[j] == 0){
-            page_table->removeEntry(pid, (pageNumStart + j));
-        }
-    }
+    uint64_t counts[CommandType::CmdCount] = {0};
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int status = replayTrace(trace_file, mmu, page_table, memory, counts);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-    mmu->mergeFreeSpace(var->virtual_address, var->size, pid);
-    
-    //   - free page if this variable was the only one on a given page
-    // check virtual address and virtual address + size to see if they are on different pages
-    //entry pid|pageNum
-    //loop through all the entries and if there is 
-    //how to find amount of vars on a page
-    // - check front and end page of newly freed var.
+    output.finish();
+    std::cout.rdbuf(console);
+
+    printThroughput(counts, seconds);
+    return status;
 }
 
-void terminateProcess(uint32_t pid, Mmu *mmu, PageTable *page_table)
+/*
+    threads: number of worker threads (> 1)
+    same as runBatch but commands of different processes run concurrently
+*/
+int runThreads(std::string trace_file, uint32_t threads, bool quiet, Mmu *mmu, PageTable *page_table, void *memory)
 {
-    //   - free all pages associated with given process
-    std::vector<Variable*> processVars = mmu->getAllVars(pid);
-    for(int i = 0; i < processVars.size(); i++){
-        freeVariable(pid, processVars[i]->name, mmu, page_table);
-    }
-    //   - remove process from MMU
-    mmu->removeProcess(pid);
-}
+    OutputBuffer output(STDOUT_FILENO, 1 << 20, quiet);
+    std::streambuf *console = std::cout.rdbuf(&output);
 
-void printVariable(uint32_t pid, std::string var_name, Mmu *mmu, PageTable *page_table, void *memory){
-    Variable *var = mmu->getVariable(pid, var_name);
-    DataType type = var->type;
-    uint32_t size;
-    uint32_t add;
-    int physicalAddress = page_table->getPhysicalAddress(pid, var->virtual_address);
-    uint32_t totalVarSize = var->size;
-    int count = 0;
-
-    if(type == DataType::Char){
-        size = 1;
-        char value;
-        for(int i = 0; i < totalVarSize; i+=size){
-            int physicalAddressOffset = physicalAddress + i;
-            if(count == 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << value;
-            }
-            if(count < 4 && count > 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << ", " << value;
-            }
-            count++;
-        }
-        if(count > 4){
-            std::cout << ", ... ["<<(count)<<" items]";
-        }
-    }else if(type == DataType::Double){
-        size = 8;
-        double value;
-        for(int i = 0; i < totalVarSize; i+=size){
-            int physicalAddressOffset = physicalAddress + i;
-            if(count == 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << value;
-            }
-            if(count < 4 && count > 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << ", " << value;
-            }
-            count++;
-        }
-        if(count > 4){
-            std::cout << ", ... ["<<(count)<<" items]";
-        }
-    }else if(type == DataType::Long){
-        size = 8;
-        long value;
-        for(int i = 0; i < totalVarSize; i+=size){
-            int physicalAddressOffset = physicalAddress + i;
-            if(count == 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << value;
-            }
-            if(count < 4 && count > 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << ", " << value;
-            }
-            count++;
-        }
-        if(count > 4){
-            std::cout << ", ... ["<<(count)<<" items]";
-        }
-    }else if(type == DataType::Float){
-        size = 4;
-        float value;
-        for(int i = 0; i < totalVarSize; i+=size){
-            int physicalAddressOffset = physicalAddress + i;
-            if(count == 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << value;
-            }
-            if(count < 4 && count > 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << ", " << value;
-            }
-            count++;
-        }
-        if(count > 4){
-            std::cout << ", ... ["<<(count)<<" items]";
-        }
-    }else if(type == DataType::Int){
-        size = 4;
-        int value;
-        for(int i = 0; i < totalVarSize; i+=size){
-            int physicalAddressOffset = physicalAddress + i;
-            if(count == 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << value;
-            }
-            if(count < 4 && count > 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << ", " << value;
-            }
-            count++;
-        }
-        if(count > 4){
-            std::cout << ", ... ["<<(count)<<" items]";
-        }
-    }else if(type == DataType::Short){
-        size = 2;
-        short value;
-        for(int i = 0; i < totalVarSize; i+=size){
-            int physicalAddressOffset = physicalAddress + i;
-            if(count == 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << value;
-            }
-            if(count < 4 && count > 0){
-                memcpy(&value, (uint8_t*)memory + physicalAddressOffset, size);
-                std::cout << ", " << value;
-            }
-            count++;
-        }
-        if(count > 4){
-            std::cout << ", ... ["<<(count)<<" items]";
-        }
-    }
-    std::cout << std::endl;
-}
+    uint64_t counts[CommandType::CmdCount] = {0};
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int status = runParallel(trace_file, threads, mmu, page_table, memory, counts);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
+    output.finish();
+    std::cout.rdbuf(console);
 
-void splitString(std::string text, char d, std::vector<std::string>& result)
-{
-    enum states { NONE, IN_WORD, IN_STRING } state = NONE;
+    printThroughput(counts, seconds);
+    return status;
+}
 
-    int i;
-    std::string token;
-    result.clear();
-    for (i = 0; i < text.length(); i++)
+// Byte count with an optional K, M or G suffix (powers of 1024), false if text is not one
+// or the count does not fit in 64 bits
+bool parseSize(std::string text, uint64_t *value)
+{
+    if (text.empty() || !isdigit((unsigned char)text[0]))
     {
-        char c = text[i];
-        switch (state) {
-            case NONE:
-                if (c != d)
-                {
-                    if (c == '\"')
-                    {
-                        state = IN_STRING;
-                        token = "";
-                    }
-                    else
-                    {
-                        state = IN_WORD;
-                        token = c;
-                    }
-                }
-                break;
-            case IN_WORD:
-                if (c == d)
-                {
-                    result.push_back(token);
-                    state = NONE;
-                }
-                else
-                {
-                    token += c;
-                }
-                break;
-            case IN_STRING:
-                if (c == '\"')
-                {
-                    result.push_back(token);
-                    state = NONE;
-                }
-                else
-                {
-                    token += c;
-                }
-                break;
-        }
+        return false;
+    }
+    char *end = NULL;
+    errno = 0;
+    uint64_t count = strtoull(text.c_str(), &end, 10);
+    if (errno == ERANGE)
+    {
+        return false;
     }
-    if (state != NONE)
+    std::string suffix = end;
+    int shift = 0;
+    if (suffix == "K" || suffix == "k")
     {
-        result.push_back(token);
+        shift = 10;
     }
+    else if (suffix == "M" || suffix == "m")
+    {
+        shift = 20;
+    }
+    else if (suffix == "G" || suffix == "g")
+    {
+        shift = 30;
+    }
+    else if (!suffix.empty())
+    {
+        return false;
+    }
+    if (count > (UINT64_MAX >> shift))
+    {
+        return false;
+    }
+    *value = count << shift;
+    return true;
 }
 
-/*
-    checkString: text to check if it is all numbers
-    returns the string as an int if checkString is an int and -1 if it is not
-*/
-int allNums(std::string checkString){
-    for(int i = 0; i < checkString.length(); i++){
-        if(isdigit(checkString[i]) == false){
-            return -1;
+// Report total and per-type command counts of a batch or replay run on stderr
+void printThroughput(uint64_t counts[CmdCount], double seconds)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < CommandType::CmdCount; i++)
+    {
+        total += counts[i];
+    }
+    fprintf(stderr, "Replayed %llu commands in %.3f s (%.0f commands/sec)\n", (unsigned long long)total, seconds,
+            (seconds > 0) ? total / seconds : 0.0);
+    for (int i = 0; i < CommandType::CmdCount; i++)
+    {
+        if (counts[i] > 0)
+        {
+            fprintf(stderr, "  %-10s %llu\n", commandTypeName((CommandType)i), (unsigned long long)counts[i]);
         }
     }
-    return atoi(checkString.c_str());
-}
\ No newline at end of file
+}
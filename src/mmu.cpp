@@ -1,205 +1,756 @@
 #include "mmu.h"
+#include <cstring>
 
-Mmu::Mmu(int memory_size)
+/*
+    memory_size: bytes that can be allocated over all processes (physical memory plus swap)
+    virtual_size: bytes of virtual address space each process gets, independent of memory_size
+*/
+Mmu::Mmu(uint64_t memory_size, uint64_t virtual_size, int page_size)
 {
-    _next_pid = 1024;
-    _max_size = memory_size;
+    _first_pid = 1024;
+    _next_pid = _first_pid;
+    _memory_size = memory_size;
+    _virtual_size = virtual_size;
+    _page_size = page_size;
+    _num_processes = 0;
+    _bytes_used = 0;
+    _fit_policy = FitPolicy::FirstFit;
+    _compact_threshold = 0;
+    _huge_alignment = 0;
+    _num_shards = 0;
+    _timing = false;
+    setShards(1);
 }
 
 Mmu::~Mmu()
 {
+    for (size_t i = 0; i < _processes.size(); i++)
+    {
+        if (_processes[i] != NULL)
+        {
+            deleteProcess(_processes[i]);
+        }
+    }
+    for (uint32_t i = 0; i < _num_shards; i++)
+    {
+        delete _process_pools[i];
+        delete _variable_pools[i];
+    }
 }
 
-uint32_t Mmu::createProcess()
+/*
+    num_shards: number of threads that may run commands at once
+    gives every shard its own record pools and counters; processes of pids in different
+    shards then share nothing but atomics. Must be called before the first process exists
+*/
+void Mmu::setShards(uint32_t num_shards)
 {
-    Process *proc = new Process();
-    proc->pid = _next_pid;
+    for (uint32_t i = 0; i < _num_shards; i++)
+    {
+        delete _process_pools[i];
+        delete _variable_pools[i];
+    }
+    _num_shards = num_shards;
+    _process_pools.assign(num_shards, NULL);
+    _variable_pools.assign(num_shards, NULL);
+    for (uint32_t i = 0; i < num_shards; i++)
+    {
+        _process_pools[i] = new Pool<Process>();
+        _variable_pools[i] = new Pool<Variable>();
+    }
+    MmuStats zero;
+    memset(&zero, 0, sizeof(zero));
+    _stats.assign(num_shards, zero);
+    _latency.assign(num_shards, MmuLatency());
+}
 
-    Variable *var = new Variable();
-    var->name = "<FREE_SPACE>";
-    var->type = DataType::FreeSpace;
-    var->virtual_address = 0;
-    var->size = _max_size;
-    proc->variables.push_back(var);
+uint32_t Mmu::numShards()
+{
+    return _num_shards;
+}
 
-    _processes.push_back(proc);
+uint32_t Mmu::shardOf(uint32_t pid)
+{
+    return pid % _num_shards;
+}
 
-    _next_pid++;
-    return proc->pid;
+// Pids are handed out densely and never reused, so pid - _first_pid is the slot of the process
+Process* Mmu::findProcess(uint32_t pid)
+{
+    if (pid < _first_pid || pid - _first_pid >= _processes.size())
+    {
+        return NULL;
+    }
+    return _processes[pid - _first_pid];
 }
 
-void Mmu::addVariableToProcess(uint32_t pid, std::string var_name, DataType type, uint32_t size, uint32_t address)
+// Add (sign = 1) or remove (sign = -1) a live variable from the padding and per-page counters
+// (its bytes in use are reserved and released by the callers)
+void Mmu::accountVariable(Process *proc, Variable *var, int sign)
 {
-    int i;
-    Process *proc = NULL;
-    for (i = 0; i < _processes.size(); i++)
+    if (var->padding > 0)
+    {
+        proc->padding_bytes += (uint64_t)(sign * (int64_t)var->padding);
+        proc->padded_vars += sign;
+    }
+    if (var->size == 0)
+    {
+        return;
+    }
+
+    uint64_t first_page = var->virtual_address / _page_size;
+    uint64_t last_page = (var->virtual_address + var->size - 1) / _page_size;
+    for (uint64_t page = first_page; page <= last_page; page++)
+    {
+        uint64_t page_start = page * _page_size;
+        uint64_t start = std::max(var->virtual_address, page_start);
+        uint64_t end = std::min(var->virtual_address + var->size, page_start + _page_size);
+
+        PageUsage& usage = proc->pages[page];
+        usage.live_bytes += sign * (int32_t)(end - start);
+        usage.live_vars += sign;
+        if (usage.live_vars == 0)
+        {
+            proc->pages.erase(page);
+        }
+    }
+}
+
+void Mmu::deleteProcess(Process *proc)
+{
+    uint32_t shard = shardOf(proc->pid);
+    for (size_t i = 0; i < proc->variables.size(); i++)
+    {
+        _variable_pools[shard]->release(proc->variables[i]);
+    }
+    _process_pools[shard]->release(proc);
+}
+
+// Hand out the next count pids without creating the processes yet, their slots stay empty
+// until createProcess(pid); returns the first one
+uint32_t Mmu::reservePids(uint32_t count)
+{
+    uint32_t first = _next_pid;
+    _next_pid += count;
+    _processes.resize(_next_pid - _first_pid, NULL);
+    return first;
+}
+
+uint32_t Mmu::createProcess()
+{
+    uint32_t pid = reservePids(1);
+    createProcess(pid);
+    return pid;
+}
+
+// Create the process for a pid returned by reservePids
+void Mmu::createProcess(uint32_t pid)
+{
+    Process *proc = _process_pools[shardOf(pid)]->allocate();
+    proc->pid = pid;
+    proc->holes.release(0, _virtual_size);
+
+    _processes[pid - _first_pid] = proc;
+    _num_processes++;
+}
+
+/*
+    parent_pid: a live process, pid: taken with reservePids
+    creates pid as a copy of the parent: same variables at the same addresses, same holes,
+    attached to the same shared memory segments. The child's other bytes are reserved like
+    the parent's (the page table shares the frames); false, and no process, if they do not fit
+*/
+bool Mmu::forkProcess(uint32_t parent_pid, uint32_t pid)
+{
+    Process *parent = findProcess(parent_pid);
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < parent->variables.size(); i++)
+    {
+        if (!(parent->variables[i]->flags & VAR_SHARED))
+        {
+            bytes += parent->variables[i]->size;
+        }
+    }
+    if (!reserveBytes(bytes))
+    {
+        return false;
+    }
+
+    Process *proc = _process_pools[shardOf(pid)]->allocate();
+    proc->pid = pid;
+    proc->holes = parent->holes;
+    proc->pages = parent->pages;
+    proc->padding_bytes = parent->padding_bytes;
+    proc->padded_vars = parent->padded_vars;
+    proc->variables.reserve(parent->variables.size());
+    for (size_t i = 0; i < parent->variables.size(); i++)
     {
-        if (_processes[i]->pid == pid)
+        Variable *var = _variable_pools[shardOf(pid)]->allocate();
+        *var = *parent->variables[i];
+        proc->variables.push_back(var);
+        proc->index.insert(var);
+        proc->by_address[std::make_pair(var->virtual_address, var->name)] = var;
+        if (var->flags & VAR_SHARED)
         {
-            proc = _processes[i];
+            std::lock_guard<std::mutex> guard(_segments_lock);
+            _segments[var->name].pids.push_back(pid);
         }
-    } 
+    }
+
+    _processes[pid - _first_pid] = proc;
+    _num_processes++;
+    return true;
+}
 
-    Variable *var = new Variable();
-    var->name = var_name;
+Variable* Mmu::addVariableToProcess(uint32_t pid, std::string var_name, DataType type, uint64_t size, uint64_t address)
+{
+    return addVariableToProcess(pid, _names.intern(var_name), type, size, address);
+}
+
+// Add a variable at a given address (e.g. restored from a snapshot); its bytes count towards
+// memory without checking the limit
+Variable* Mmu::addVariableToProcess(uint32_t pid, uint32_t name, DataType type, uint64_t size, uint64_t address, uint8_t flags, uint16_t padding)
+{
+    Process *proc = findProcess(pid);
+    if (type == DataType::FreeSpace)
+    {
+        mergeFreeSpace(address, size, pid);
+        return NULL;
+    }
+    if (proc == NULL)
+    {
+        return NULL;
+    }
+    if (!(flags & VAR_SHARED))
+    {
+        _bytes_used += size;
+    }
+    return insertVariable(proc, name, type, size, address, flags, padding);
+}
+
+Variable* Mmu::insertVariable(Process *proc, uint32_t name, DataType type, uint64_t size, uint64_t address, uint8_t flags, uint16_t padding)
+{
+    Variable *var = _variable_pools[shardOf(proc->pid)]->allocate();
+    var->name = name;
     var->type = type;
+    var->flags = flags | ((var->name < NAME_FIRST_USER) ? VAR_SYSTEM : 0);
     var->virtual_address = address;
     var->size = size;
-    if (proc != NULL)
+    var->padding = padding;
+    var->index = proc->variables.size();
+    proc->variables.push_back(var);
+    proc->index.insert(var);
+    proc->by_address[std::make_pair(address, name)] = var;
+    accountVariable(proc, var, 1);
+    return var;
+}
+
+// Pick a hole for a new variable with the current fit policy and add the variable there. The
+// caller has reserved its size with reserveBytes (not for a shared segment, whose bytes are
+// the segment's) and releases it again if this returns NULL
+Variable* Mmu::placeVariable(uint32_t pid, std::string var_name, DataType type, uint64_t size, uint32_t type_size)
+{
+    return placeVariable(pid, _names.intern(var_name), type, size, type_size);
+}
+
+Variable* Mmu::placeVariable(uint32_t pid, uint32_t name, DataType type, uint64_t size, uint32_t type_size, uint8_t flags)
+{
+    Process *proc = findProcess(pid);
+    uint64_t address;
+    uint64_t padding;
+    MmuStats& stats = _stats[shardOf(pid)];
+    stats.placements++;
+    ScopedLatency timer(_timing ? &_latency[shardOf(pid)].place : NULL);
+    // a variable that can fill a huge page starts on one, so the page table can map it with them,
+    // and a shared segment starts on a page; the gap skipped for either stays a usable hole
+    uint32_t boundary = _page_size;
+    bool align = (flags & VAR_SHARED) != 0;
+    if (_huge_alignment > 0 && size >= _huge_alignment && !(flags & VAR_SHARED))
     {
-        proc->variables.push_back(var);
+        type_size = boundary = _huge_alignment;
+        align = true;
     }
+    if (proc == NULL || !proc->holes.allocate(size, type_size, boundary, _fit_policy, align, &address, &padding))
+    {
+        return NULL;
+    }
+    if (padding > 0 && align)
+    {
+        stats.aligned_allocations++;
+        stats.alignment_bytes += padding;
+        padding = 0;
+    }
+    // page-boundary padding (less than one element) belongs to the variable until it is freed
+    return insertVariable(proc, name, type, size, address, flags, padding);
+}
+
+void Mmu::setFitPolicy(FitPolicy policy)
+{
+    _fit_policy = policy;
+}
+
+void Mmu::setCompactThreshold(uint32_t holes)
+{
+    _compact_threshold = holes;
 }
 
+// Size of a huge page: variables at least that big are placed (and compacted) on a multiple of it
+void Mmu::setHugeAlignment(uint32_t bytes)
+{
+    _huge_alignment = bytes;
+}
+
+bool Mmu::needsCompaction(uint32_t pid)
+{
+    Process *proc = findProcess(pid);
+    return _compact_threshold > 0 && proc != NULL && proc->holes.numHoles() > _compact_threshold;
+}
+
+// Slide the process's variables down to the bottom of its virtual space in address order,
+// keeping the page-boundary padding rule, and rebuild its holes. Only the bookkeeping
+// changes: returns the variables that moved (in address order) so their bytes and page
+// mappings can be moved to match
+std::vector<Relocation> Mmu::compactProcess(uint32_t pid)
+{
+    std::vector<Relocation> moves;
+    Process *proc = findProcess(pid);
+    if (proc == NULL)
+    {
+        return moves;
+    }
+
+    // addresses change but their order does not, so the address index is rebuilt in one pass
+    AddressIndex sorted;
+    sorted.swap(proc->by_address);
+
+    uint64_t cursor = 0;
+    proc->holes.clear();
+    for (AddressIndex::iterator it = sorted.begin(); it != sorted.end(); it++)
+    {
+        Variable *var = it->second;
+        // a shared memory segment keeps whole pages to itself
+        uint32_t type_size = (var->flags & VAR_SHARED) ? _page_size : dataTypeSize(var->type);
+        uint32_t boundary = _page_size;
+        bool align = (var->flags & VAR_SHARED) != 0;
+        if (_huge_alignment > 0 && var->size >= _huge_alignment && !(var->flags & VAR_SHARED))
+        {
+            type_size = boundary = _huge_alignment;
+            align = true;
+        }
+        uint64_t room = boundary - (cursor % boundary);
+        uint16_t padding = 0;
+        if (room < type_size && type_size <= boundary)
+        {
+            if (align)
+            {
+                proc->holes.release(cursor, room);
+            }
+            else
+            {
+                padding = room;
+            }
+            cursor += room;
+        }
+        if (var->virtual_address != cursor || var->padding != padding)
+        {
+            if (var->virtual_address != cursor)
+            {
+                Relocation move = {var, var->virtual_address};
+                moves.push_back(move);
+            }
+            accountVariable(proc, var, -1);
+            var->virtual_address = cursor;
+            var->padding = padding;
+            accountVariable(proc, var, 1);
+        }
+        proc->by_address.insert(proc->by_address.end(), std::make_pair(std::make_pair(cursor, var->name), var));
+        cursor += var->size;
+    }
+    proc->holes.release(cursor, _virtual_size - cursor);
+    return moves;
+}
+
+void Mmu::recordCompaction(uint32_t pid, uint32_t frames_reclaimed, uint64_t bytes_moved)
+{
+    MmuStats& stats = _stats[shardOf(pid)];
+    stats.compactions++;
+    stats.frames_reclaimed += frames_reclaimed;
+    stats.compaction_bytes += bytes_moved;
+}
+
+// Processes are kept by pid, so walking them prints in pid order with nothing to sort
 void Mmu::print()
 {
-    int i, j;
+    std::cout << " PID  | Variable Name | Virtual Addr | Size" << std::endl;
+    std::cout << "------+---------------+--------------+------------" << std::endl;
+    RowWriter rows(std::cout);
+    for (size_t i = 0; i < _processes.size(); i++)
+    {
+        if (_processes[i] != NULL)
+        {
+            printVariables(_processes[i], 0, UINT64_MAX, rows);
+        }
+    }
+}
 
+// Only the variables of one process overlapping [first_address, last_address]
+void Mmu::print(uint32_t pid, uint64_t first_address, uint64_t last_address)
+{
     std::cout << " PID  | Variable Name | Virtual Addr | Size" << std::endl;
     std::cout << "------+---------------+--------------+------------" << std::endl;
-    for (i = 0; i < _processes.size(); i++)
+    RowWriter rows(std::cout);
+    Process *proc = findProcess(pid);
+    if (proc != NULL)
     {
-        uint32_t pid = _processes[i]->pid;
-        for (j = 0; j < _processes[i]->variables.size(); j++)
+        printVariables(proc, first_address, last_address, rows);
+    }
+}
+
+// Rows for a process's variables in address order (free space is kept in the process's
+// hole list, not here). Variables do not overlap, so only those starting at the last address
+// below first_address can reach into the range; the walk starts there and stops past it
+void Mmu::printVariables(Process *proc, uint64_t first_address, uint64_t last_address, RowWriter& rows)
+{
+    AddressIndex::iterator it = proc->by_address.lower_bound(std::make_pair(first_address, (uint32_t)0));
+    if (it != proc->by_address.begin())
+    {
+        AddressIndex::iterator prev = it;
+        prev--;
+        it = proc->by_address.lower_bound(std::make_pair(prev->first.first, (uint32_t)0));
+    }
+    for (; it != proc->by_address.end() && it->first.first <= last_address; it++)
+    {
+        const Variable *var = it->second;
+        if (var->virtual_address < first_address && var->virtual_address + var->size <= first_address)
         {
-            //print all variables (excluding <FREE_SPACE> entries)
-            std::string varName = _processes[i]->variables[j]->name;
-            uint32_t virtualAddress = _processes[i]->variables[j]->virtual_address;
-            uint32_t varSize = _processes[i]->variables[j]->size;
-            if(varName != "<FREE_SPACE>"){
-                printf(" %4u | %-13s |   0x%08X | %10u \n", pid, varName.c_str(), virtualAddress, varSize);     
-            }
+            continue;
         }
+        rows.row(" %4u | %-13s |   0x%08llX | %10llu \n", proc->pid, _names.name(var->name).c_str(),
+                 (unsigned long long)var->virtual_address, (unsigned long long)var->size);
     }
 }
 
 Variable* Mmu::getVariable(uint32_t pid, std::string var_name){
-    for(int i = 0; i < _processes.size(); i++){
-        if(_processes[i]->pid == pid){
-            for(int j = 0; j < _processes[i]->variables.size(); j++){
-                if(_processes[i]->variables[j]->name == var_name){
-                    return _processes[i]->variables[j];
-                }
-            }
-        }
+    int64_t name = _names.find(var_name);
+    if(name < 0){
+        _stats[shardOf(pid)].lookups++;
+        return NULL;
     }
-    return NULL;
+    return getVariable(pid, (uint32_t)name);
 }
 
-bool Mmu::processExists(uint32_t pid){
-    for(int i = 0; i < _processes.size(); i++){
-        if(_processes[i]->pid == pid){
-            return true;
-        }
+Variable* Mmu::getVariable(uint32_t pid, uint32_t name){
+    _stats[shardOf(pid)].lookups++;
+    ScopedLatency timer(_timing ? &_latency[shardOf(pid)].lookup : NULL);
+    Process *proc = findProcess(pid);
+    if(proc == NULL){
+        return NULL;
     }
-    return false;
+    return proc->index.find(name);
 }
 
-void Mmu::printProcesses(){
-    for(int i = 0; i < _processes.size(); i++){
-        std::cout<<_processes[i]->pid<<std::endl;
+const std::string& Mmu::getVariableName(Variable *var){
+    return _names.name(var->name);
+}
+
+uint32_t Mmu::internName(std::string var_name){
+    return _names.intern(var_name);
+}
+
+// Remove a live variable from its process and delete it, its range still has to be
+// handed back with mergeFreeSpace
+void Mmu::removeVariable(uint32_t pid, Variable *var){
+    _stats[shardOf(pid)].removals++;
+    ScopedLatency timer(_timing ? &_latency[shardOf(pid)].remove : NULL);
+    Process *proc = findProcess(pid);
+    if(proc == NULL){
+        return;
+    }
+    proc->index.erase(var->name);
+    proc->by_address.erase(std::make_pair(var->virtual_address, var->name));
+    accountVariable(proc, var, -1);
+    if(!(var->flags & VAR_SHARED)){
+        releaseBytes(var->size);
     }
+    // the last variable takes its slot, so removal does not shift the rest
+    Variable *last = proc->variables.back();
+    last->index = var->index;
+    proc->variables[var->index] = last;
+    proc->variables.pop_back();
+    _variable_pools[shardOf(pid)]->release(var);
 }
 
-bool Mmu::spaceLeft(int size){
-    uint32_t mem_size = 67108864;
-    uint32_t memUsed = size;
+bool Mmu::processExists(uint32_t pid){
+    return findProcess(pid) != NULL;
+}
 
+void Mmu::printProcesses(){
     for(int i = 0; i < _processes.size(); i++){
-        for(int j = 0; j < _processes[i]->variables.size(); j++){
-            std::string varName = _processes[i]->variables[j]->name;
-            if(varName != "<FREE_SPACE>"){
-                memUsed = memUsed + _processes[i]->variables[j]->size;
-            }
+        if(_processes[i] != NULL){
+            std::cout<<_processes[i]->pid<<std::endl;
         }
     }
+}
 
-    if(memUsed <= mem_size){
-        return true;
-    }else {
-        return false;
+/*
+    takes size bytes of the memory limit for an allocation about to be placed; false, and
+    nothing taken, if they do not fit. The check and the add are one compare-exchange, so
+    threads allocating at once can never take more than the limit between them
+*/
+bool Mmu::reserveBytes(uint64_t size){
+    uint64_t used = _bytes_used.load();
+    do{
+        if(size > _memory_size || used > _memory_size - size){
+            return false;
+        }
+    }while(!_bytes_used.compare_exchange_weak(used, used + size));
+    return true;
+}
+
+// Give back bytes of a freed variable or segment, or of a reservation that was not placed
+void Mmu::releaseBytes(uint64_t size){
+    _bytes_used -= size;
+}
+
+uint64_t Mmu::bytesUsed(){
+    return _bytes_used;
+}
+
+uint64_t Mmu::memorySize(){
+    return _memory_size;
+}
+
+uint64_t Mmu::virtualSize(){
+    return _virtual_size;
+}
+
+void Mmu::mergeFreeSpace(uint64_t address, uint64_t size, uint32_t pid){
+    // newly created freespace is merged with any hole directly before or after it
+    _stats[shardOf(pid)].merges++;
+    ScopedLatency timer(_timing ? &_latency[shardOf(pid)].merge : NULL);
+    Process *proc = findProcess(pid);
+    if(proc != NULL){
+        proc->holes.release(address, size);
     }
 }
 
-void Mmu::mergeFreeSpace(uint32_t address, uint32_t size, uint32_t pid){
-    // if newly created freespace has freespace directly before or after then merge them
+std::vector<Variable*> Mmu::getAllVars(uint32_t pid){
+    std::vector<Variable*> toReturn;
+    Process *proc = findProcess(pid);
+    if(proc != NULL){
+        return proc->variables;
+    }
+    return toReturn;
+}
 
-    uint32_t beforeAddress = -1;
-    uint32_t afterAddress = address;
-    bool otherFreeSpace = false;
+uint32_t Mmu::liveBytesOnPage(uint32_t pid, uint64_t page_num){
+    Process *proc = findProcess(pid);
+    if(proc == NULL){
+        return 0;
+    }
+    std::unordered_map<uint64_t, PageUsage>::iterator it = proc->pages.find(page_num);
+    return (it == proc->pages.end()) ? 0 : it->second.live_bytes;
+}
 
-    //find freespace before 
-    for(int i = 0; i < _processes.size(); i++){
-        if(_processes[i]->pid == pid){
-            for(int j = 0; j < _processes[i]->variables.size(); j++){
-                std::string varName = _processes[i]->variables[j]->name;
-                if(varName == "<FREE_SPACE>"){
-                    if(_processes[i]->variables[j]->virtual_address + _processes[i]->variables[j]->size == address){ //freespace directly before new freespace
-                        _processes[i]->variables[j]->size += size;
-                        otherFreeSpace = true;
-                    }
-
-                    if(_processes[i]->variables[j]->virtual_address == (address + size)){ //freespace directly after new freespace
-                        _processes[i]->variables[j]->size += size;
-                        otherFreeSpace = true;
-                    }
-                }
-            }
-        }
+uint32_t Mmu::liveVariablesOnPage(uint32_t pid, uint64_t page_num){
+    Process *proc = findProcess(pid);
+    if(proc == NULL){
+        return 0;
     }
+    std::unordered_map<uint64_t, PageUsage>::iterator it = proc->pages.find(page_num);
+    return (it == proc->pages.end()) ? 0 : it->second.live_vars;
+}
 
-    //remove new free space from var list if merged
-    if(otherFreeSpace){
-        for(int i = 0; i < _processes.size(); i++){
-            if(_processes[i]->pid == pid){
-                for(int j = 0; j < _processes[i]->variables.size(); j++){
-                    uint32_t varAddress = _processes[i]->variables[j]->virtual_address;
-                    if(varAddress == address){
-                        _processes[i]->variables.erase((_processes[i]->variables.begin() + j));
-                    }
-                }
+void Mmu::removeProcess(uint32_t pid){
+    Process *proc = findProcess(pid);
+    if(proc != NULL){
+        for(int j = 0; j < proc->variables.size(); j++){
+            if(!(proc->variables[j]->flags & VAR_SHARED)){
+                _bytes_used -= proc->variables[j]->size;
             }
         }
+        _processes[pid - _first_pid] = NULL;
+        _num_processes--;
+        deleteProcess(proc);
     }
 }
 
-std::vector<Variable*> Mmu::getAllVars(uint32_t pid){
-    std::vector<Variable*> toReturn;
-    for(int i = 0; i < _processes.size(); i++){
-        if(_processes[i]->pid == pid){
-            return _processes[i]->variables;
+// Register a segment the page table created frames for; its bytes, counted once for all the
+// processes attached to it, were taken with reserveBytes
+void Mmu::addSegment(uint32_t name, uint64_t size, uint32_t id){
+    std::lock_guard<std::mutex> guard(_segments_lock);
+    Segment& segment = _segments[name];
+    segment.id = id;
+    segment.size = size;
+}
+
+Segment* Mmu::findSegment(uint32_t name){
+    std::lock_guard<std::mutex> guard(_segments_lock);
+    std::unordered_map<uint32_t, Segment>::iterator it = _segments.find(name);
+    return (it == _segments.end()) ? NULL : &it->second;
+}
+
+/*
+    name: an existing segment, not attached to pid yet
+    places a variable named after the segment at a page boundary of pid's virtual space,
+    spanning the segment's pages; NULL if no hole is large enough
+*/
+Variable* Mmu::attachSegment(uint32_t pid, uint32_t name){
+    Segment *segment = findSegment(name);
+    Variable *var = placeVariable(pid, name, DataType::Char, segment->size, _page_size, VAR_SHARED);
+    if(var != NULL){
+        std::lock_guard<std::mutex> guard(_segments_lock);
+        segment->pids.push_back(pid);
+    }
+    return var;
+}
+
+/*
+    name: a segment whose variable was just removed from pid
+    drops pid from the segment's processes; once none is left the segment is gone and its
+    id is returned so the page table can forget it, otherwise -1
+*/
+int64_t Mmu::detachSegment(uint32_t pid, uint32_t name){
+    std::lock_guard<std::mutex> guard(_segments_lock);
+    std::unordered_map<uint32_t, Segment>::iterator it = _segments.find(name);
+    if(it == _segments.end()){
+        return -1;
+    }
+    std::vector<uint32_t>& pids = it->second.pids;
+    pids.erase(std::find(pids.begin(), pids.end(), pid));
+    if(!pids.empty()){
+        return -1;
+    }
+    int64_t id = it->second.id;
+    _bytes_used -= it->second.size;
+    _segments.erase(it);
+    return id;
+}
+
+uint32_t Mmu::numProcesses(){
+    return _num_processes;
+}
+
+
+std::vector<uint32_t> Mmu::getPids(){
+    std::vector<uint32_t> pids;
+    for(size_t i = 0; i < _processes.size(); i++){
+        if(_processes[i] != NULL){
+            pids.push_back(_processes[i]->pid);
         }
     }
-    return toReturn;
+    return pids;
 }
 
-int Mmu::getRemainingSpaceOnPage(uint32_t pid, uint32_t virtual_address, int page_size, int page_num){
-    int remainingPageSpace = page_size;
-    for(int i = 0; i < _processes.size(); i++){
-        if(_processes[i]->pid == pid){
-            for(int j = 0; j < _processes[i]->variables.size(); j++){
-                std::string varName = _processes[i]->variables[j]->name;
-                uint32_t varAddress = _processes[i]->variables[j]->virtual_address;
-                int varPageNum = varAddress / page_size;
-                int varSize = _processes[i]->variables[j]->size;
-                if(varName != "<FREE_SPACE>" && (varPageNum == page_num)){
-                    remainingPageSpace = remainingPageSpace - varSize;
-                }
-            }
+uint32_t Mmu::firstPid(){
+    return _first_pid;
+}
+
+// First pid not handed out yet
+uint32_t Mmu::nextPid(){
+    return _next_pid;
+}
+
+uint32_t Mmu::numNames(){
+    return _names.size();
+}
+
+const std::string& Mmu::getName(uint32_t name){
+    return _names.name(name);
+}
+
+const std::map<uint64_t, uint64_t>& Mmu::getHoles(uint32_t pid){
+    return findProcess(pid)->holes.holes();
+}
+
+// Every live segment with its name
+std::vector<std::pair<uint32_t, Segment>> Mmu::getSegments(){
+    std::lock_guard<std::mutex> guard(_segments_lock);
+    return std::vector<std::pair<uint32_t, Segment>>(_segments.begin(), _segments.end());
+}
+
+// Drop every process and segment, pids start over from the first one (names are kept)
+void Mmu::clear(){
+    for(size_t i = 0; i < _processes.size(); i++){
+        if(_processes[i] != NULL){
+            deleteProcess(_processes[i]);
         }
     }
+    _processes.clear();
+    _next_pid = _first_pid;
+    _num_processes = 0;
+    _bytes_used = 0;
+    std::lock_guard<std::mutex> guard(_segments_lock);
+    _segments.clear();
+}
 
-    if(remainingPageSpace <= 0){
-        return 0;
-    }else {
-        return remainingPageSpace;
+// Replace the holes of a process being restored from a snapshot (its variables are added
+// with addVariableToProcess)
+void Mmu::restoreHoles(uint32_t pid, const std::vector<std::pair<uint64_t, uint64_t>>& holes){
+    Process *proc = findProcess(pid);
+    proc->holes.clear();
+    for(size_t i = 0; i < holes.size(); i++){
+        proc->holes.release(holes[i].first, holes[i].second);
     }
 }
 
-void Mmu::removeProcess(uint32_t pid){
-    for(int i = 0; i < _processes.size(); i++){
-        if(_processes[i]->pid == pid){
-            _processes.erase((_processes.begin() + i));
+// Register a segment of a snapshot, already attached to segment.pids; charged like addSegment
+void Mmu::restoreSegment(uint32_t name, const Segment& segment){
+    std::lock_guard<std::mutex> guard(_segments_lock);
+    _segments[name] = segment;
+    _bytes_used += segment.size;
+}
+
+MmuStats Mmu::getStats(){
+    MmuStats stats = _stats[0];
+    for(uint32_t i = 1; i < _num_shards; i++){
+        stats.placements += _stats[i].placements;
+        stats.lookups += _stats[i].lookups;
+        stats.removals += _stats[i].removals;
+        stats.merges += _stats[i].merges;
+        stats.aligned_allocations += _stats[i].aligned_allocations;
+        stats.alignment_bytes += _stats[i].alignment_bytes;
+        stats.compactions += _stats[i].compactions;
+        stats.frames_reclaimed += _stats[i].frames_reclaimed;
+        stats.compaction_bytes += _stats[i].compaction_bytes;
+    }
+    for(size_t i = 0; i < _processes.size(); i++){
+        if(_processes[i] != NULL){
+            stats.padded_variables += _processes[i]->padded_vars;
+            stats.padding_bytes += _processes[i]->padding_bytes;
+            uint32_t holes;
+            uint64_t hole_bytes;
+            uint64_t largest_hole;
+            _processes[i]->holes.innerHoles(_virtual_size, &holes, &hole_bytes, &largest_hole);
+            stats.holes += holes;
+            stats.hole_bytes += hole_bytes;
+            stats.largest_hole = std::max(stats.largest_hole, largest_hole);
         }
     }
-}
\ No newline at end of file
+    std::lock_guard<std::mutex> guard(_segments_lock);
+    for(std::unordered_map<uint32_t, Segment>::iterator it = _segments.begin(); it != _segments.end(); it++){
+        uint64_t attached = it->second.pids.size();
+        stats.segments++;
+        stats.segment_bytes += it->second.size;
+        stats.attachments += attached;
+        stats.segment_bytes_saved += (attached > 1) ? (attached - 1) * it->second.size : 0;
+    }
+    return stats;
+}
+
+// Time placeVariable, getVariable (by name id), removeVariable and mergeFreeSpace from now
+// on (print stats with --latency)
+void Mmu::enableTiming(bool timing){
+    _timing = timing;
+}
+
+MmuLatency Mmu::getLatency(){
+    MmuLatency latency = _latency[0];
+    for(uint32_t i = 1; i < _num_shards; i++){
+        latency.place.merge(_latency[i].place);
+        latency.lookup.merge(_latency[i].lookup);
+        latency.remove.merge(_latency[i].remove);
+        latency.merge.merge(_latency[i].merge);
+    }
+    return latency;
+}
@@ -0,0 +1,42 @@
+#include "nametable.h"
+
+NameTable::NameTable()
+{
+    intern("<TEXT>");
+    intern("<GLOBALS>");
+    intern("<STACK>");
+}
+
+NameTable::~NameTable()
+{
+}
+
+uint32_t NameTable::intern(const std::string& name)
+{
+    std::unordered_map<std::string, uint32_t>::iterator it = _ids.find(name);
+    if (it != _ids.end())
+    {
+        return it->second;
+    }
+    uint32_t id = _names.size();
+    _names.push_back(name);
+    _ids[name] = id;
+    return id;
+}
+
+// Returns -1 for a name that was never interned (so no variable can have it)
+int64_t NameTable::find(const std::string& name)
+{
+    std::unordered_map<std::string, uint32_t>::iterator it = _ids.find(name);
+    return (it == _ids.end()) ? -1 : (int64_t)it->second;
+}
+
+const std::string& NameTable::name(uint32_t id)
+{
+    return _names[id];
+}
+
+uint32_t NameTable::size()
+{
+    return _names.size();
+}
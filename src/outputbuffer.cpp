@@ -0,0 +1,101 @@
+#include "outputbuffer.h"
+#include <cstdarg>
+#include <cstdio>
+#include <unistd.h>
+
+OutputBuffer::OutputBuffer(int fd, size_t size, bool discard) : _buffer(size)
+{
+    _fd = fd;
+    _discard = discard;
+    setp(_buffer.data(), _buffer.data() + _buffer.size());
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    finish();
+}
+
+void OutputBuffer::drain()
+{
+    char *data = pbase();
+    size_t remaining = pptr() - pbase();
+    while (!_discard && remaining > 0)
+    {
+        ssize_t written = write(_fd, data, remaining);
+        if (written <= 0)
+        {
+            break;
+        }
+        data += written;
+        remaining -= written;
+    }
+    setp(_buffer.data(), _buffer.data() + _buffer.size());
+}
+
+int OutputBuffer::overflow(int c)
+{
+    drain();
+    if (c != traits_type::eof())
+    {
+        *pptr() = c;
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+// Flushes from the stream (std::endl, std::flush) are ignored on purpose
+int OutputBuffer::sync()
+{
+    return 0;
+}
+
+void OutputBuffer::finish()
+{
+    drain();
+}
+
+RowWriter::RowWriter(std::ostream& out) : _out(out)
+{
+    _rows.reserve(ROW_WRITER_BYTES);
+}
+
+RowWriter::~RowWriter()
+{
+    flush();
+}
+
+// Appends one printf-formatted row, writing the rows out once there are enough of them
+void RowWriter::row(const char *format, ...)
+{
+    size_t used = _rows.size();
+    size_t room = 128;
+    while (true)
+    {
+        _rows.resize(used + room);
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(&_rows[used], room, format, args);
+        va_end(args);
+        if (length < 0)
+        {
+            _rows.resize(used);
+            return;
+        }
+        if ((size_t)length < room)
+        {
+            _rows.resize(used + length);
+            break;
+        }
+        room = length + 1;
+    }
+    if (_rows.size() >= ROW_WRITER_BYTES)
+    {
+        flush();
+    }
+}
+
+void RowWriter::flush()
+{
+    _out.write(_rows.data(), _rows.size());
+    _rows.clear();
+}
@@ -1,100 +1,488 @@
 #include "pagetable.h"
 #include <math.h>
+#include <cstring>
 
-PageTable::PageTable(int page_size)
+/*
+    memory_size: bytes of physical memory, one frame per page_size bytes
+    virtual_size: bytes of each process's virtual address space, at most 2^PAGE_KEY_PAGE_BITS
+    pages; sets how many levels the radix trees need
+*/
+PageTable::PageTable(int page_size, uint64_t memory_size, uint64_t virtual_size) : _frames(memory_size / page_size)
 {
     _page_size = page_size;
+    uint64_t last_page = (virtual_size - 1) / page_size;
+    _levels = 2;
+    while (_levels < PT_MAX_LEVELS && (last_page >> (_levels * PT_BITS)) != 0)
+    {
+        _levels++;
+    }
+    _num_entries = 0;
+    _num_dirs = 0;
+    _num_leaves = 0;
+    _num_huge = 0;
+    _sparse_huge = 0;
+    _promote = PromotePolicy::PromoteNever;
+    _demote = DemotePolicy::DemoteSplit;
+    _frame_refs = new std::atomic<uint32_t>[_frames.numFrames()];
+    _shared_mappings = 0;
+    _frame_shared = new uint8_t[_frames.numFrames()];
+    _frame_dirty = new std::atomic<uint8_t>[_frames.numFrames()];
+    clearDirty();
+    _tlb_config = Tlb::defaultConfig();
+    _timing = false;
+    _handed_out = false;
+    setShards(1);
+    _memory = NULL;
+    _physical = NULL;
+    _swap = NULL;
+    _replacer = NULL;
+    _policy = ReplacementPolicy::ReplaceClock;
 }
 
 PageTable::~PageTable()
 {
+    for (size_t i = 0; i < _roots.size(); i++)
+    {
+        if (_roots[i] != NULL)
+        {
+            freeNode(_roots[i], 0);
+        }
+    }
+    delete _replacer;
+    delete _swap;
+    delete[] _frame_refs;
+    delete[] _frame_shared;
+    delete[] _frame_dirty;
+}
+
+void PageTable::freeNode(void *node, int level)
+{
+    if (level == _levels - 1)
+    {
+        delete static_cast<PageTableLeaf*>(node);
+        _num_leaves--;
+        return;
+    }
+    PageTableNode *dir = static_cast<PageTableNode*>(node);
+    for (int i = 0; i < PT_FANOUT; i++)
+    {
+        if (isHugeSlot(dir->children[i]))
+        {
+            delete hugeOf(dir->children[i]);
+            _num_huge--;
+        }
+        else if (dir->children[i] != NULL)
+        {
+            freeNode(dir->children[i], level + 1);
+        }
+    }
+    delete dir;
+    _num_dirs--;
+}
+
+static inline bool hugeMaps(PageTableHuge *huge, int index)
+{
+    return (huge->mapped[index / 64] >> (index % 64)) & 1;
 }
 
-std::vector<std::string> PageTable::sortedKeys()
+// Slot of `page` in a node on `level` of the tree (level 0 is the root)
+inline int PageTable::indexAt(uint64_t page, int level)
 {
-    std::vector<std::string> keys;
+    return (page >> ((_levels - 1 - level) * PT_BITS)) & PT_MASK;
+}
 
-    std::map<std::string, int>::iterator it;
-    for (it = _table.begin(); it != _table.end(); it++)
+// Walk the radix tree of the key's pid, returns NULL if the page is not mapped (no allocation);
+// the entry may be a swapped-out page. A page inside a huge page has no entry of its own:
+// NULL is returned and the huge page stored in *huge, if given
+int32_t* PageTable::lookupEntry(PageKey key, PageTableHuge **huge)
+{
+    uint32_t pid = pageKeyPid(key);
+    uint64_t page = pageKeyPage(key);
+    if (pid >= _roots.size() || _roots[pid] == NULL)
     {
-        keys.push_back(it->first);
+        return NULL;
+    }
+
+    void *node = _roots[pid];
+    for (int level = 0; level < _levels - 1; level++)
+    {
+        node = static_cast<PageTableNode*>(node)->children[indexAt(page, level)];
+        if (node == NULL)
+        {
+            return NULL;
+        }
+    }
+    if (isHugeSlot(node))
+    {
+        if (huge != NULL)
+        {
+            *huge = hugeOf(node);
+        }
+        return NULL;
     }
+    int32_t *slot = &static_cast<PageTableLeaf*>(node)->frames[page & PT_MASK];
+    return (*slot == PT_UNMAPPED) ? NULL : slot;
+}
 
-    std::sort(keys.begin(), keys.end(), PageTableKeyComparator());
+// Same as lookupEntry() but only for pages resident in a frame
+int32_t* PageTable::lookup(PageKey key)
+{
+    int32_t *slot = lookupEntry(key);
+    return (slot == NULL || *slot < 0) ? NULL : slot;
+}
 
-    return keys;
+// Same walk as lookup() but builds missing levels (splitting a huge page in the way), then
+// stores the frame in the leaf
+void PageTable::insert(PageKey key, int32_t frame)
+{
+    uint32_t pid = pageKeyPid(key);
+    uint64_t page = pageKeyPage(key);
+    if (pid >= _roots.size())
+    {
+        reservePids(pid);
+    }
+    if (_roots[pid] == NULL)
+    {
+        _roots[pid] = new PageTableNode();
+        _num_dirs++;
+    }
+
+    void *node = _roots[pid];
+    for (int level = 0; level < _levels - 1; level++)
+    {
+        PageTableNode *dir = static_cast<PageTableNode*>(node);
+        int index = indexAt(page, level);
+        if (dir->children[index] == NULL)
+        {
+            if (level == _levels - 2)
+            {
+                PageTableLeaf *leaf = new PageTableLeaf();
+                std::fill(leaf->frames, leaf->frames + PT_FANOUT, PT_UNMAPPED);
+                dir->children[index] = leaf;
+                _num_leaves++;
+            }
+            else
+            {
+                dir->children[index] = new PageTableNode();
+                _num_dirs++;
+            }
+            dir->used++;
+        }
+        else if (isHugeSlot(dir->children[index]))
+        {
+            splitHuge(dir, pid, page);
+        }
+        node = dir->children[index];
+    }
+    PageTableLeaf *leaf = static_cast<PageTableLeaf*>(node);
+    if (leaf->frames[page & PT_MASK] == PT_UNMAPPED)
+    {
+        leaf->used++;
+        _num_entries++;
+        _pid_entries[pid]++;
+    }
+    leaf->frames[page & PT_MASK] = frame;
 }
 
-void PageTable::addEntry(uint32_t pid, int page_number)
+// Appends (key, entry) for every mapped page under node; with huge given, a huge page is
+// appended there as (first page, huge page) instead of as its pages
+void PageTable::collectEntries(void *node, int level, uint32_t pid, uint64_t page_prefix, std::vector<std::pair<PageKey, int>>& entries,
+                               std::vector<std::pair<PageKey, PageTableHuge*>> *huge)
 {
-    // Combination of pid and page number act as the key to look up frame number
-    std::string entry = std::to_string(pid) + "|" + std::to_string(page_number);
-    int arrToTrackOpenFrames[(67108864 / _page_size)] = {0};
-    if(_table.count(entry) == 0){ //entry is NOT in table yet
-        int frame = 0; 
-        // Find free frame
-        if(!_table.empty()){
-            for(const auto &i : _table){
-                arrToTrackOpenFrames[i.second] = 1; // marking this frame in arr as one that is used in page table
-                if(i.second >= frame){
-                    frame = i.second;
+    if (level == _levels - 1)
+    {
+        PageTableLeaf *leaf = static_cast<PageTableLeaf*>(node);
+        for (int i = 0; i < PT_FANOUT; i++)
+        {
+            if (leaf->frames[i] != PT_UNMAPPED)
+            {
+                entries.push_back(std::make_pair(makePageKey(pid, (page_prefix << PT_BITS) | i), leaf->frames[i]));
+            }
+        }
+        return;
+    }
+    PageTableNode *dir = static_cast<PageTableNode*>(node);
+    for (int i = 0; i < PT_FANOUT; i++)
+    {
+        if (isHugeSlot(dir->children[i]))
+        {
+            // the pages of a huge page the process maps, each on its frame of the run
+            PageTableHuge *page = hugeOf(dir->children[i]);
+            uint64_t first_page = ((page_prefix << PT_BITS) | i) << PT_BITS;
+            if (huge != NULL)
+            {
+                huge->push_back(std::make_pair(makePageKey(pid, first_page), page));
+                continue;
+            }
+            for (int k = 0; k < PT_FANOUT; k++)
+            {
+                if (hugeMaps(page, k))
+                {
+                    entries.push_back(std::make_pair(makePageKey(pid, first_page | k), page->frame + k));
                 }
             }
-            frame++;
         }
+        else if (dir->children[i] != NULL)
+        {
+            collectEntries(dir->children[i], level + 1, pid, (page_prefix << PT_BITS) | i, entries, huge);
+        }
+    }
+}
 
-        for(int i = 0; i < frame; i++){
-            if(arrToTrackOpenFrames[i] == 0){
-                //frame is not in current table entries so it should be used first
-                frame = i;
+// Prints a row for every mapped page in [first_page, last_page] under node, which covers
+// the pages starting at page_prefix << (PT_BITS * (_levels - level))
+void PageTable::printEntries(void *node, int level, uint32_t pid, uint64_t page_prefix, uint64_t first_page, uint64_t last_page,
+                             RowWriter& rows)
+{
+    int shift = PT_BITS * (_levels - 1 - level);      // each slot covers 1 << shift pages
+    uint64_t start = page_prefix << (PT_BITS + shift);
+    uint64_t span = (uint64_t)PT_FANOUT << shift;
+    if (first_page > last_page || (first_page > start && first_page - start >= span))
+    {
+        return;
+    }
+    int first_slot = (first_page <= start) ? 0 : (int)((first_page - start) >> shift);
+    int last_slot = (last_page - start >= span) ? PT_FANOUT - 1 : (int)((last_page - start) >> shift);
+    for (int i = first_slot; i <= last_slot; i++)
+    {
+        uint64_t prefix = (page_prefix << PT_BITS) | i;
+        if (level == _levels - 1)
+        {
+            int32_t frame = static_cast<PageTableLeaf*>(node)->frames[i];
+            if (frame >= 0)
+            {
+                rows.row(" %4u | %11llu | %12d \n", pid, (unsigned long long)prefix, frame);
+            }
+            else if (frame != PT_UNMAPPED)
+            {
+                char slot[24];
+                snprintf(slot, sizeof(slot), "swap %u", swapSlot(frame));
+                rows.row(" %4u | %11llu | %12s \n", pid, (unsigned long long)prefix, slot);
             }
+            continue;
         }
+        void *child = static_cast<PageTableNode*>(node)->children[i];
+        if (isHugeSlot(child))
+        {
+            // the pages of a huge page the process maps, each on its frame of the run
+            PageTableHuge *page = hugeOf(child);
+            uint64_t first = prefix << PT_BITS;
+            int k = (first_page <= first) ? 0 : (int)(first_page - first);
+            int last_k = (last_page - first >= PT_FANOUT) ? PT_FANOUT - 1 : (int)(last_page - first);
+            for (; k <= last_k; k++)
+            {
+                if (hugeMaps(page, k))
+                {
+                    rows.row(" %4u | %11llu | %12d \n", pid, (unsigned long long)(first | k), page->frame + k);
+                }
+            }
+        }
+        else if (child != NULL)
+        {
+            printEntries(child, level + 1, pid, prefix, first_page, last_page, rows);
+        }
+    }
+}
 
-        _table[entry] = frame; 
+void PageTable::collectHuge(void *node, int level, std::vector<PageTableHuge*>& huge)
+{
+    PageTableNode *dir = static_cast<PageTableNode*>(node);
+    for (int i = 0; i < PT_FANOUT; i++)
+    {
+        if (isHugeSlot(dir->children[i]))
+        {
+            huge.push_back(hugeOf(dir->children[i]));
+        }
+        else if (dir->children[i] != NULL && level < _levels - 2)
+        {
+            collectHuge(dir->children[i], level + 1, huge);
+        }
     }
 }
 
-int PageTable::getPhysicalAddress(uint32_t pid, uint32_t virtual_address)
+// Walking the roots by pid and each tree by index already yields (pid, page) order
+std::vector<std::pair<PageKey, int>> PageTable::sortedEntries()
 {
-    // Convert virtual address to page_number and page_offset
-    int page_number = getPageNumber(virtual_address); 
-    int page_offset = virtual_address % _page_size; 
+    std::vector<std::pair<PageKey, int>> entries;
+    entries.reserve(_num_entries);
+    for (uint32_t pid = 0; pid < _roots.size(); pid++)
+    {
+        if (_roots[pid] != NULL)
+        {
+            collectEntries(_roots[pid], 0, pid, 0, entries);
+        }
+    }
+    return entries;
+}
 
+int PageTable::addEntry(uint32_t pid, uint64_t page_number)
+{
     // Combination of pid and page number act as the key to look up frame number
-    std::string entry = std::to_string(pid) + "|" + std::to_string(page_number);
-    
-    // If entry exists, look up frame number and convert virtual to physical address
-    int address = -1;
-    if (_table.count(entry) > 0)
+    _stats[shardOf(pid)].adds++;
+    ScopedLatency timer(_timing ? &_latency[shardOf(pid)].add : NULL);
+    PageKey entry = makePageKey(pid, page_number);
+    PageTableHuge *huge = NULL;
+    int32_t *existing = lookupEntry(entry, &huge);
+    if(existing != NULL){
+        return *existing;
+    }
+    if(huge != NULL){
+        // a page of a huge page kept whole after it was unmapped still has its frame
+        int index = page_number & PT_MASK;
+        if(!hugeMaps(huge, index)){
+            huge->mapped[index / 64] |= 1ULL << (index % 64);
+            _num_entries++;
+            _pid_entries[pid]++;
+            if(++huge->used == PT_FANOUT){
+                _sparse_huge--;
+            }
+        }
+        return huge->frame + index;
+    }
+
+    // entry is NOT in table yet, take the lowest free frame (or evict a page for it)
+    int32_t frame = obtainFrame(entry);
+    if(frame >= 0){
+        _frame_refs[frame] = 1;
+        _frame_shared[frame] = 0;
+        insert(entry, frame);
+        if(_replacer != NULL){
+            _frame_owner[frame] = entry;
+            _replacer->insert(frame, entry);
+        }
+    }else {
+        _stats[shardOf(pid)].failed_adds++;
+    }
+    return frame;
+}
+
+int64_t PageTable::getPhysicalAddress(uint32_t pid, uint64_t virtual_address)
+{
+    uint32_t shard = shardOf(pid);
+    _stats[shard].translations++;
+    ScopedLatency timer(_timing ? &_latency[shard].translate : NULL);
+
+    // Convert virtual address to page_number and page_offset
+    uint64_t page_number = getPageNumber(virtual_address);
+    int page_offset = virtual_address % _page_size;
+
+    // Try the TLB first, on a miss walk the table and fill the TLB
+    int32_t frame;
+    if (!_tlbs[shard].lookup(pid, page_number, &frame))
     {
-        address = _table[entry] * page_number + page_offset; 
+        PageKey key = makePageKey(pid, page_number);
+        PageTableHuge *huge = NULL;
+        int32_t *entry = lookupEntry(key, &huge);
+        if (huge != NULL)
+        {
+            frame = huge->frame + (page_number & PT_MASK);
+            _tlbs[shard].insertHuge(pid, page_number, huge->frame);
+        }
+        else
+        {
+            if (entry == NULL)
+            {
+                return -1;
+            }
+            frame = (*entry < 0) ? faultIn(key, entry) : *entry;
+            if (frame < 0)
+            {
+                return -1;
+            }
+            _tlbs[shard].insert(pid, page_number, frame);
+        }
+    }
+    if (_replacer != NULL)
+    {
+        _replacer->touch(frame);
     }
 
-    return address;
+    return (int64_t)frame * _page_size + page_offset;
 }
 
-void PageTable::print()
+// Same as getPhysicalAddress() for an address about to be written: a page whose frame is
+// shared with another process after a fork first gets a copy of the frame of its own
+// (frames of a shared memory segment are written in place, every process sees the write)
+int64_t PageTable::getWritableAddress(uint32_t pid, uint64_t virtual_address)
 {
-    int i;
+    int64_t address = getPhysicalAddress(pid, virtual_address);
+    if (address < 0)
+    {
+        return address;
+    }
+    int32_t frame = address / _page_size;
+    if (_frame_refs[frame] > 1 && !_frame_shared[frame])
+    {
+        frame = copyOnWrite(pid, getPageNumber(virtual_address), frame);
+        if (frame < 0)
+        {
+            return -1;
+        }
+    }
+    markDirty(frame);
+    return (int64_t)frame * _page_size + virtual_address % _page_size;
+}
 
+/*
+    shared_frame: the frame the page of pid maps, which other entries map too
+    copies it to a free frame and points the page (and the TLB) there; -1 if no frame is free
+*/
+int32_t PageTable::copyOnWrite(uint32_t pid, uint64_t page_number, int32_t shared_frame)
+{
+    PageKey key = makePageKey(pid, page_number);
+    PageTableHuge *huge = NULL;
+    if (lookupEntry(key, &huge) == NULL && huge != NULL)
+    {
+        // only the page written to is copied, the rest of the huge page becomes base pages
+        splitHuge(hugeParent(pid, page_number, false), pid, page_number);
+    }
+    int32_t frame = obtainFrame(key);
+    if (frame < 0)
+    {
+        _stats[shardOf(pid)].failed_adds++;
+        return -1;
+    }
+    memcpy((uint8_t*)_memory + frame * (size_t)_page_size, (uint8_t*)_memory + shared_frame * (size_t)_page_size, _page_size);
+    _frame_refs[frame] = 1;
+    _frame_shared[frame] = 0;
+    *lookup(key) = frame;
+    _tlbs[shardOf(pid)].insert(pid, page_number, frame);
+    _stats[shardOf(pid)].cow_faults++;
+
+    // the other sharers may have let go of the frame meanwhile, the last one frees it
+    unrefFrame(pid, shared_frame);
+    return frame;
+}
+
+// Walking the roots by pid and each tree by index prints in (pid, page) order as it goes
+void PageTable::print()
+{
     std::cout << " PID  | Page Number | Frame Number" << std::endl;
     std::cout << "------+-------------+--------------" << std::endl;
+    RowWriter rows(std::cout);
+    for (uint32_t pid = 0; pid < _roots.size(); pid++)
+    {
+        if (_roots[pid] != NULL)
+        {
+            printEntries(_roots[pid], 0, pid, 0, 0, UINT64_MAX, rows);
+        }
+    }
+}
 
-    std::vector<std::string> keys = sortedKeys();
-
-    for (i = 0; i < keys.size(); i++)
+// Only the pages of one process in [first_page, last_page]: the walk skips every subtree
+// outside the range, so it costs what it prints rather than the size of the table
+void PageTable::print(uint32_t pid, uint64_t first_page, uint64_t last_page)
+{
+    std::cout << " PID  | Page Number | Frame Number" << std::endl;
+    std::cout << "------+-------------+--------------" << std::endl;
+    RowWriter rows(std::cout);
+    if (pid < _roots.size() && _roots[pid] != NULL)
     {
-        std::string toSplit = "|";
-        std::string tempString = keys.at(i);
-        size_t position = tempString.find(toSplit);
-        std::string pid = tempString.substr(0,position);
-        tempString.erase(0, (position + toSplit.length()));
-        int frameNum = _table[keys.at(i)];
-        printf(" %4s | %11s | %12d \n", pid.c_str(), tempString.c_str(), frameNum);     
+        printEntries(_roots[pid], 0, pid, 0, first_page, last_page, rows);
     }
 }
 
-int PageTable::getPageNumber(uint32_t virtual_address){ 
+uint64_t PageTable::getPageNumber(uint64_t virtual_address){
     return virtual_address / _page_size;
 }
 
@@ -102,7 +490,1085 @@ int PageTable::getPageSize(){
     return _page_size;
 }
 
-void PageTable::removeEntry(uint32_t pid, int page_number){
-    std::string entry = std::to_string(pid) + "|" + std::to_string(page_number);
-    _table.erase(entry);
+int PageTable::numLevels(){
+    return _levels;
+}
+
+uint32_t PageTable::numNodes(){
+    return _num_dirs + _num_leaves;
+}
+
+// Memory held by the radix trees of all processes
+uint64_t PageTable::nodeBytes(){
+    return (uint64_t)_num_dirs * sizeof(PageTableNode) + (uint64_t)_num_leaves * sizeof(PageTableLeaf) +
+           (uint64_t)_num_huge * sizeof(PageTableHuge);
+}
+
+void PageTable::removeEntry(uint32_t pid, uint64_t page_number){
+    _stats[shardOf(pid)].removes++;
+    ScopedLatency timer(_timing ? &_latency[shardOf(pid)].remove : NULL);
+    uint64_t page = page_number;
+    if (pid >= _roots.size() || _roots[pid] == NULL)
+    {
+        return;
+    }
+
+    // remember the path so levels that become empty can be released
+    PageTableNode *path[PT_MAX_LEVELS - 1];
+    int indices[PT_MAX_LEVELS - 1];
+    void *node = _roots[pid];
+    for (int level = 0; level < _levels - 1; level++)
+    {
+        path[level] = static_cast<PageTableNode*>(node);
+        indices[level] = indexAt(page, level);
+        node = path[level]->children[indices[level]];
+        if (node == NULL)
+        {
+            return;
+        }
+    }
+
+    if (isHugeSlot(node) && _demote == DemotePolicy::DemoteSplit)
+    {
+        node = splitHuge(path[_levels - 2], pid, page);
+    }
+    if (isHugeSlot(node))
+    {
+        // kept whole: the page stays translatable until the last page of the huge page goes
+        PageTableHuge *huge = hugeOf(node);
+        int index = page & PT_MASK;
+        if (!hugeMaps(huge, index))
+        {
+            return;
+        }
+        huge->mapped[index / 64] &= ~(1ULL << (index % 64));
+        if (huge->used-- == PT_FANOUT)
+        {
+            _sparse_huge++;
+        }
+        _num_entries--;
+        _pid_entries[pid]--;
+        if (huge->used > 0)
+        {
+            return;
+        }
+        _tlbs[shardOf(pid)].invalidate(pid, page);
+        dropHuge(huge, pid);
+    }
+    else
+    {
+        PageTableLeaf *leaf = static_cast<PageTableLeaf*>(node);
+        int32_t entry = leaf->frames[page & PT_MASK];
+        if (entry == PT_UNMAPPED)
+        {
+            return;
+        }
+        if (entry >= 0)
+        {
+            _tlbs[shardOf(pid)].invalidate(pid, page);
+            unrefFrame(pid, entry);
+        }
+        else
+        {
+            _swap->release(swapSlot(entry));
+        }
+        leaf->frames[page & PT_MASK] = PT_UNMAPPED;
+        _num_entries--;
+        _pid_entries[pid]--;
+
+        if (--leaf->used > 0)
+        {
+            return;
+        }
+        delete leaf;
+        _num_leaves--;
+    }
+    for (int level = _levels - 2; level >= 0; level--)
+    {
+        path[level]->children[indices[level]] = NULL;
+        if (--path[level]->used > 0)
+        {
+            return;
+        }
+        if (level > 0)
+        {
+            delete path[level];
+            _num_dirs--;
+        }
+    }
+    delete _roots[pid];
+    _roots[pid] = NULL;
+    _num_dirs--;
+}
+
+uint32_t PageTable::numEntries(){
+    return _num_entries;
+}
+
+uint32_t PageTable::numEntries(uint32_t pid){
+    return (pid < _pid_entries.size()) ? _pid_entries[pid] : 0;
+}
+
+uint32_t PageTable::numFreeFrames(){
+    return _frames.numFree();
+}
+
+uint32_t PageTable::numFrames(){
+    return _frames.numFrames();
+}
+
+void PageTable::configureTlb(TlbConfig config){
+    // the TLBs hold huge-page entries whenever there can be huge pages
+    config.huge_shift = (_promote != PromotePolicy::PromoteNever) ? PT_BITS : 0;
+    _tlb_config = config;
+    _tlbs.assign(_num_shards, Tlb(config));
+}
+
+void PageTable::flushTlb(uint32_t pid){
+    _tlbs[shardOf(pid)].flush(pid);
+}
+
+void PageTable::printTlb(){
+    for(uint32_t i = 0; i < _num_shards; i++){
+        if(_num_shards > 1){
+            std::cout << "shard " << i << " ";
+        }
+        _tlbs[i].print();
+    }
+}
+
+PageTableStats PageTable::getStats(){
+    PageTableStats stats = _stats[0];
+    for(uint32_t i = 1; i < _num_shards; i++){
+        stats.adds += _stats[i].adds;
+        stats.failed_adds += _stats[i].failed_adds;
+        stats.translations += _stats[i].translations;
+        stats.removes += _stats[i].removes;
+        stats.faults += _stats[i].faults;
+        stats.page_outs += _stats[i].page_outs;
+        stats.shared_pages += _stats[i].shared_pages;
+        stats.cow_faults += _stats[i].cow_faults;
+        stats.huge_promotions += _stats[i].huge_promotions;
+        stats.huge_collapses += _stats[i].huge_collapses;
+        stats.huge_splits += _stats[i].huge_splits;
+    }
+    return stats;
+}
+
+// Time addEntry, getPhysicalAddress and removeEntry from now on (print stats with --latency)
+void PageTable::enableTiming(bool timing){
+    _timing = timing;
+}
+
+PageTableLatency PageTable::getLatency(){
+    PageTableLatency latency = _latency[0];
+    for(uint32_t i = 1; i < _num_shards; i++){
+        latency.add.merge(_latency[i].add);
+        latency.translate.merge(_latency[i].translate);
+        latency.remove.merge(_latency[i].remove);
+    }
+    return latency;
+}
+
+/*
+    num_shards: number of threads that may use the page table at once
+    each shard (pid % num_shards) gets its own TLB, as a core would, its own counters and
+    latencies and a cache of free frames. Must be called before any page is mapped
+*/
+void PageTable::setShards(uint32_t num_shards){
+    _num_shards = num_shards;
+    _tlbs.assign(num_shards, Tlb(_tlb_config));
+    PageTableStats zero;
+    memset(&zero, 0, sizeof(zero));
+    _stats.assign(num_shards, zero);
+    _latency.assign(num_shards, PageTableLatency());
+    _frame_caches.assign(num_shards, std::vector<int32_t>());
+}
+
+uint32_t PageTable::shardOf(uint32_t pid){
+    return pid % _num_shards;
+}
+
+// Make room for the trees of every pid up to last_pid, so mapping pages of new processes
+// never resizes _roots while other shards read it
+void PageTable::reservePids(uint32_t last_pid){
+    if(last_pid >= _roots.size()){
+        _roots.resize(last_pid + 1, NULL);
+        _pid_entries.resize(last_pid + 1, 0);
+        _pid_shares.resize(last_pid + 1, 0);
+    }
+}
+
+/*
+    counts: frames for each shard, at most as many as are free in all
+    fills the shards' caches with the lowest free frames, shard 0 first, before the shards
+    run at once. Until drainFrameCaches they take frames only from there and keep the ones
+    they free, so which frames a shard maps depends on its own commands alone, not on how
+    the threads interleave (only while no other shard is running)
+*/
+void PageTable::handOutFrames(const std::vector<uint64_t>& counts){
+    drainFrameCaches();
+    for(uint32_t i = 0; i < _num_shards; i++){
+        std::vector<int32_t>& cache = _frame_caches[i];
+        for(uint64_t j = 0; j < counts[i]; j++){
+            int32_t frame = _frames.allocate();
+            if(frame < 0){
+                break;
+            }
+            cache.push_back(frame);
+        }
+        std::reverse(cache.begin(), cache.end());
+    }
+    _handed_out = true;
+}
+
+// Give every cached frame back to the allocator (only while no other shard is running)
+void PageTable::drainFrameCaches(){
+    for(uint32_t i = 0; i < _num_shards; i++){
+        for(size_t j = 0; j < _frame_caches[i].size(); j++){
+            _frames.release(_frame_caches[i][j]);
+        }
+        _frame_caches[i].clear();
+    }
+    _handed_out = false;
+}
+
+// Memory the page table's frames live in; their host pages are released as frames are freed
+void PageTable::setPhysicalMemory(PhysicalMemory *physical){
+    _physical = physical;
+    _memory = physical->base();
+}
+
+PhysicalMemory* PageTable::physicalMemory(){
+    return _physical;
+}
+
+void PageTable::releaseFrame(uint32_t pid, int32_t frame){
+    markDirty(frame);
+    if(_physical != NULL){
+        _physical->discard(frame * (uint64_t)_page_size, _page_size);
+    }
+    if(_num_shards == 1){
+        _frames.release(frame);
+        return;
+    }
+    std::vector<int32_t>& cache = _frame_caches[shardOf(pid)];
+    cache.push_back(frame);
+    if(cache.size() > 2 * FRAME_BATCH && !_handed_out){
+        std::lock_guard<std::mutex> guard(_frames_lock);
+        for(int i = 0; i < FRAME_BATCH; i++){
+            _frames.release(cache.back());
+            cache.pop_back();
+        }
+    }
+}
+
+// Drop one entry's reference to a resident frame, freeing it with the last one (frames of a
+// shared memory segment stay with the segment)
+void PageTable::unrefFrame(uint32_t pid, int32_t frame){
+    if(_frame_refs[frame]-- > 1){
+        // still mapped by a process this one was forked from (or into), or by
+        // another process attached to the same shared memory segment
+        _shared_mappings--;
+    }
+    else if(!_frame_shared[frame]){
+        releaseFrame(pid, frame);
+        if(_replacer != NULL){
+            _replacer->remove(frame);
+        }
+    }
+}
+
+// Frames compaction moves together: a single frame, or the aligned run of a huge page
+typedef struct FrameRun {
+    int32_t first;
+    int32_t count;
+    PageKey owner;              // first page mapping a single frame
+} FrameRun;
+
+static bool runBefore(const FrameRun& a, const FrameRun& b)
+{
+    if (a.first != b.first)
+    {
+        return a.first < b.first;
+    }
+    if (a.count != b.count)
+    {
+        return a.count > b.count;
+    }
+    return a.owner < b.owner;
+}
+
+/*
+    memory: the physical memory the frames index into
+    renumbers the mapped frames from 0 keeping their relative order, moving each run of
+    consecutive frames with one memmove, so all free frames end up above the last mapped one
+    (the frames of a huge page move as one run to the next multiple of PT_FANOUT, so there
+    may be free frames below it)
+    returns the number of frames that moved
+*/
+uint32_t PageTable::compactFrames(void *memory, uint64_t *bytes_moved){
+    std::vector<std::pair<PageKey, int>> entries = sortedEntries();
+    std::vector<FrameRun> all;
+    all.reserve(entries.size());
+    for(size_t i = 0; i < entries.size(); i++){
+        if(entries[i].second >= 0){
+            FrameRun run = {entries[i].second, 1, entries[i].first};
+            all.push_back(run);
+        }
+    }
+    // frames of shared memory segments are held even while no process maps them, and a
+    // huge page holds its whole run whichever of its pages are mapped
+    for(size_t s = 0; s < _segments.size(); s++){
+        for(size_t k = 0; k < _segments[s].size(); k++){
+            FrameRun run = {_segments[s][k], 1, 0};
+            all.push_back(run);
+        }
+    }
+    std::vector<PageTableHuge*> huge;
+    for(uint32_t pid = 0; pid < _roots.size(); pid++){
+        if(_roots[pid] != NULL){
+            collectHuge(_roots[pid], 0, huge);
+        }
+    }
+    for(size_t h = 0; h < huge.size(); h++){
+        FrameRun run = {huge[h]->frame, PT_FANOUT, 0};
+        all.push_back(run);
+    }
+    std::sort(all.begin(), all.end(), runBefore);
+
+    // a shared frame (or huge page) shows up once for every entry mapping it, it is moved
+    // once; the frames of a huge page are moved with it
+    std::vector<FrameRun> runs;
+    std::vector<int32_t> firsts;
+    runs.reserve(all.size());
+    firsts.reserve(all.size());
+    for(size_t k = 0; k < all.size(); k++){
+        if(runs.empty() || all[k].first >= runs.back().first + runs.back().count){
+            runs.push_back(all[k]);
+            firsts.push_back(all[k].first);
+        }
+    }
+    std::vector<int32_t> targets(runs.size());
+    int32_t cursor = 0;
+    for(size_t k = 0; k < runs.size(); k++){
+        if(runs[k].count > 1){
+            cursor = (cursor + runs[k].count - 1) / runs[k].count * runs[k].count;
+        }
+        targets[k] = cursor;
+        cursor += runs[k].count;
+    }
+
+    // each run lands at or below where it was, so copying downwards in frame order never
+    // overwrites a frame (or reference count) that has yet to move
+    uint32_t moved = 0;
+    *bytes_moved = 0;
+    size_t i = 0;
+    while(i < runs.size()){
+        size_t j = i + 1;
+        while(j < runs.size() && runs[j].first == runs[j - 1].first + runs[j - 1].count &&
+              targets[j] == targets[j - 1] + runs[j - 1].count){
+            j++;
+        }
+        if(runs[i].first != targets[i]){
+            int32_t count = runs[j - 1].first + runs[j - 1].count - runs[i].first;
+            size_t bytes = count * (size_t)_page_size;
+            memmove((uint8_t*)memory + targets[i] * (size_t)_page_size, (uint8_t*)memory + runs[i].first * (size_t)_page_size, bytes);
+            markDirty(targets[i], count);
+            for(int32_t k = 0; k < count; k++){
+                _frame_refs[targets[i] + k] = _frame_refs[runs[i].first + k].load();
+                _frame_shared[targets[i] + k] = _frame_shared[runs[i].first + k];
+            }
+            moved += count;
+            *bytes_moved += bytes;
+        }
+        i = j;
+    }
+    for(size_t k = 0; k < entries.size(); k++){
+        int32_t *entry = (entries[k].second >= 0) ? lookup(entries[k].first) : NULL;
+        if(entry != NULL){
+            size_t r = std::upper_bound(firsts.begin(), firsts.end(), *entry) - firsts.begin() - 1;
+            *entry = targets[r] + (*entry - firsts[r]);
+        }
+    }
+    for(size_t s = 0; s < _segments.size(); s++){
+        for(size_t k = 0; k < _segments[s].size(); k++){
+            size_t r = std::upper_bound(firsts.begin(), firsts.end(), _segments[s][k]) - firsts.begin() - 1;
+            _segments[s][k] = targets[r] + (_segments[s][k] - firsts[r]);
+        }
+    }
+    for(size_t h = 0; h < huge.size(); h++){
+        size_t r = std::upper_bound(firsts.begin(), firsts.end(), huge[h]->frame) - firsts.begin() - 1;
+        huge[h]->frame = targets[r];
+    }
+
+    // every frame above the packed ones is free again, including any a shard had cached,
+    // and so are the gaps left below huge pages
+    _frames.reset(cursor);
+    int32_t packed = 0;
+    for(size_t k = 0; k <= runs.size(); k++){
+        int32_t next = (k < runs.size()) ? targets[k] : cursor;
+        for(int32_t frame = packed; frame < next; frame++){
+            _frames.release(frame);
+        }
+        if(next > packed){
+            markDirty(packed, next - packed);
+            if(_physical != NULL){
+                _physical->discard(packed * (uint64_t)_page_size, (next - packed) * (uint64_t)_page_size);
+            }
+        }
+        if(k < runs.size()){
+            packed = targets[k] + runs[k].count;
+        }
+    }
+    if(!runs.empty() && runs.back().first + runs.back().count > cursor){
+        int32_t old_end = runs.back().first + runs.back().count;
+        markDirty(cursor, old_end - cursor);
+        if(_physical != NULL){
+            _physical->discard(cursor * (uint64_t)_page_size, (old_end - cursor) * (uint64_t)_page_size);
+        }
+    }
+    for(uint32_t k = 0; k < _num_shards; k++){
+        _tlbs[k].flushAll();
+        _frame_caches[k].clear();
+    }
+
+    // the replacer tracks frames by number, so it starts over with the packed frames
+    // (in their old frame order; recency and ARC history are not carried across)
+    if(_replacer != NULL){
+        delete _replacer;
+        _replacer = createReplacer(_policy, _frames.numFrames());
+        for(size_t k = 0; k < runs.size(); k++){
+            _frame_owner[targets[k]] = runs[k].owner;
+            _replacer->insert(targets[k], runs[k].owner);
+        }
+    }
+    return moved;
+}
+
+/*
+    path: scratch file for evicted pages, num_slots: how many pages it may hold
+    once enabled, a page that needs a frame when none is free evicts a resident page
+    chosen by policy, and translating a swapped-out page faults it back in
+    returns false if the swap file cannot be created
+*/
+bool PageTable::enableSwap(std::string path, uint32_t num_slots, ReplacementPolicy policy, void *memory){
+    SwapFile *swap = new SwapFile(path, _page_size, num_slots);
+    if(!swap->isOpen()){
+        delete swap;
+        return false;
+    }
+    delete _swap;
+    delete _replacer;
+    _swap = swap;
+    _memory = memory;
+    _policy = policy;
+    _replacer = createReplacer(policy, _frames.numFrames());
+    _frame_owner.assign(_frames.numFrames(), 0);
+    // pages mapped before paging was enabled become candidates for eviction too
+    std::vector<std::pair<PageKey, int>> entries = sortedEntries();
+    for(size_t i = 0; i < entries.size(); i++){
+        _frame_owner[entries[i].second] = entries[i].first;
+        _replacer->insert(entries[i].second, entries[i].first);
+    }
+    return true;
+}
+
+// Free frame for the page `key`, evicting a resident page (or splitting a huge page kept
+// whole) if none is left; -1 if every frame is in use and nothing can be given up
+int32_t PageTable::obtainFrame(PageKey key){
+    int32_t frame = takeFrame(key);
+    while(frame < 0 && _sparse_huge > 0 && reclaimHuge(pageKeyPid(key))){
+        frame = takeFrame(key);
+    }
+    return frame;
+}
+
+int32_t PageTable::takeFrame(PageKey key){
+    if(_num_shards > 1){
+        // take frames from the shard's cache, refilling it a batch at a time (a shard
+        // handed too few frames still gets one, though no longer in the same order every run)
+        std::vector<int32_t>& cache = _frame_caches[shardOf(pageKeyPid(key))];
+        if(cache.empty()){
+            std::lock_guard<std::mutex> guard(_frames_lock);
+            for(int i = 0; i < FRAME_BATCH; i++){
+                int32_t frame = _frames.allocate();
+                if(frame < 0){
+                    break;
+                }
+                cache.push_back(frame);
+            }
+            std::reverse(cache.begin(), cache.end());
+        }
+        if(cache.empty()){
+            return -1;
+        }
+        int32_t frame = cache.back();
+        cache.pop_back();
+        return frame;
+    }
+
+    int32_t frame = _frames.allocate();
+    if(frame >= 0 || _swap == NULL || _swap->numUsed() == _swap->numSlots()){
+        return frame;
+    }
+    frame = _replacer->victim(key);
+    if(frame >= 0){
+        pageOut(frame);
+    }
+    return frame;
+}
+
+// Write the page in `frame` to a swap slot and point its entry at the slot, the frame stays
+// allocated for the caller
+void PageTable::pageOut(int32_t frame){
+    PageKey key = _frame_owner[frame];
+    int32_t slot = _swap->allocate();
+    if(!_swap->write(slot, (uint8_t*)_memory + frame * (size_t)_page_size)){
+        fprintf(stderr, "Error: writing to swap failed\n");
+    }
+    *lookupEntry(key) = swapEntry(slot);
+    _tlbs[shardOf(pageKeyPid(key))].invalidate(pageKeyPid(key), pageKeyPage(key));
+    _stats[shardOf(pageKeyPid(key))].page_outs++;
+}
+
+// Bring the swapped-out page `key` (whose entry is `entry`) back into a frame
+int32_t PageTable::faultIn(PageKey key, int32_t *entry){
+    int32_t frame = obtainFrame(key);
+    if(frame < 0){
+        return -1;
+    }
+    uint32_t slot = swapSlot(*entry);
+    if(!_swap->read(slot, (uint8_t*)_memory + frame * (size_t)_page_size)){
+        fprintf(stderr, "Error: reading from swap failed\n");
+    }
+    _swap->release(slot);
+    markDirty(frame);
+    *entry = frame;
+    _frame_refs[frame] = 1;
+    _frame_shared[frame] = 0;
+    _frame_owner[frame] = key;
+    _replacer->insert(frame, key);
+    _stats[shardOf(pageKeyPid(key))].faults++;
+    return frame;
+}
+
+void PageTable::printPaging(){
+    if(_swap == NULL){
+        return;
+    }
+    char line[160];
+    PageTableStats stats = getStats();
+    snprintf(line, sizeof(line), "  paging     %s, %llu faults, %llu page-outs, swap %u / %u pages\n",
+             replacementPolicyName(_policy), (unsigned long long)stats.faults, (unsigned long long)stats.page_outs,
+             _swap->numUsed(), _swap->numSlots());
+    std::cout << line;
+}
+
+// Frames can only be shared (by fork or shared memory) while every page stays resident in memory
+bool PageTable::canShareFrames(){
+    return _swap == NULL && _memory != NULL;
+}
+
+/*
+    parent_pid: process being forked, pid: its new child (with no pages yet)
+    gives the child a copy of the parent's tree, so every page of the child maps the
+    parent's frame read-only until one of them writes to it; no page data is copied
+*/
+void PageTable::forkEntries(uint32_t parent_pid, uint32_t pid){
+    reservePids(std::max(parent_pid, pid));
+    if(_roots[parent_pid] == NULL){
+        return;
+    }
+    _roots[pid] = static_cast<PageTableNode*>(cloneNode(_roots[parent_pid], 0));
+    _pid_shares[parent_pid] = 1;
+    _pid_shares[pid] = 1;
+    _pid_entries[pid] = _pid_entries[parent_pid];
+    _num_entries += _pid_entries[pid];
+    _stats[shardOf(pid)].shared_pages += _pid_entries[pid];
+}
+
+void* PageTable::cloneNode(void *node, int level){
+    if(level == _levels - 1){
+        PageTableLeaf *leaf = new PageTableLeaf(*static_cast<PageTableLeaf*>(node));
+        _num_leaves++;
+        for(int i = 0; i < PT_FANOUT; i++){
+            if(leaf->frames[i] >= 0){
+                _frame_refs[leaf->frames[i]]++;
+                _shared_mappings++;
+            }
+        }
+        return leaf;
+    }
+    PageTableNode *dir = static_cast<PageTableNode*>(node);
+    PageTableNode *copy = new PageTableNode();
+    _num_dirs++;
+    copy->used = dir->used;
+    for(int i = 0; i < PT_FANOUT; i++){
+        if(isHugeSlot(dir->children[i])){
+            PageTableHuge *huge = new PageTableHuge(*hugeOf(dir->children[i]));
+            _num_huge++;
+            if(huge->used < PT_FANOUT){
+                _sparse_huge++;
+            }
+            for(int k = 0; k < PT_FANOUT; k++){
+                _frame_refs[huge->frame + k]++;
+                _shared_mappings++;
+            }
+            copy->children[i] = hugeSlot(huge);
+        }
+        else if(dir->children[i] != NULL){
+            copy->children[i] = cloneNode(dir->children[i], level + 1);
+        }
+    }
+    return copy;
+}
+
+/*
+    num_pages: size of a new shared memory segment
+    takes a frame for each page, held by the segment (mapped or not) until releaseSegment;
+    returns the segment's id, or -1 (and no frames taken) if there are not enough free frames
+*/
+int32_t PageTable::createSegment(uint64_t num_pages){
+    std::vector<int32_t> frames;
+    for(uint64_t i = 0; i < num_pages; i++){
+        int32_t frame = obtainFrame(makePageKey(0, i));
+        if(frame < 0){
+            for(size_t k = 0; k < frames.size(); k++){
+                releaseFrame(0, frames[k]);
+            }
+            return -1;
+        }
+        _frame_refs[frame] = 0;
+        _frame_shared[frame] = 1;
+        frames.push_back(frame);
+    }
+    _segments.push_back(frames);
+    return _segments.size() - 1;
+}
+
+/*
+    segment: id from createSegment, first_page: where in pid's virtual space it goes
+    maps the segment's pages there (replacing whatever those pages mapped), each onto the
+    segment's own frame, so every process attached to it reads and writes the same memory
+*/
+void PageTable::mapSegment(uint32_t segment, uint32_t pid, uint64_t first_page){
+    const std::vector<int32_t>& frames = _segments[segment];
+    for(size_t i = 0; i < frames.size(); i++){
+        PageKey key = makePageKey(pid, first_page + i);
+        if(lookupEntry(key) != NULL){
+            removeEntry(pid, first_page + i);
+        }
+        insert(key, frames[i]);
+        if(_frame_refs[frames[i]]++ > 0){
+            _shared_mappings++;
+        }
+    }
+    _pid_shares[pid] = 1;
+}
+
+// Free the frames of a segment no process maps any more (pid: the one that unmapped it last)
+void PageTable::releaseSegment(uint32_t segment, uint32_t pid){
+    for(size_t i = 0; i < _segments[segment].size(); i++){
+        releaseFrame(pid, _segments[segment][i]);
+    }
+    std::vector<int32_t>().swap(_segments[segment]);
+}
+
+// Entries that map a frame another entry maps too: frames a fork-heavy run did not need
+uint32_t PageTable::sharedMappings(){
+    return _shared_mappings;
+}
+
+// Whether pid forked, was forked or attached a shared memory segment since it was created
+// (or restored mapping a shared frame): writing or freeing its pages may touch frames
+// another process maps too
+bool PageTable::sharesFrames(uint32_t pid){
+    return pid < _pid_shares.size() && _pid_shares[pid];
+}
+
+void PageTable::printSharing(){
+    PageTableStats stats = getStats();
+    if(stats.shared_pages == 0){
+        return;
+    }
+    char line[160];
+    snprintf(line, sizeof(line), "  sharing    %llu pages shared by fork, %llu copy-on-write faults, %u frames saved now\n",
+             (unsigned long long)stats.shared_pages, (unsigned long long)stats.cow_faults, sharedMappings());
+    std::cout << line;
+}
+
+// Aligned run of PT_FANOUT free frames for a huge page, -1 if there is none; also -1 while
+// frames are handed out, which shard got to the allocator first would decide the run
+int32_t PageTable::takeFrameRun(){
+    if(_handed_out){
+        return -1;
+    }
+    std::lock_guard<std::mutex> guard(_frames_lock);
+    return _frames.allocateRun(PT_FANOUT);
+}
+
+// The node on the last upper level whose slot holds the leaf (or huge page) of `page`; with
+// create, missing nodes on the way are built, else NULL if one is missing
+PageTableNode* PageTable::hugeParent(uint32_t pid, uint64_t page, bool create){
+    if(pid >= _roots.size() || _roots[pid] == NULL){
+        if(!create){
+            return NULL;
+        }
+        reservePids(pid);
+        _roots[pid] = new PageTableNode();
+        _num_dirs++;
+    }
+    PageTableNode *dir = _roots[pid];
+    for(int level = 0; level < _levels - 2; level++){
+        int index = indexAt(page, level);
+        if(dir->children[index] == NULL){
+            if(!create){
+                return NULL;
+            }
+            dir->children[index] = new PageTableNode();
+            _num_dirs++;
+            dir->used++;
+        }
+        dir = static_cast<PageTableNode*>(dir->children[index]);
+    }
+    return dir;
+}
+
+/*
+    page: first of PT_FANOUT pages (a multiple of PT_FANOUT) none of which is mapped yet
+    maps all of them with one huge page; false if no aligned run of free frames is left
+*/
+bool PageTable::mapHuge(uint32_t pid, uint64_t page){
+    int32_t frame = takeFrameRun();
+    if(frame < 0){
+        return false;
+    }
+    PageTableHuge *huge = new PageTableHuge();
+    huge->frame = frame;
+    huge->used = PT_FANOUT;
+    std::fill(huge->mapped, huge->mapped + PT_FANOUT / 64, ~0ULL);
+    for(int i = 0; i < PT_FANOUT; i++){
+        _frame_refs[frame + i] = 1;
+        _frame_shared[frame + i] = 0;
+    }
+    PageTableNode *parent = hugeParent(pid, page, true);
+    parent->children[indexAt(page, _levels - 2)] = hugeSlot(huge);
+    parent->used++;
+    _num_huge++;
+    _num_entries += PT_FANOUT;
+    _pid_entries[pid] += PT_FANOUT;
+    _stats[shardOf(pid)].huge_promotions++;
+    return true;
+}
+
+/*
+    page: first of PT_FANOUT pages (a multiple of PT_FANOUT)
+    replaces their leaf with a huge page once every one of them is mapped to a frame of its
+    own (not shared, not a segment's): in place if the frames already form an aligned run,
+    else by copying the pages into a free one; false if the leaf does not qualify
+*/
+bool PageTable::collapseHuge(uint32_t pid, uint64_t page){
+    PageTableNode *parent = hugeParent(pid, page, false);
+    if(parent == NULL || _memory == NULL){
+        return false;
+    }
+    int index = indexAt(page, _levels - 2);
+    void *child = parent->children[index];
+    if(child == NULL || isHugeSlot(child) || static_cast<PageTableLeaf*>(child)->used < PT_FANOUT){
+        return false;
+    }
+    PageTableLeaf *leaf = static_cast<PageTableLeaf*>(child);
+    bool in_place = (leaf->frames[0] % PT_FANOUT) == 0;
+    for(int i = 0; i < PT_FANOUT; i++){
+        int32_t frame = leaf->frames[i];
+        if(frame < 0 || _frame_refs[frame] != 1 || _frame_shared[frame]){
+            return false;
+        }
+        in_place = in_place && frame == leaf->frames[0] + i;
+    }
+    int32_t frame = in_place ? leaf->frames[0] : takeFrameRun();
+    if(frame < 0){
+        return false;
+    }
+    if(!in_place){
+        for(int i = 0; i < PT_FANOUT; i++){
+            memcpy((uint8_t*)_memory + (frame + i) * (size_t)_page_size, (uint8_t*)_memory + leaf->frames[i] * (size_t)_page_size, _page_size);
+            markDirty(frame + i);
+            _frame_refs[frame + i] = 1;
+            _frame_shared[frame + i] = 0;
+            releaseFrame(pid, leaf->frames[i]);
+        }
+    }
+    for(int i = 0; i < PT_FANOUT; i++){
+        _tlbs[shardOf(pid)].invalidate(pid, page + i);
+    }
+    PageTableHuge *huge = new PageTableHuge();
+    huge->frame = frame;
+    huge->used = PT_FANOUT;
+    std::fill(huge->mapped, huge->mapped + PT_FANOUT / 64, ~0ULL);
+    parent->children[index] = hugeSlot(huge);
+    delete leaf;
+    _num_leaves--;
+    _num_huge++;
+    _stats[shardOf(pid)].huge_collapses++;
+    return true;
+}
+
+/*
+    parent: node holding the huge page of `page` in its slot
+    demotes the huge page to a leaf of base pages: the pages the process maps keep their
+    frames, the frames of the others are given up; returns the leaf
+*/
+PageTableLeaf* PageTable::splitHuge(PageTableNode *parent, uint32_t pid, uint64_t page){
+    int index = indexAt(page, _levels - 2);
+    PageTableHuge *huge = hugeOf(parent->children[index]);
+    PageTableLeaf *leaf = new PageTableLeaf();
+    leaf->used = 0;
+    for(int i = 0; i < PT_FANOUT; i++){
+        if(hugeMaps(huge, i)){
+            leaf->frames[i] = huge->frame + i;
+            leaf->used++;
+        }
+        else{
+            leaf->frames[i] = PT_UNMAPPED;
+            unrefFrame(pid, huge->frame + i);
+        }
+    }
+    if(huge->used < PT_FANOUT){
+        _sparse_huge--;
+    }
+    parent->children[index] = leaf;
+    _num_leaves++;
+    _num_huge--;
+    _tlbs[shardOf(pid)].invalidate(pid, page);
+    _stats[shardOf(pid)].huge_splits++;
+    delete huge;
+    return leaf;
+}
+
+// Give up the frames of a huge page none of whose pages is mapped any more (the caller
+// clears the slot holding it)
+void PageTable::dropHuge(PageTableHuge *huge, uint32_t pid){
+    for(int i = 0; i < PT_FANOUT; i++){
+        unrefFrame(pid, huge->frame + i);
+    }
+    if(huge->used < PT_FANOUT){
+        _sparse_huge--;
+    }
+    _num_huge--;
+    delete huge;
+}
+
+// Split the first huge page under `node` that has pages no longer mapped; false if none has
+bool PageTable::splitSparseHuge(void *node, int level, uint32_t pid, uint64_t page_prefix){
+    PageTableNode *dir = static_cast<PageTableNode*>(node);
+    for(int i = 0; i < PT_FANOUT; i++){
+        void *child = dir->children[i];
+        uint64_t prefix = (page_prefix << PT_BITS) | i;
+        if(isHugeSlot(child)){
+            if(hugeOf(child)->used < PT_FANOUT){
+                splitHuge(dir, pid, prefix << PT_BITS);
+                return true;
+            }
+        }
+        else if(child != NULL && level < _levels - 2 && splitSparseHuge(child, level + 1, pid, prefix)){
+            return true;
+        }
+    }
+    return false;
+}
+
+// Out of frames with the keep policy: split a huge page of pid's shard whose unmapped pages
+// still hold frames, handing those back; false if there is none
+bool PageTable::reclaimHuge(uint32_t pid){
+    for(uint32_t owner = shardOf(pid); owner < _roots.size(); owner += _num_shards){
+        if(_roots[owner] != NULL && splitSparseHuge(_roots[owner], 0, owner, 0)){
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    first_page..last_page: pages of a variable just placed (or moved) in pid's space
+    maps every one of them not mapped yet, as addEntry does; with the eager policy each
+    aligned span of PT_FANOUT pages inside the range that has nothing mapped gets a huge
+    page instead, and with the usage policy each span the range leaves fully mapped is
+    collapsed into one
+    returns false if a page got no frame (out of frames without swap), the pages before it
+    stay mapped
+*/
+bool PageTable::mapRange(uint32_t pid, uint64_t first_page, uint64_t last_page){
+    uint64_t page = first_page;
+    while(page <= last_page){
+        if(_promote == PromotePolicy::PromoteEager && (page & PT_MASK) == 0 && last_page - page >= PT_MASK){
+            PageTableNode *parent = hugeParent(pid, page, false);
+            if((parent == NULL || parent->children[indexAt(page, _levels - 2)] == NULL) && mapHuge(pid, page)){
+                page += PT_FANOUT;
+                continue;
+            }
+        }
+        if(addEntry(pid, page) < 0){
+            return false;
+        }
+        page++;
+    }
+    if(_promote == PromotePolicy::PromoteUsage){
+        for(uint64_t span = first_page & ~(uint64_t)PT_MASK; span <= last_page; span += PT_FANOUT){
+            collapseHuge(pid, span);
+        }
+    }
+    return true;
+}
+
+// When ranges of pages get huge pages and what unmapping part of one does
+void PageTable::setHugePolicy(PromotePolicy promote, DemotePolicy demote){
+    _promote = promote;
+    _demote = demote;
+    configureTlb(_tlb_config);
+}
+
+uint64_t PageTable::hugePageSize(){
+    return (uint64_t)_page_size << PT_BITS;
+}
+
+static const char *PROMOTE_NAMES[] = {"never", "eager", "usage"};
+static const char *DEMOTE_NAMES[] = {"split", "keep"};
+
+void PageTable::printHuge(){
+    if(_promote == PromotePolicy::PromoteNever){
+        return;
+    }
+    PageTableStats stats = getStats();
+    uint64_t reach = 0;
+    uint64_t base_reach = 0;
+    for(uint32_t i = 0; i < _num_shards; i++){
+        reach += _tlbs[i].reachPages() * _page_size;
+        base_reach += _tlbs[i].numValid() * (uint64_t)_page_size;
+    }
+    // each huge page stands in for a leaf of PT_FANOUT entries
+    uint64_t leaf_bytes = _num_huge * (uint64_t)(sizeof(PageTableLeaf) - sizeof(PageTableHuge));
+    char line[200];
+    snprintf(line, sizeof(line), "  huge pages %u mapped (%llu KB, %s/%s), %llu promoted, %llu collapsed, %llu split\n",
+             _num_huge.load(), (unsigned long long)(_num_huge * hugePageSize() >> 10), PROMOTE_NAMES[_promote], DEMOTE_NAMES[_demote],
+             (unsigned long long)stats.huge_promotions, (unsigned long long)stats.huge_collapses, (unsigned long long)stats.huge_splits);
+    std::cout << line;
+    snprintf(line, sizeof(line), "  huge saves %u leaves (%llu KB of page table), TLB reach %llu KB (%llu KB with base pages only)\n",
+             _num_huge.load(), (unsigned long long)(leaf_bytes >> 10), (unsigned long long)(reach >> 10), (unsigned long long)(base_reach >> 10));
+    std::cout << line;
+}
+
+bool PageTable::swapEnabled(){
+    return _swap != NULL;
+}
+
+bool PageTable::hugePagesEnabled(){
+    return _promote != PromotePolicy::PromoteNever;
+}
+
+// Every mapping in (pid, page) order, base pages in entries and huge pages in huge
+void PageTable::collectMappings(std::vector<std::pair<PageKey, int>>& entries, std::vector<std::pair<PageKey, PageTableHuge*>>& huge){
+    entries.reserve(_num_entries);
+    for(uint32_t pid = 0; pid < _roots.size(); pid++){
+        if(_roots[pid] != NULL){
+            collectEntries(_roots[pid], 0, pid, 0, entries, &huge);
+        }
+    }
+}
+
+// Reference count and flags of a frame (used: taken from the allocator, by a shard's cache too)
+void PageTable::frameState(int32_t frame, uint32_t *refs, bool *used, bool *shared){
+    *refs = _frame_refs[frame];
+    *used = !_frames.isFree(frame);
+    *shared = _frame_shared[frame] != 0;
+}
+
+const std::vector<int32_t>& PageTable::segmentFrames(uint32_t segment){
+    return _segments[segment];
+}
+
+// Unmap everything and free every frame, before a snapshot is restored (call counters are kept)
+void PageTable::clear(){
+    for(size_t i = 0; i < _roots.size(); i++){
+        if(_roots[i] != NULL){
+            freeNode(_roots[i], 0);
+            _roots[i] = NULL;
+        }
+    }
+    std::fill(_pid_entries.begin(), _pid_entries.end(), 0);
+    std::fill(_pid_shares.begin(), _pid_shares.end(), 0);
+    _num_entries = 0;
+    _sparse_huge = 0;
+    _shared_mappings = 0;
+    _frames.reset(0);
+    std::vector<std::vector<int32_t>>().swap(_segments);
+    for(uint32_t i = 0; i < _num_shards; i++){
+        _tlbs[i].flushAll();
+        _frame_caches[i].clear();
+    }
+    _handed_out = false;
+}
+
+void PageTable::restoreFrame(int32_t frame, uint32_t refs, bool used, bool shared){
+    _frame_refs[frame] = refs;
+    _frame_shared[frame] = shared;
+    if(used){
+        _frames.claim(frame);
+    }
+    if(refs > 1){
+        _shared_mappings += refs - 1;
+    }
+}
+
+// Map a page of a snapshot onto its frame, whose reference count is restored separately
+void PageTable::restoreMapping(PageKey key, int32_t frame){
+    insert(key, frame);
+    if(frame >= 0 && (_frame_refs[frame] > 1 || _frame_shared[frame])){
+        _pid_shares[pageKeyPid(key)] = 1;
+    }
+}
+
+void PageTable::restoreHuge(PageKey key, const PageTableHuge& huge){
+    uint32_t pid = pageKeyPid(key);
+    uint64_t page = pageKeyPage(key);
+    PageTableNode *parent = hugeParent(pid, page, true);
+    parent->children[indexAt(page, _levels - 2)] = hugeSlot(new PageTableHuge(huge));
+    parent->used++;
+    _num_huge++;
+    if(huge.used < PT_FANOUT){
+        _sparse_huge++;
+    }
+    _num_entries += huge.used;
+    _pid_entries[pid] += huge.used;
+    if(_frame_refs[huge.frame] > 1){
+        _pid_shares[pid] = 1;
+    }
+}
+
+// A shared memory segment of a snapshot on frames already restored; returns its new id
+uint32_t PageTable::restoreSegment(const int32_t *frames, uint32_t count){
+    _segments.push_back(std::vector<int32_t>(frames, frames + count));
+    return _segments.size() - 1;
+}
+
+// Frames in [first, first + count) changed; checked first so rewriting a page already
+// dirty leaves its cache line shared between threads
+void PageTable::markDirty(int32_t first, int32_t count){
+    for(int32_t frame = first; frame < first + count; frame++){
+        if(!_frame_dirty[frame].load(std::memory_order_relaxed)){
+            _frame_dirty[frame].store(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool PageTable::frameDirty(int32_t frame){
+    return _frame_dirty[frame].load(std::memory_order_relaxed) != 0;
+}
+
+// Start tracking changes afresh, after a checkpoint has recorded them
+void PageTable::clearDirty(){
+    for(uint32_t frame = 0; frame < _frames.numFrames(); frame++){
+        _frame_dirty[frame].store(0, std::memory_order_relaxed);
+    }
 }
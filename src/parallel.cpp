@@ -0,0 +1,378 @@
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include "parallel.h"
+#include "stats.h"
+
+// One command of the segment the workers are running
+typedef struct SegmentCommand {
+    std::string line;           // split by the worker that runs it
+    uint32_t shard;
+    uint32_t pid;               // pid reserved on the main thread when this is a create
+    size_t output_end;          // end of the command's output in its shard's buffer
+} SegmentCommand;
+
+typedef struct ParallelState {
+    Mmu *mmu;
+    PageTable *page_table;
+    void *memory;
+    CommandStats *stats;                        // the main thread's, workers merge into it
+    std::vector<SegmentCommand> segment;
+    std::vector<std::vector<size_t>> queues;    // per shard, positions in segment
+    std::vector<std::ostringstream*> outputs;   // per shard
+    std::vector<std::vector<uint64_t>> counts;  // per shard, by CommandType
+    std::mutex lock;
+    std::condition_variable start;
+    std::condition_variable done;
+    uint64_t generation;
+    uint32_t running;
+    bool stop;
+} ParallelState;
+
+static void leadingWords(const std::string& line, size_t count, std::vector<std::string>& words);
+static bool routeCommand(std::vector<std::string>& words, uint32_t *pid);
+static bool changesFrames(const std::string& name);
+static uint64_t allocationBound(const std::vector<std::string>& words);
+static uint64_t frameBound(uint64_t bytes, uint32_t variables, PageTable *page_table);
+static void workerLoop(ParallelState *state, uint32_t shard);
+static void runShard(ParallelState *state, uint32_t shard);
+static void runSegment(ParallelState *state);
+
+/*
+    trace_file: text file with one command per line (same syntax as the prompt)
+    threads: number of workers, mmu and page_table must have been split into as many shards
+    runs the trace like runBatch, one segment of per-process commands at a time
+*/
+int runParallel(std::string trace_file, uint32_t threads, Mmu *mmu, PageTable *page_table, void *memory, uint64_t counts[CmdCount])
+{
+    std::ifstream trace(trace_file.c_str());
+    if (!trace.is_open())
+    {
+        fprintf(stderr, "Error: cannot open trace file %s\n", trace_file.c_str());
+        return 1;
+    }
+
+    ParallelState state;
+    state.mmu = mmu;
+    state.page_table = page_table;
+    state.memory = memory;
+    state.stats = &command_stats;
+    state.queues.resize(threads);
+    state.counts.assign(threads, std::vector<uint64_t>(CmdCount, 0));
+    state.generation = 0;
+    state.running = 0;
+    state.stop = false;
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        state.outputs.push_back(new std::ostringstream());
+    }
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        workers.push_back(std::thread(workerLoop, &state, i));
+    }
+
+    std::vector<std::string> words;
+    std::vector<std::string> barrier;
+    bool finished = false;
+    while (!finished)
+    {
+        //   - gather per-process commands up to the next barrier, taking pids for creates
+        //     and interning new variable names here so workers never modify shared tables;
+        //     only the first words are looked at, the workers split the rest
+        state.segment.clear();
+        barrier.clear();
+        // memory and frames the creates and allocates of the segment may still take: while
+        // what they ask for fits, each succeeds in whatever order the workers run; one that
+        // might not fit runs as a barrier, so it sees the same usage every run. Each shard is
+        // handed the frames its own commands may take before the workers start
+        uint64_t used = mmu->bytesUsed();
+        uint64_t room = (used < mmu->memorySize()) ? mmu->memorySize() - used : 0;
+        uint64_t frame_room = page_table->numFreeFrames();
+        std::vector<uint64_t> handout(threads, 0);
+        while (state.segment.size() < PARALLEL_SEGMENT_LINES)
+        {
+            SegmentCommand next;
+            if (!std::getline(trace, next.line))
+            {
+                finished = true;
+                break;
+            }
+            leadingWords(next.line, 3, words);
+            if (words.empty())
+            {
+                continue;
+            }
+            if (words[0] == "allocate")
+            {
+                leadingWords(next.line, 5, words);
+            }
+            uint64_t bytes = allocationBound(words);
+            uint64_t frames = (bytes > 0) ? frameBound(bytes, (words[0] == "create") ? 3 : 1, page_table) : 0;
+            // a write or free on a process sharing frames may copy or free a frame another
+            // shard maps, so which shard does it first would depend on the threads
+            if (next.line.find('"') != std::string::npos || !routeCommand(words, &next.pid) || bytes > room ||
+                frames > frame_room || (changesFrames(words[0]) && page_table->sharesFrames(next.pid)))
+            {
+                splitString(next.line, ' ', barrier);
+                break;
+            }
+            room -= bytes;
+            frame_room -= frames;
+            if (words[0] == "create")
+            {
+                next.pid = mmu->reservePids(1);
+                page_table->reservePids(next.pid);
+            }
+            else if (words[0] == "allocate" && words.size() > 2)
+            {
+                mmu->internName(words[2]);
+            }
+            next.shard = next.pid % threads;
+            handout[next.shard] += frames;
+            state.segment.push_back(std::move(next));
+        }
+
+        //   - run it on the workers, then write the output back in trace order
+        if (!state.segment.empty())
+        {
+            page_table->handOutFrames(handout);
+            runSegment(&state);
+        }
+
+        //   - barrier commands see every process and run alone, then hand back the frames
+        //     their shard cached so the next command finds them where one thread would
+        if (!barrier.empty())
+        {
+            CommandType type = executeCommand(barrier, mmu, page_table, memory);
+            page_table->drainFrameCaches();
+            counts[type]++;
+            if (type == CommandType::CmdExit)
+            {
+                finished = true;
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(state.lock);
+        state.stop = true;
+        state.generation++;
+    }
+    state.start.notify_all();
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        workers[i].join();
+        delete state.outputs[i];
+        for (int j = 0; j < CmdCount; j++)
+        {
+            counts[j] += state.counts[i][j];
+        }
+    }
+    return 0;
+}
+
+// Up to the first count words of a command line
+static void leadingWords(const std::string& line, size_t count, std::vector<std::string>& words)
+{
+    words.clear();
+    size_t position = 0;
+    while (words.size() < count)
+    {
+        size_t begin = line.find_first_not_of(' ', position);
+        if (begin == std::string::npos)
+        {
+            break;
+        }
+        position = line.find(' ', begin);
+        words.push_back(line.substr(begin, position - begin));
+    }
+}
+
+// Which pid a command belongs to; false for commands that must run as a barrier
+static bool routeCommand(std::vector<std::string>& words, uint32_t *pid)
+{
+    const std::string& name = words[0];
+    if (name == "create")
+    {
+        // the pid is only known once it is reserved
+        *pid = 0;
+        return words.size() > 2;
+    }
+    if (words.size() < 2)
+    {
+        return false;
+    }
+    if (name == "allocate" || name == "set" || name == "free" || name == "terminate" || name == "fill" || name == "shm_detach")
+    {
+        *pid = allNums(words[1]);
+        return true;
+    }
+    const std::string& object = words[1];
+    *pid = allNums(object.substr(0, object.find(':')));
+    if (name == "print")
+    {
+        return !(object == "mmu" || object == "page" || object == "processes" || object == "tlb" || object == "stats");
+    }
+    if (name == "sum" || name == "min" || name == "max")
+    {
+        return true;
+    }
+    if (name == "copy")
+    {
+        // only copies within one process stay on its worker
+        return words.size() > 2 && (uint32_t)allNums(words[2].substr(0, words[2].find(':'))) == *pid;
+    }
+    return false;
+}
+
+// Commands that can write to or free the frames of the process they are routed to
+static bool changesFrames(const std::string& name)
+{
+    return name == "set" || name == "fill" || name == "copy" || name == "free" || name == "terminate" || name == "shm_detach";
+}
+
+// Most bytes a create or allocate can add to the memory in use (a create also takes the 64 KB
+// stack), 0 for other commands and UINT64_MAX if the sizes are not numbers that could fit
+static uint64_t allocationBound(const std::vector<std::string>& words)
+{
+    if (words[0] == "create" && words.size() > 2)
+    {
+        int64_t text_size = allNums(words[1]);
+        int64_t data_size = allNums(words[2]);
+        if (text_size < 0 || data_size < 0 || text_size > INT32_MAX || data_size > INT32_MAX)
+        {
+            return UINT64_MAX;
+        }
+        return text_size + data_size + 65536;
+    }
+    if (words[0] == "allocate" && words.size() > 4)
+    {
+        uint32_t size = dataTypeSize(parseDataType(words[3]));
+        int64_t count = allNums(words[4]);
+        if (count < 0 || (size > 0 && (uint64_t)count > UINT64_MAX / size))
+        {
+            return UINT64_MAX;
+        }
+        return count * size;
+    }
+    return 0;
+}
+
+// Most frames mapping that many bytes over that many new variables can take: every page
+// they span (workers get no huge pages from the allocator, see PageTable::takeFrameRun)
+static uint64_t frameBound(uint64_t bytes, uint32_t variables, PageTable *page_table)
+{
+    if (bytes == UINT64_MAX)
+    {
+        return UINT64_MAX;
+    }
+    return bytes / page_table->getPageSize() + 2 * variables;
+}
+
+// Wake the workers for the current segment, wait for them, then emit the captured output
+static void runSegment(ParallelState *state)
+{
+    uint32_t threads = state->queues.size();
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        state->queues[i].clear();
+        state->outputs[i]->str("");
+    }
+    for (size_t i = 0; i < state->segment.size(); i++)
+    {
+        state->queues[state->segment[i].shard].push_back(i);
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(state->lock);
+        state->running = threads;
+        state->generation++;
+        state->start.notify_all();
+        while (state->running > 0)
+        {
+            state->done.wait(guard);
+        }
+    }
+
+    std::vector<std::string> text(threads);
+    std::vector<size_t> position(threads, 0);
+    for (uint32_t i = 0; i < threads; i++)
+    {
+        text[i] = state->outputs[i]->str();
+    }
+    for (size_t i = 0; i < state->segment.size(); i++)
+    {
+        SegmentCommand& command = state->segment[i];
+        size_t begin = position[command.shard];
+        std::cout.write(text[command.shard].data() + begin, command.output_end - begin);
+        position[command.shard] = command.output_end;
+    }
+
+    // frames parked in the workers' caches go back to the allocator between segments
+    state->page_table->drainFrameCaches();
+}
+
+static void workerLoop(ParallelState *state, uint32_t shard)
+{
+    setCommandOutput(state->outputs[shard]);
+    command_stats.enableTiming(state->stats->timing());
+    uint64_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(state->lock);
+            while (state->generation == seen)
+            {
+                state->start.wait(guard);
+            }
+            seen = state->generation;
+            if (state->stop)
+            {
+                return;
+            }
+        }
+
+        runShard(state, shard);
+
+        std::lock_guard<std::mutex> guard(state->lock);
+        state->stats->merge(command_stats);
+        command_stats.clear();
+        if (--state->running == 0)
+        {
+            state->done.notify_one();
+        }
+    }
+}
+
+// Run this shard's commands of the segment in trace order
+static void runShard(ParallelState *state, uint32_t shard)
+{
+    std::vector<size_t>& queue = state->queues[shard];
+    std::ostream& output = commandOutput();
+    std::vector<std::string> words;
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+        SegmentCommand& command = state->segment[queue[i]];
+        CommandType type;
+        splitString(command.line, ' ', words);
+        if (words[0] == "create")
+        {
+            // same as executeCommand, with the pid taken when the segment was read
+            uint64_t start = command_stats.timing() ? statsNow() : 0;
+            createProcess(command.pid, allNums(words[1]), allNums(words[2]), state->mmu, state->page_table);
+            output << std::endl;
+            type = CommandType::CmdCreate;
+            command_stats.record(type, command_stats.timing() ? statsNow() - start : 0);
+        }
+        else
+        {
+            type = executeCommand(words, state->mmu, state->page_table, state->memory);
+        }
+        state->counts[shard][type]++;
+        command.output_end = output.tellp();
+    }
+}
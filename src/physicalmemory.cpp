@@ -0,0 +1,163 @@
+#include "physicalmemory.h"
+#include <vector>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+
+PhysicalMemory::PhysicalMemory(uint64_t size, HugePages huge)
+{
+    size_t host_page = sysconf(_SC_PAGESIZE);
+    _size = size;
+    _huge = huge;
+    _discards = 0;
+    _discarded_bytes = 0;
+    _image = false;
+    _base = (uint8_t*)MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (huge == HugePages::HugeTlb)
+    {
+        _granule = HUGETLB_PAGE_SIZE;
+        _mapped = (size + _granule - 1) / _granule * _granule;
+        // no MAP_NORESERVE here: the huge pages must be reserved now, or the first touch of
+        // one the pool cannot supply would SIGBUS instead of the mmap failing
+        _base = (uint8_t*)mmap(NULL, _mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (_base == MAP_FAILED)
+    {
+        // no hugetlbfs pages reserved on this host: transparent huge pages are the closest
+        if (_huge == HugePages::HugeTlb)
+        {
+            _huge = HugePages::HugeThp;
+        }
+        _granule = host_page;
+        _mapped = (size + _granule - 1) / _granule * _granule;
+        // MAP_NORESERVE: nothing is committed (or charged against overcommit) until touched
+        _base = (uint8_t*)mmap(NULL, _mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    }
+#ifdef MADV_HUGEPAGE
+    if (_base != MAP_FAILED && _huge == HugePages::HugeThp)
+    {
+        madvise(_base, _mapped, MADV_HUGEPAGE);
+    }
+#endif
+}
+
+PhysicalMemory::~PhysicalMemory()
+{
+    if (_base != MAP_FAILED)
+    {
+        munmap(_base, _mapped);
+    }
+}
+
+bool PhysicalMemory::isMapped()
+{
+    return _base != MAP_FAILED;
+}
+
+void* PhysicalMemory::base()
+{
+    return _base;
+}
+
+uint64_t PhysicalMemory::size()
+{
+    return _size;
+}
+
+// What the memory actually ended up on (HugeTlb falls back to HugeThp)
+HugePages PhysicalMemory::hugePages()
+{
+    return _huge;
+}
+
+/*
+    offset/length: a range of memory that no longer holds data
+    releases the host pages lying entirely inside it; they read back as zeros and are
+    committed again when next written
+*/
+void PhysicalMemory::discard(uint64_t offset, uint64_t length)
+{
+    uint64_t start = (offset + _granule - 1) / _granule * _granule;
+    uint64_t end = (offset + length) / _granule * _granule;
+    if (start >= end)
+    {
+        return;
+    }
+    // over a file image, dropped pages would be read back from the file: map fresh
+    // anonymous memory over them instead (or just zero them once the host runs out of
+    // mappings)
+    if (_image && mmap(_base + start, end - start, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0) == MAP_FAILED)
+    {
+        memset(_base + start, 0, end - start);
+        return;
+    }
+    if (_image || madvise(_base + start, end - start, MADV_DONTNEED) == 0)
+    {
+        _discards++;
+        _discarded_bytes += end - start;
+    }
+}
+
+/*
+    fd: open file holding at least size() bytes (rounded up to host pages) at offset, a
+    multiple of the host page size
+    maps the file over the memory, private and writable: nothing is read until a frame is
+    touched and writes never reach the file. hugetlbfs memory cannot map a file and is read
+    instead
+*/
+bool PhysicalMemory::mapImage(int fd, uint64_t offset)
+{
+    if (_huge == HugePages::HugeTlb)
+    {
+        uint64_t done = 0;
+        while (done < _size)
+        {
+            ssize_t got = pread(fd, _base + done, _size - done, offset + done);
+            if (got <= 0)
+            {
+                return false;
+            }
+            done += got;
+        }
+        return true;
+    }
+    size_t host_page = sysconf(_SC_PAGESIZE);
+    size_t length = (_size + host_page - 1) / host_page * host_page;
+    if (mmap(_base, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_NORESERVE, fd, offset) == MAP_FAILED)
+    {
+        return false;
+    }
+    _image = true;
+    return true;
+}
+
+// Bytes of the mapping currently backed by host memory (walks the mapping with mincore)
+uint64_t PhysicalMemory::residentBytes()
+{
+    size_t host_page = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((_mapped + host_page - 1) / host_page);
+    if (mincore(_base, _mapped, pages.data()) != 0)
+    {
+        return 0;
+    }
+    uint64_t resident = 0;
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        resident += pages[i] & 1;
+    }
+    return resident * host_page;
+}
+
+uint64_t PhysicalMemory::discards()
+{
+    return _discards;
+}
+
+uint64_t PhysicalMemory::discardedBytes()
+{
+    return _discarded_bytes;
+}
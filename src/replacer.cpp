@@ -0,0 +1,312 @@
+#include "replacer.h"
+#include <algorithm>
+
+FrameList::FrameList(uint32_t num_frames) : _prev(num_frames, -1), _next(num_frames, -1), _linked(num_frames, false)
+{
+    _head = -1;
+    _tail = -1;
+    _size = 0;
+}
+
+void FrameList::pushBack(uint32_t frame)
+{
+    _prev[frame] = _tail;
+    _next[frame] = -1;
+    if (_tail >= 0)
+    {
+        _next[_tail] = frame;
+    }
+    else
+    {
+        _head = frame;
+    }
+    _tail = frame;
+    _linked[frame] = true;
+    _size++;
+}
+
+void FrameList::remove(uint32_t frame)
+{
+    if (!_linked[frame])
+    {
+        return;
+    }
+    if (_prev[frame] >= 0)
+    {
+        _next[_prev[frame]] = _next[frame];
+    }
+    else
+    {
+        _head = _next[frame];
+    }
+    if (_next[frame] >= 0)
+    {
+        _prev[_next[frame]] = _prev[frame];
+    }
+    else
+    {
+        _tail = _prev[frame];
+    }
+    _linked[frame] = false;
+    _size--;
+}
+
+int32_t FrameList::front()
+{
+    return _head;
+}
+
+bool FrameList::contains(uint32_t frame)
+{
+    return _linked[frame];
+}
+
+uint32_t FrameList::size()
+{
+    return _size;
+}
+
+FifoReplacer::FifoReplacer(uint32_t num_frames) : _queue(num_frames)
+{
+}
+
+void FifoReplacer::insert(uint32_t frame, uint64_t key)
+{
+    _queue.pushBack(frame);
+}
+
+void FifoReplacer::touch(uint32_t frame)
+{
+}
+
+void FifoReplacer::remove(uint32_t frame)
+{
+    _queue.remove(frame);
+}
+
+int32_t FifoReplacer::victim(uint64_t incoming)
+{
+    int32_t frame = _queue.front();
+    if (frame >= 0)
+    {
+        _queue.remove(frame);
+    }
+    return frame;
+}
+
+LruReplacer::LruReplacer(uint32_t num_frames) : _order(num_frames)
+{
+}
+
+void LruReplacer::insert(uint32_t frame, uint64_t key)
+{
+    _order.pushBack(frame);
+}
+
+void LruReplacer::touch(uint32_t frame)
+{
+    if (_order.contains(frame))
+    {
+        _order.remove(frame);
+        _order.pushBack(frame);
+    }
+}
+
+void LruReplacer::remove(uint32_t frame)
+{
+    _order.remove(frame);
+}
+
+int32_t LruReplacer::victim(uint64_t incoming)
+{
+    int32_t frame = _order.front();
+    if (frame >= 0)
+    {
+        _order.remove(frame);
+    }
+    return frame;
+}
+
+ClockReplacer::ClockReplacer(uint32_t num_frames) : _referenced(num_frames, 0), _resident(num_frames, 0)
+{
+    _num_resident = 0;
+    _hand = 0;
+}
+
+void ClockReplacer::insert(uint32_t frame, uint64_t key)
+{
+    if (!_resident[frame])
+    {
+        _num_resident++;
+    }
+    _resident[frame] = 1;
+    _referenced[frame] = 1;
+}
+
+void ClockReplacer::touch(uint32_t frame)
+{
+    _referenced[frame] = 1;
+}
+
+void ClockReplacer::remove(uint32_t frame)
+{
+    if (_resident[frame])
+    {
+        _num_resident--;
+    }
+    _resident[frame] = 0;
+    _referenced[frame] = 0;
+}
+
+int32_t ClockReplacer::victim(uint64_t incoming)
+{
+    if (_num_resident == 0)
+    {
+        return -1;
+    }
+    // at most two sweeps: the first may only clear reference bits
+    while (true)
+    {
+        uint32_t frame = _hand;
+        _hand = (_hand + 1) % _resident.size();
+        if (!_resident[frame])
+        {
+            continue;
+        }
+        if (_referenced[frame])
+        {
+            _referenced[frame] = 0;
+            continue;
+        }
+        remove(frame);
+        return frame;
+    }
+}
+
+ArcReplacer::ArcReplacer(uint32_t num_frames) : _t1(num_frames), _t2(num_frames), _keys(num_frames, 0)
+{
+    _capacity = num_frames;
+    _target = 0;
+    _pending_ghost = 0;
+    _pending_key = 0;
+}
+
+// A miss on a remembered key grows the list it was evicted from: a B1 hit means T1 was
+// too small, a B2 hit that T2 was. Returns which ghost list held the key (0 if neither)
+int ArcReplacer::adapt(uint64_t key)
+{
+    std::unordered_map<uint64_t, std::list<uint64_t>::iterator>::iterator it = _b1_index.find(key);
+    if (it != _b1_index.end())
+    {
+        uint32_t delta = std::max<uint32_t>(1, _b2.size() / _b1.size());
+        _target = std::min(_capacity, _target + delta);
+        _b1.erase(it->second);
+        _b1_index.erase(it);
+        return 1;
+    }
+    it = _b2_index.find(key);
+    if (it != _b2_index.end())
+    {
+        uint32_t delta = std::max<uint32_t>(1, _b1.size() / _b2.size());
+        _target = (_target > delta) ? _target - delta : 0;
+        _b2.erase(it->second);
+        _b2_index.erase(it);
+        return 2;
+    }
+    return 0;
+}
+
+void ArcReplacer::remember(std::list<uint64_t>& ghosts, std::unordered_map<uint64_t, std::list<uint64_t>::iterator>& index, uint64_t key)
+{
+    ghosts.push_back(key);
+    index[key] = --ghosts.end();
+    // both ghost lists together never remember more than the cache holds
+    while (_b1.size() + _b2.size() > _capacity)
+    {
+        std::list<uint64_t>& oldest = (_b1.size() > _b2.size()) ? _b1 : _b2;
+        std::unordered_map<uint64_t, std::list<uint64_t>::iterator>& oldest_index = (&oldest == &_b1) ? _b1_index : _b2_index;
+        oldest_index.erase(oldest.front());
+        oldest.pop_front();
+    }
+}
+
+void ArcReplacer::insert(uint32_t frame, uint64_t key)
+{
+    int ghost = (_pending_ghost != 0 && _pending_key == key) ? _pending_ghost : adapt(key);
+    _pending_ghost = 0;
+    _keys[frame] = key;
+    if (ghost != 0)
+    {
+        _t2.pushBack(frame);
+    }
+    else
+    {
+        _t1.pushBack(frame);
+    }
+}
+
+void ArcReplacer::touch(uint32_t frame)
+{
+    if (_t1.contains(frame))
+    {
+        _t1.remove(frame);
+        _t2.pushBack(frame);
+    }
+    else if (_t2.contains(frame))
+    {
+        _t2.remove(frame);
+        _t2.pushBack(frame);
+    }
+}
+
+void ArcReplacer::remove(uint32_t frame)
+{
+    _t1.remove(frame);
+    _t2.remove(frame);
+}
+
+int32_t ArcReplacer::victim(uint64_t incoming)
+{
+    _pending_key = incoming;
+    _pending_ghost = adapt(incoming);
+
+    int32_t frame;
+    if (_t1.size() > 0 && (_t1.size() > _target || (_pending_ghost == 2 && _t1.size() == _target) || _t2.size() == 0))
+    {
+        frame = _t1.front();
+        _t1.remove(frame);
+        remember(_b1, _b1_index, _keys[frame]);
+    }
+    else
+    {
+        frame = _t2.front();
+        if (frame < 0)
+        {
+            return -1;
+        }
+        _t2.remove(frame);
+        remember(_b2, _b2_index, _keys[frame]);
+    }
+    return frame;
+}
+
+PageReplacer* createReplacer(ReplacementPolicy policy, uint32_t num_frames)
+{
+    switch (policy)
+    {
+        case ReplacementPolicy::ReplaceFifo:
+            return new FifoReplacer(num_frames);
+        case ReplacementPolicy::ReplaceLru:
+            return new LruReplacer(num_frames);
+        case ReplacementPolicy::ReplaceArc:
+            return new ArcReplacer(num_frames);
+        default:
+            return new ClockReplacer(num_frames);
+    }
+}
+
+const char* replacementPolicyName(ReplacementPolicy policy)
+{
+    static const char *names[] = {"fifo", "lru", "clock", "arc"};
+    return names[policy];
+}
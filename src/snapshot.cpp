@@ -0,0 +1,1035 @@
+#include "snapshot.h"
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const size_t RECORD_SIZES[SectionCount] = {
+    1, sizeof(SnapshotProcess), sizeof(SnapshotVariable), sizeof(SnapshotHole), sizeof(SnapshotSegment),
+    sizeof(int32_t), sizeof(uint32_t), sizeof(SnapshotMapping), sizeof(SnapshotHuge), sizeof(SnapshotFrame),
+    sizeof(SnapshotFrameChange)
+};
+static const uint32_t COPY_PAGES = 256;         // most pages copied between files at once
+
+// Everything a snapshot holds besides the memory image: taken from the simulator, or what a
+// chain of records adds up to (the header is then the last record's)
+typedef struct SnapshotState {
+    SnapshotHeader header;
+    std::vector<std::string> names;
+    std::vector<SnapshotProcess> processes;
+    std::vector<SnapshotVariable> variables;
+    std::vector<SnapshotHole> holes;
+    std::vector<SnapshotSegment> segments;
+    std::vector<int32_t> segment_frames;
+    std::vector<uint32_t> attachments;
+    std::vector<SnapshotMapping> mappings;
+    std::vector<SnapshotHuge> huge;
+    std::vector<SnapshotFrame> frames;
+} SnapshotState;
+
+// One record of a snapshot file: everything before its image mapped read-only, each section
+// checked to lie inside it and to refer only to frames and names it has
+typedef struct SnapshotView {
+    SnapshotHeader header;
+    const uint8_t *data;
+    std::vector<std::string> names;
+} SnapshotView;
+
+// A snapshot file read back: the state its records add up to, and where in the file the
+// latest page of each frame is (0 where the frame holds zeros)
+typedef struct SnapshotChain {
+    SnapshotState state;
+    int fd;
+    uint64_t end;                   // right after the last record
+    uint64_t base_image;            // image offset of the full snapshot
+    std::vector<uint64_t> sources;
+} SnapshotChain;
+
+// The file last saved, checkpointed to or loaded, and the state as of its last record, so a
+// checkpoint to it only appends what changed since. save, checkpoint and load are barriers
+// that run alone on the main thread, so one for the whole program is enough
+typedef struct CheckpointBase {
+    std::string file;
+    PageTable *page_table;          // NULL when there is none
+    dev_t device;
+    ino_t inode;
+    uint64_t end;
+    SnapshotState state;
+} CheckpointBase;
+
+static CheckpointBase last_checkpoint;
+
+template <typename T>
+static const T* sectionOf(const SnapshotView& view, SnapshotSection section)
+{
+    return (const T*)(view.data + view.header.offsets[section]);
+}
+
+template <typename T>
+static void copySection(const SnapshotView& view, SnapshotSection section, std::vector<T>& records)
+{
+    const T *first = sectionOf<T>(view, section);
+    records.assign(first, first + view.header.counts[section]);
+}
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Reads the names section into view->names; false if a name runs past the section
+static bool readNames(SnapshotView *view)
+{
+    const SnapshotHeader& header = view->header;
+    const uint8_t *pos = view->data + header.offsets[SecNames];
+    const uint8_t *end = view->data + header.image_offset;
+    for (uint64_t i = 0; i < header.counts[SecNames]; i++)
+    {
+        uint32_t size;
+        if ((size_t)(end - pos) < sizeof(size))
+        {
+            return false;
+        }
+        memcpy(&size, pos, sizeof(size));
+        pos += sizeof(size);
+        if ((size_t)(end - pos) < size)
+        {
+            return false;
+        }
+        view->names.push_back(std::string((const char*)pos, size));
+        pos += size;
+    }
+    return true;
+}
+
+// A frame a record may refer to; a checkpoint removes a mapping with PT_UNMAPPED
+static bool validFrame(const SnapshotHeader& header, int32_t frame, bool removal)
+{
+    return (frame >= 0 && (uint32_t)frame < header.num_frames) || (removal && frame == PT_UNMAPPED);
+}
+
+// Whether the records of the sections agree with each other and with the header
+static bool checkRecords(const SnapshotView& view)
+{
+    const SnapshotHeader& header = view.header;
+    const uint64_t *counts = header.counts;
+    bool full = (header.sequence == 0);
+    const SnapshotProcess *processes = sectionOf<SnapshotProcess>(view, SecProcesses);
+    uint64_t variables = 0;
+    uint64_t holes = 0;
+    for (uint64_t i = 0; i < counts[SecProcesses]; i++)
+    {
+        if (processes[i].pid < header.first_pid || processes[i].pid >= header.next_pid ||
+            (i > 0 && processes[i].pid <= processes[i - 1].pid))
+        {
+            return false;
+        }
+        variables += processes[i].num_variables;
+        holes += processes[i].num_holes;
+    }
+    const SnapshotVariable *vars = sectionOf<SnapshotVariable>(view, SecVariables);
+    for (uint64_t i = 0; i < counts[SecVariables]; i++)
+    {
+        if (vars[i].name >= view.names.size() || vars[i].type == DataType::FreeSpace || vars[i].type > DataType::Double)
+        {
+            return false;
+        }
+    }
+    const SnapshotSegment *segments = sectionOf<SnapshotSegment>(view, SecSegments);
+    uint64_t segment_frames = 0;
+    uint64_t attachments = 0;
+    for (uint64_t i = 0; i < counts[SecSegments]; i++)
+    {
+        if (segments[i].name >= view.names.size())
+        {
+            return false;
+        }
+        segment_frames += segments[i].num_frames;
+        attachments += segments[i].num_pids;
+    }
+    if (variables != counts[SecVariables] || holes != counts[SecHoles] || segment_frames != counts[SecSegmentFrames] ||
+        attachments != counts[SecAttachments] || counts[SecFrames] != (full ? header.num_frames : 0) ||
+        (full && counts[SecFrameChanges] > 0))
+    {
+        return false;
+    }
+    const int32_t *frames = sectionOf<int32_t>(view, SecSegmentFrames);
+    for (uint64_t i = 0; i < counts[SecSegmentFrames]; i++)
+    {
+        if (!validFrame(header, frames[i], false))
+        {
+            return false;
+        }
+    }
+    const SnapshotMapping *mappings = sectionOf<SnapshotMapping>(view, SecMappings);
+    for (uint64_t i = 0; i < counts[SecMappings]; i++)
+    {
+        if (!validFrame(header, mappings[i].frame, !full) || (i > 0 && mappings[i].key <= mappings[i - 1].key))
+        {
+            return false;
+        }
+    }
+    const SnapshotHuge *huge = sectionOf<SnapshotHuge>(view, SecHuge);
+    for (uint64_t i = 0; i < counts[SecHuge]; i++)
+    {
+        if (i > 0 && huge[i].key <= huge[i - 1].key)
+        {
+            return false;
+        }
+        if (!full && huge[i].frame == PT_UNMAPPED)
+        {
+            continue;
+        }
+        if (huge[i].frame < 0 || huge[i].frame % PT_FANOUT != 0 || (uint64_t)huge[i].frame + PT_FANOUT > header.num_frames ||
+            pageKeyPage(huge[i].key) % PT_FANOUT != 0 || huge[i].used > PT_FANOUT)
+        {
+            return false;
+        }
+    }
+    const SnapshotFrameChange *changes = sectionOf<SnapshotFrameChange>(view, SecFrameChanges);
+    uint64_t pages = 0;
+    for (uint64_t i = 0; i < counts[SecFrameChanges]; i++)
+    {
+        if (changes[i].frame >= header.num_frames || (i > 0 && changes[i].frame <= changes[i - 1].frame))
+        {
+            return false;
+        }
+        pages += changes[i].data;
+    }
+    uint64_t image_size = full ? header.memory_size : pages * header.page_size;
+    return header.length == header.image_offset + alignUp(image_size, SNAPSHOT_ALIGN);
+}
+
+/*
+    fd: snapshot file of file_size bytes, a record of which starts at offset
+    maps everything of the record before its image; returns NULL if it is a valid record
+    (unmap it with closeView), else what is wrong with it
+*/
+static const char* openView(int fd, uint64_t file_size, uint64_t offset, SnapshotView *view)
+{
+    SnapshotHeader& header = view->header;
+    memset(&header, 0, sizeof(header));
+    view->data = NULL;
+    if (pread(fd, &header, sizeof(header), offset) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, SNAPSHOT_MAGIC, 4) != 0 || header.version != SNAPSHOT_VERSION)
+    {
+        return "not a memsim snapshot";
+    }
+    bool valid = header.image_offset % SNAPSHOT_ALIGN == 0 && header.image_offset >= sizeof(header) &&
+                 header.length >= header.image_offset && file_size - offset >= header.length;
+    for (int i = 0; i < SectionCount && valid; i++)
+    {
+        valid = header.offsets[i] % 8 == 0 && header.offsets[i] >= sizeof(header) && header.offsets[i] <= header.image_offset &&
+                header.counts[i] <= (header.image_offset - header.offsets[i]) / RECORD_SIZES[i];
+    }
+    if (valid)
+    {
+        void *data = mmap(NULL, header.image_offset, PROT_READ, MAP_PRIVATE, fd, offset);
+        view->data = (data == MAP_FAILED) ? NULL : (const uint8_t*)data;
+        valid = view->data != NULL && readNames(view) && checkRecords(*view);
+    }
+    if (!valid)
+    {
+        if (view->data != NULL)
+        {
+            munmap((void*)view->data, header.image_offset);
+        }
+        return "the snapshot file is damaged";
+    }
+    return NULL;
+}
+
+static void closeView(SnapshotView *view)
+{
+    munmap((void*)view->data, view->header.image_offset);
+}
+
+// What turns from into to (both in key order): the records of to that are new or differ,
+// and for each key only in from a record of it with frame PT_UNMAPPED
+template <typename T>
+static void diffRecords(const std::vector<T>& from, const std::vector<T>& to, std::vector<T>& changes)
+{
+    size_t i = 0;
+    size_t j = 0;
+    while (i < from.size() || j < to.size())
+    {
+        if (j == to.size() || (i < from.size() && from[i].key < to[j].key))
+        {
+            T removal;
+            memset(&removal, 0, sizeof(removal));
+            removal.key = from[i].key;
+            removal.frame = PT_UNMAPPED;
+            changes.push_back(removal);
+            i++;
+        }
+        else if (i == from.size() || to[j].key < from[i].key)
+        {
+            changes.push_back(to[j]);
+            j++;
+        }
+        else
+        {
+            if (memcmp(&from[i], &to[j], sizeof(T)) != 0)
+            {
+                changes.push_back(to[j]);
+            }
+            i++;
+            j++;
+        }
+    }
+}
+
+// The reverse of diffRecords: merges the changes into records
+template <typename T>
+static void applyChanges(std::vector<T>& records, const T *changes, uint64_t count)
+{
+    std::vector<T> merged;
+    merged.reserve(records.size() + count);
+    size_t i = 0;
+    uint64_t j = 0;
+    while (i < records.size() || j < count)
+    {
+        if (j == count || (i < records.size() && records[i].key < changes[j].key))
+        {
+            merged.push_back(records[i]);
+            i++;
+            continue;
+        }
+        if (i < records.size() && records[i].key == changes[j].key)
+        {
+            i++;
+        }
+        if (changes[j].frame != PT_UNMAPPED)
+        {
+            merged.push_back(changes[j]);
+        }
+        j++;
+    }
+    records.swap(merged);
+}
+
+// Takes the header, names, processes and segments of a record, which every record has whole
+static void readProcesses(const SnapshotView& view, SnapshotState *state)
+{
+    state->header = view.header;
+    state->names = view.names;
+    copySection(view, SecProcesses, state->processes);
+    copySection(view, SecVariables, state->variables);
+    copySection(view, SecHoles, state->holes);
+    copySection(view, SecSegments, state->segments);
+    copySection(view, SecSegmentFrames, state->segment_frames);
+    copySection(view, SecAttachments, state->attachments);
+}
+
+// Whether a checkpoint record can follow the record before it
+static bool followsRecord(const SnapshotHeader& header, const SnapshotHeader& before)
+{
+    return header.sequence == before.sequence + 1 && header.page_size == before.page_size &&
+           header.num_frames == before.num_frames && header.memory_size == before.memory_size &&
+           header.virtual_size == before.virtual_size && header.first_pid == before.first_pid;
+}
+
+/*
+    file: snapshot file written by saveSnapshot, with any checkpoints appended to it
+    adds up its records into chain (chain->fd is then open for reading pages, close it when
+    done); returns NULL on success, else what is wrong with the file. A checkpoint whose
+    header never got written (the program died appending it) ends the chain
+*/
+static const char* readChain(std::string file, SnapshotChain *chain)
+{
+    chain->fd = open(file.c_str(), O_RDONLY);
+    struct stat info;
+    if (chain->fd < 0 || fstat(chain->fd, &info) != 0)
+    {
+        if (chain->fd >= 0)
+        {
+            close(chain->fd);
+        }
+        return "cannot open the snapshot file";
+    }
+    SnapshotState& state = chain->state;
+    uint64_t offset = 0;
+    const char *error = NULL;
+    while (error == NULL && (offset == 0 || offset < (uint64_t)info.st_size))
+    {
+        SnapshotView view;
+        error = openView(chain->fd, info.st_size, offset, &view);
+        if (error != NULL)
+        {
+            if (offset > 0 && view.header.magic[0] == '\0')
+            {
+                error = NULL;
+            }
+            break;
+        }
+        const SnapshotHeader& header = view.header;
+        if (offset == 0 ? header.sequence != 0 : !followsRecord(header, state.header))
+        {
+            error = "the snapshot file is damaged";
+        }
+        else if (offset == 0)
+        {
+            readProcesses(view, &state);
+            copySection(view, SecMappings, state.mappings);
+            copySection(view, SecHuge, state.huge);
+            copySection(view, SecFrames, state.frames);
+            chain->base_image = header.image_offset;
+            chain->sources.resize(header.num_frames);
+            for (uint32_t f = 0; f < header.num_frames; f++)
+            {
+                chain->sources[f] = header.image_offset + (uint64_t)f * header.page_size;
+            }
+        }
+        else
+        {
+            readProcesses(view, &state);
+            applyChanges(state.mappings, sectionOf<SnapshotMapping>(view, SecMappings), header.counts[SecMappings]);
+            applyChanges(state.huge, sectionOf<SnapshotHuge>(view, SecHuge), header.counts[SecHuge]);
+            const SnapshotFrameChange *changes = sectionOf<SnapshotFrameChange>(view, SecFrameChanges);
+            uint64_t page = offset + header.image_offset;
+            for (uint64_t i = 0; i < header.counts[SecFrameChanges]; i++)
+            {
+                SnapshotFrame frame = {changes[i].refs, changes[i].used, changes[i].shared, 0};
+                state.frames[changes[i].frame] = frame;
+                if (changes[i].data)
+                {
+                    chain->sources[changes[i].frame] = page;
+                    page += header.page_size;
+                }
+                else if (!changes[i].used)
+                {
+                    chain->sources[changes[i].frame] = 0;
+                }
+            }
+        }
+        offset += header.length;
+        closeView(&view);
+    }
+    if (error != NULL)
+    {
+        close(chain->fd);
+        return error;
+    }
+    chain->end = offset;
+    return NULL;
+}
+
+// Reads the pages of count frames from first on out of the chain, one read per run of them
+// lying one after the other in the file
+static bool readPages(const SnapshotChain& chain, uint32_t first, uint32_t count, uint8_t *out)
+{
+    uint32_t page_size = chain.state.header.page_size;
+    uint32_t i = 0;
+    while (i < count)
+    {
+        uint64_t source = chain.sources[first + i];
+        uint32_t end = i + 1;
+        while (end < count && (source == 0 ? chain.sources[first + end] == 0 :
+                               chain.sources[first + end] == source + (uint64_t)(end - i) * page_size))
+        {
+            end++;
+        }
+        uint64_t length = (uint64_t)(end - i) * page_size;
+        uint8_t *pos = out + (uint64_t)i * page_size;
+        if (source == 0)
+        {
+            memset(pos, 0, length);
+        }
+        else if (pread(chain.fd, pos, length, source) != (ssize_t)length)
+        {
+            return false;
+        }
+        i = end;
+    }
+    return true;
+}
+
+static bool writeAll(int fd, const void *data, size_t length, uint64_t offset)
+{
+    const uint8_t *pos = (const uint8_t*)data;
+    while (length > 0)
+    {
+        ssize_t written = pwrite(fd, pos, length, offset);
+        if (written <= 0)
+        {
+            return false;
+        }
+        pos += written;
+        offset += written;
+        length -= written;
+    }
+    return true;
+}
+
+/*
+    frames: the frames whose pages to write, in ascending order
+    writes each page to fd at offset + frame * page_size, or if packed one after the other
+    from offset; one write per run of consecutive frames. The pages come from memory, or if
+    that is NULL from chain
+*/
+static bool writePages(int fd, uint64_t offset, bool packed, const std::vector<uint32_t>& frames, uint32_t page_size,
+                       const uint8_t *memory, const SnapshotChain *chain)
+{
+    std::vector<uint8_t> buffer;
+    size_t i = 0;
+    while (i < frames.size())
+    {
+        size_t end = i + 1;
+        while (end < frames.size() && frames[end] == frames[end - 1] + 1 && (memory != NULL || end - i < COPY_PAGES))
+        {
+            end++;
+        }
+        uint64_t length = (uint64_t)(end - i) * page_size;
+        const uint8_t *data;
+        if (memory != NULL)
+        {
+            data = memory + (uint64_t)frames[i] * page_size;
+        }
+        else
+        {
+            buffer.resize(length);
+            if (!readPages(*chain, frames[i], end - i, buffer.data()))
+            {
+                return false;
+            }
+            data = buffer.data();
+        }
+        if (!writeAll(fd, data, length, offset + (uint64_t)(packed ? i : frames[i]) * page_size))
+        {
+            return false;
+        }
+        i = end;
+    }
+    return true;
+}
+
+// Appends a section to the metadata being built, 8-byte aligned, and records where it went
+static void putSection(std::string& out, SnapshotHeader *header, SnapshotSection section, const void *data, size_t bytes, uint64_t count)
+{
+    out.resize(alignUp(out.size(), 8), '\0');
+    header->offsets[section] = out.size();
+    header->counts[section] = count;
+    out.append((const char*)data, bytes);
+}
+
+template <typename T>
+static void putRecords(std::string& out, SnapshotHeader *header, SnapshotSection section, const std::vector<T>& records)
+{
+    putSection(out, header, section, records.data(), records.size() * sizeof(T), records.size());
+}
+
+/*
+    everything of a record before its image: the processes and segments of state, then the
+    given mappings, huge pages, frames and frame changes. Sets the offsets, counts and image
+    offset of header, which the caller copies in front once it has set the length
+*/
+static std::string encodeRecord(SnapshotHeader *header, const SnapshotState& state, const std::vector<SnapshotMapping>& mappings,
+                                const std::vector<SnapshotHuge>& huge, const std::vector<SnapshotFrame>& frames,
+                                const std::vector<SnapshotFrameChange>& changes)
+{
+    std::string out(sizeof(*header), '\0');
+    std::string names;
+    for (size_t i = 0; i < state.names.size(); i++)
+    {
+        uint32_t size = state.names[i].size();
+        names.append((const char*)&size, sizeof(size));
+        names += state.names[i];
+    }
+    putSection(out, header, SecNames, names.data(), names.size(), state.names.size());
+    putRecords(out, header, SecProcesses, state.processes);
+    putRecords(out, header, SecVariables, state.variables);
+    putRecords(out, header, SecHoles, state.holes);
+    putRecords(out, header, SecSegments, state.segments);
+    putRecords(out, header, SecSegmentFrames, state.segment_frames);
+    putRecords(out, header, SecAttachments, state.attachments);
+    putRecords(out, header, SecMappings, mappings);
+    putRecords(out, header, SecHuge, huge);
+    putRecords(out, header, SecFrames, frames);
+    putRecords(out, header, SecFrameChanges, changes);
+    header->image_offset = alignUp(out.size(), SNAPSHOT_ALIGN);
+    return out;
+}
+
+static bool bySegmentId(const std::pair<uint32_t, Segment>& a, const std::pair<uint32_t, Segment>& b)
+{
+    return a.second.id < b.second.id;
+}
+
+// Takes everything a snapshot holds besides memory from the simulator (frames a shard has
+// cached must have been handed back first)
+static void captureState(Mmu *mmu, PageTable *page_table, SnapshotState *state)
+{
+    SnapshotHeader& header = state->header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+    header.version = SNAPSHOT_VERSION;
+    header.page_size = page_table->getPageSize();
+    header.num_frames = page_table->numFrames();
+    PhysicalMemory *physical = page_table->physicalMemory();
+    header.memory_size = (physical != NULL) ? physical->size() : (uint64_t)header.num_frames * header.page_size;
+    header.virtual_size = mmu->virtualSize();
+    header.first_pid = mmu->firstPid();
+    header.next_pid = mmu->nextPid();
+
+    for (uint32_t i = 0; i < mmu->numNames(); i++)
+    {
+        state->names.push_back(mmu->getName(i));
+    }
+    std::vector<uint32_t> pids = mmu->getPids();
+    for (size_t i = 0; i < pids.size(); i++)
+    {
+        std::vector<Variable*> vars = mmu->getAllVars(pids[i]);
+        const std::map<uint64_t, uint64_t>& free = mmu->getHoles(pids[i]);
+        SnapshotProcess process = {pids[i], (uint32_t)vars.size(), (uint32_t)free.size(), 0};
+        state->processes.push_back(process);
+        for (size_t j = 0; j < vars.size(); j++)
+        {
+            SnapshotVariable var = {vars[j]->virtual_address, vars[j]->size, vars[j]->name, vars[j]->type, vars[j]->flags, vars[j]->padding};
+            state->variables.push_back(var);
+        }
+        for (std::map<uint64_t, uint64_t>::const_iterator it = free.begin(); it != free.end(); it++)
+        {
+            SnapshotHole hole = {it->first, it->second};
+            state->holes.push_back(hole);
+        }
+    }
+
+    std::vector<std::pair<uint32_t, Segment>> live = mmu->getSegments();
+    std::sort(live.begin(), live.end(), bySegmentId);
+    for (size_t i = 0; i < live.size(); i++)
+    {
+        const std::vector<int32_t>& frames = page_table->segmentFrames(live[i].second.id);
+        const std::vector<uint32_t>& attached = live[i].second.pids;
+        SnapshotSegment segment = {live[i].first, (uint32_t)frames.size(), live[i].second.size, (uint32_t)attached.size(), 0};
+        state->segments.push_back(segment);
+        state->segment_frames.insert(state->segment_frames.end(), frames.begin(), frames.end());
+        state->attachments.insert(state->attachments.end(), attached.begin(), attached.end());
+    }
+
+    std::vector<std::pair<PageKey, int>> entries;
+    std::vector<std::pair<PageKey, PageTableHuge*>> huge_pages;
+    page_table->collectMappings(entries, huge_pages);
+    state->mappings.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        SnapshotMapping mapping = {entries[i].first, entries[i].second, 0};
+        state->mappings[i] = mapping;
+    }
+    state->huge.resize(huge_pages.size());
+    for (size_t i = 0; i < huge_pages.size(); i++)
+    {
+        SnapshotHuge& huge = state->huge[i];
+        huge.key = huge_pages[i].first;
+        huge.frame = huge_pages[i].second->frame;
+        huge.used = huge_pages[i].second->used;
+        memcpy(huge.mapped, huge_pages[i].second->mapped, sizeof(huge.mapped));
+    }
+
+    state->frames.resize(header.num_frames);
+    for (uint32_t f = 0; f < header.num_frames; f++)
+    {
+        bool used;
+        bool shared;
+        page_table->frameState(f, &state->frames[f].refs, &used, &shared);
+        state->frames[f].used = used;
+        state->frames[f].shared = shared;
+        state->frames[f].reserved = 0;
+    }
+}
+
+static void describeState(const SnapshotState& state, SnapshotInfo *info)
+{
+    info->processes = state.processes.size();
+    info->pages = state.mappings.size();
+    for (size_t i = 0; i < state.huge.size(); i++)
+    {
+        info->pages += state.huge[i].used;
+    }
+    info->sequence = state.header.sequence;
+}
+
+/*
+    file: where to write a full snapshot of state (replaced whole: written aside, then
+    renamed over it)
+    the pages of the frames in use come from memory, or if that is NULL from chain; info
+    gets what was written
+*/
+static const char* writeFull(std::string file, SnapshotState& state, const uint8_t *memory, const SnapshotChain *chain,
+                             SnapshotInfo *info)
+{
+    SnapshotHeader& header = state.header;
+    header.sequence = 0;
+    std::string out = encodeRecord(&header, state, state.mappings, state.huge, state.frames, std::vector<SnapshotFrameChange>());
+    header.length = header.image_offset + alignUp(header.memory_size, SNAPSHOT_ALIGN);
+    memcpy(&out[0], &header, sizeof(header));
+    std::vector<uint32_t> used;
+    for (uint32_t f = 0; f < header.num_frames; f++)
+    {
+        if (state.frames[f].used)
+        {
+            used.push_back(f);
+        }
+    }
+
+    // the image only gets the frames in use; the file is then extended over the rest,
+    // which reads back as zeros without taking up disk
+    std::string temp = file + ".tmp";
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return "cannot create the snapshot file";
+    }
+    bool ok = writeAll(fd, out.data(), out.size(), 0) &&
+              writePages(fd, header.image_offset, false, used, header.page_size, memory, chain) &&
+              ftruncate(fd, header.length) == 0;
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(temp.c_str(), file.c_str()) != 0)
+    {
+        unlink(temp.c_str());
+        return "writing the snapshot file failed";
+    }
+    describeState(state, info);
+    info->image_bytes = used.size() * (uint64_t)header.page_size;
+    return NULL;
+}
+
+// Makes file, ending at end with a record as of state, the one the next checkpoint appends
+// to, and starts tracking changes afresh (state is taken over)
+static void rememberChain(std::string file, PageTable *page_table, uint64_t end, SnapshotState& state)
+{
+    struct stat info;
+    last_checkpoint.page_table = NULL;
+    if (stat(file.c_str(), &info) == 0)
+    {
+        last_checkpoint.file = file;
+        last_checkpoint.page_table = page_table;
+        last_checkpoint.device = info.st_dev;
+        last_checkpoint.inode = info.st_ino;
+        last_checkpoint.end = end;
+        std::swap(last_checkpoint.state, state);
+    }
+    page_table->clearDirty();
+}
+
+// Whether file is still as the last save, checkpoint or load of page_table left it
+static bool continuesChain(std::string file, PageTable *page_table)
+{
+    struct stat info;
+    return last_checkpoint.page_table == page_table && last_checkpoint.file == file && stat(file.c_str(), &info) == 0 &&
+           info.st_dev == last_checkpoint.device && info.st_ino == last_checkpoint.inode &&
+           (uint64_t)info.st_size == last_checkpoint.end;
+}
+
+/*
+    file: where to write the snapshot (replaced whole: written aside, then renamed over it)
+    saves every process with its variables and holes, the shared memory segments, every page
+    mapping and frame, and the memory image; info gets what was saved
+*/
+const char* saveSnapshot(std::string file, Mmu *mmu, PageTable *page_table, void *memory, SnapshotInfo *info)
+{
+    if (page_table->swapEnabled())
+    {
+        return "snapshots are not supported with swap";
+    }
+    // frames a shard has cached are free as far as the snapshot is concerned
+    page_table->drainFrameCaches();
+    SnapshotState state;
+    captureState(mmu, page_table, &state);
+    const char *error = writeFull(file, state, (const uint8_t*)memory, NULL, info);
+    if (error == NULL)
+    {
+        rememberChain(file, page_table, state.header.length, state);
+    }
+    return error;
+}
+
+/*
+    file: snapshot this simulator last saved, checkpointed to or loaded (any other file gets
+    a full snapshot, as from saveSnapshot)
+    appends a record of what changed since: the pages of the frames written, moved or freed,
+    the frames and mappings whose state changed, and the processes and segments; info gets
+    what was written
+*/
+const char* checkpointSnapshot(std::string file, Mmu *mmu, PageTable *page_table, void *memory, SnapshotInfo *info)
+{
+    if (page_table->swapEnabled() || !continuesChain(file, page_table))
+    {
+        return saveSnapshot(file, mmu, page_table, memory, info);
+    }
+    page_table->drainFrameCaches();
+    SnapshotState state;
+    captureState(mmu, page_table, &state);
+    const SnapshotState& base = last_checkpoint.state;
+    SnapshotHeader& header = state.header;
+    header.sequence = base.header.sequence + 1;
+
+    std::vector<SnapshotMapping> mappings;
+    std::vector<SnapshotHuge> huge;
+    diffRecords(base.mappings, state.mappings, mappings);
+    diffRecords(base.huge, state.huge, huge);
+    // a frame taken into use carries its page even if never written: it holds whatever was
+    // left in it, which the chain would otherwise read back as zeros
+    std::vector<SnapshotFrameChange> changes;
+    std::vector<uint32_t> pages;
+    for (uint32_t f = 0; f < header.num_frames; f++)
+    {
+        const SnapshotFrame& now = state.frames[f];
+        const SnapshotFrame& before = base.frames[f];
+        bool dirty = page_table->frameDirty(f);
+        if (dirty || memcmp(&now, &before, sizeof(now)) != 0)
+        {
+            bool data = now.used && (dirty || !before.used);
+            SnapshotFrameChange change = {f, now.refs, now.used, now.shared, data, 0};
+            changes.push_back(change);
+            if (data)
+            {
+                pages.push_back(f);
+            }
+        }
+    }
+    std::string out = encodeRecord(&header, state, mappings, huge, std::vector<SnapshotFrame>(), changes);
+    header.length = header.image_offset + alignUp(pages.size() * (uint64_t)header.page_size, SNAPSHOT_ALIGN);
+    memcpy(&out[0], &header, sizeof(header));
+
+    // the header goes in last, so a record cut short never reads back as a whole one; on
+    // failure the file is cut back to how it was
+    uint64_t offset = last_checkpoint.end;
+    int fd = open(file.c_str(), O_WRONLY);
+    if (fd < 0)
+    {
+        return "cannot open the snapshot file";
+    }
+    bool ok = writeAll(fd, out.data() + sizeof(header), out.size() - sizeof(header), offset + sizeof(header)) &&
+              writePages(fd, offset + header.image_offset, true, pages, header.page_size, (const uint8_t*)memory, NULL) &&
+              ftruncate(fd, offset + header.length) == 0 && writeAll(fd, &header, sizeof(header), offset);
+    if (!ok && ftruncate(fd, offset) != 0)
+    {
+        last_checkpoint.page_table = NULL;
+    }
+    ok = (close(fd) == 0) && ok;
+    if (!ok)
+    {
+        return "writing the snapshot file failed";
+    }
+    describeState(state, info);
+    info->image_bytes = pages.size() * (uint64_t)header.page_size;
+    rememberChain(file, page_table, offset + header.length, state);
+    return NULL;
+}
+
+// Puts the chain's pages into memory: maps the full snapshot's image, then reads in (or
+// zeroes) the frames the checkpoints changed
+static bool restorePages(const SnapshotChain& chain, PageTable *page_table, void *memory)
+{
+    const SnapshotHeader& header = chain.state.header;
+    PhysicalMemory *physical = page_table->physicalMemory();
+    if (physical != NULL)
+    {
+        if (!physical->mapImage(chain.fd, chain.base_image))
+        {
+            return false;
+        }
+    }
+    else if (pread(chain.fd, memory, header.memory_size, chain.base_image) != (ssize_t)header.memory_size)
+    {
+        return false;
+    }
+    uint32_t f = 0;
+    while (f < header.num_frames)
+    {
+        if (chain.sources[f] == chain.base_image + (uint64_t)f * header.page_size)
+        {
+            f++;
+            continue;
+        }
+        uint32_t end = f + 1;
+        while (end < header.num_frames && chain.sources[end] != chain.base_image + (uint64_t)end * header.page_size)
+        {
+            end++;
+        }
+        if (!readPages(chain, f, end - f, (uint8_t*)memory + (uint64_t)f * header.page_size))
+        {
+            return false;
+        }
+        f = end;
+    }
+    return true;
+}
+
+// Replaces the whole state of the Mmu and page table with a snapshot's
+static void restoreState(const SnapshotState& state, Mmu *mmu, PageTable *page_table)
+{
+    const SnapshotHeader& header = state.header;
+    page_table->clear();
+    mmu->clear();
+    std::vector<uint32_t> names(state.names.size());
+    for (size_t i = 0; i < state.names.size(); i++)
+    {
+        names[i] = mmu->internName(state.names[i]);
+    }
+
+    for (uint32_t f = 0; f < header.num_frames; f++)
+    {
+        page_table->restoreFrame(f, state.frames[f].refs, state.frames[f].used != 0, state.frames[f].shared != 0);
+    }
+    for (size_t i = 0; i < state.mappings.size(); i++)
+    {
+        page_table->restoreMapping(state.mappings[i].key, state.mappings[i].frame);
+    }
+    for (size_t i = 0; i < state.huge.size(); i++)
+    {
+        PageTableHuge page;
+        page.frame = state.huge[i].frame;
+        page.used = state.huge[i].used;
+        memcpy(page.mapped, state.huge[i].mapped, sizeof(page.mapped));
+        page_table->restoreHuge(state.huge[i].key, page);
+    }
+
+    mmu->reservePids(header.next_pid - mmu->nextPid());
+    page_table->reservePids(header.next_pid);
+    const SnapshotVariable *vars = state.variables.data();
+    const SnapshotHole *holes = state.holes.data();
+    for (size_t i = 0; i < state.processes.size(); i++)
+    {
+        uint32_t pid = state.processes[i].pid;
+        mmu->createProcess(pid);
+        for (uint32_t j = 0; j < state.processes[i].num_variables; j++, vars++)
+        {
+            mmu->addVariableToProcess(pid, names[vars->name], (DataType)vars->type, vars->size, vars->virtual_address, vars->flags,
+                                      vars->padding);
+        }
+        std::vector<std::pair<uint64_t, uint64_t>> free;
+        for (uint32_t j = 0; j < state.processes[i].num_holes; j++, holes++)
+        {
+            free.push_back(std::make_pair(holes->address, holes->size));
+        }
+        mmu->restoreHoles(pid, free);
+    }
+
+    const int32_t *segment_frames = state.segment_frames.data();
+    const uint32_t *attachments = state.attachments.data();
+    for (size_t i = 0; i < state.segments.size(); i++)
+    {
+        Segment segment;
+        segment.id = page_table->restoreSegment(segment_frames, state.segments[i].num_frames);
+        segment.size = state.segments[i].size;
+        segment.pids.assign(attachments, attachments + state.segments[i].num_pids);
+        mmu->restoreSegment(names[state.segments[i].name], segment);
+        segment_frames += state.segments[i].num_frames;
+        attachments += state.segments[i].num_pids;
+    }
+}
+
+/*
+    file: snapshot written by saveSnapshot (and checkpointSnapshot) with the same page size,
+    memory size and virtual address space size
+    replaces the whole state of the Mmu and page table with the one as of the file's last
+    checkpoint; the full snapshot's memory image is mapped over physical memory (copied in
+    when there is no PhysicalMemory) and the pages checkpoints changed read in over it.
+    info gets what was restored
+*/
+const char* loadSnapshot(std::string file, Mmu *mmu, PageTable *page_table, void *memory, SnapshotInfo *info)
+{
+    if (page_table->swapEnabled())
+    {
+        return "snapshots are not supported with swap";
+    }
+    SnapshotChain chain;
+    const char *error = readChain(file, &chain);
+    if (error != NULL)
+    {
+        return error;
+    }
+    const SnapshotHeader& header = chain.state.header;
+    PhysicalMemory *physical = page_table->physicalMemory();
+    uint64_t memory_size = (physical != NULL) ? physical->size() : (uint64_t)page_table->numFrames() * page_table->getPageSize();
+    if (header.page_size != (uint32_t)page_table->getPageSize() || header.num_frames != page_table->numFrames() ||
+        header.memory_size != memory_size || header.virtual_size != mmu->virtualSize() || header.first_pid != mmu->firstPid())
+    {
+        error = "the snapshot was taken with another page size, memory size or virtual address space";
+    }
+    else if (!chain.state.huge.empty() && !page_table->hugePagesEnabled())
+    {
+        error = "the snapshot has huge pages, huge page promotion must be on to load it";
+    }
+    else if (!restorePages(chain, page_table, memory))
+    {
+        error = "cannot map the snapshot's memory image";
+    }
+    close(chain.fd);
+    if (error != NULL)
+    {
+        return error;
+    }
+
+    restoreState(chain.state, mmu, page_table);
+    describeState(chain.state, info);
+    info->image_bytes = 0;
+    for (uint32_t f = 0; f < header.num_frames; f++)
+    {
+        info->image_bytes += chain.state.frames[f].used ? header.page_size : 0;
+    }
+    rememberChain(file, page_table, chain.end, chain.state);
+    return NULL;
+}
+
+/*
+    chain_file: snapshot file with checkpoints appended to it
+    out_file: where to write a full snapshot of the state as of its last checkpoint (may be
+    chain_file itself); info gets what was written, with the sequence of the last checkpoint
+*/
+const char* mergeSnapshot(std::string chain_file, std::string out_file, SnapshotInfo *info)
+{
+    SnapshotChain chain;
+    const char *error = readChain(chain_file, &chain);
+    if (error != NULL)
+    {
+        return error;
+    }
+    uint32_t sequence = chain.state.header.sequence;
+    error = writeFull(out_file, chain.state, NULL, &chain, info);
+    close(chain.fd);
+    info->sequence = sequence;
+    return error;
+}
+
+bool readSnapshotHeader(std::string file, SnapshotHeader *header)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool ok = pread(fd, header, sizeof(*header), 0) == (ssize_t)sizeof(*header) &&
+              memcmp(header->magic, SNAPSHOT_MAGIC, 4) == 0 && header->version == SNAPSHOT_VERSION;
+    close(fd);
+    return ok;
+}
+
+// The processes of a snapshot as of its last checkpoint, their variables and the pid the
+// next create would get
+bool listSnapshot(std::string file, uint32_t *next_pid, std::vector<uint32_t>& pids, std::vector<SnapshotListing>& variables)
+{
+    SnapshotChain chain;
+    if (readChain(file, &chain) != NULL)
+    {
+        return false;
+    }
+    close(chain.fd);
+    const SnapshotState& state = chain.state;
+    const SnapshotVariable *vars = state.variables.data();
+    for (size_t i = 0; i < state.processes.size(); i++)
+    {
+        pids.push_back(state.processes[i].pid);
+        for (uint32_t j = 0; j < state.processes[i].num_variables; j++, vars++)
+        {
+            SnapshotListing listing = {state.processes[i].pid, state.names[vars->name], (DataType)vars->type};
+            variables.push_back(listing);
+        }
+    }
+    *next_pid = state.header.next_pid;
+    return true;
+}
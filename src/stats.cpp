@@ -0,0 +1,180 @@
+#include "stats.h"
+#include <cstring>
+
+thread_local CommandStats command_stats;
+
+CommandStats::CommandStats()
+{
+    memset(_counts, 0, sizeof(_counts));
+    _timing = false;
+}
+
+void CommandStats::enableTiming(bool timing)
+{
+    _timing = timing;
+}
+
+bool CommandStats::timing()
+{
+    return _timing;
+}
+
+void CommandStats::record(CommandType type, uint64_t nanoseconds)
+{
+    _counts[type]++;
+    if (_timing)
+    {
+        _latency[type].record(nanoseconds);
+    }
+}
+
+// Add another thread's counts and latencies, then the other side can be cleared
+void CommandStats::merge(const CommandStats& other)
+{
+    for (int i = 0; i < CmdCount; i++)
+    {
+        _counts[i] += other._counts[i];
+        _latency[i].merge(other._latency[i]);
+    }
+}
+
+void CommandStats::clear()
+{
+    memset(_counts, 0, sizeof(_counts));
+    for (int i = 0; i < CmdCount; i++)
+    {
+        _latency[i] = LatencyHistogram();
+    }
+}
+
+void CommandStats::print()
+{
+    std::cout << "Commands:" << std::endl;
+    for (int i = 0; i < CmdCount; i++)
+    {
+        if (_counts[i] == 0)
+        {
+            continue;
+        }
+        char line[160];
+        if (_timing && _latency[i].count() > 0)
+        {
+            snprintf(line, sizeof(line), "  %-10s %10llu   p50 %9.1f us   p99 %9.1f us   max %9.1f us\n",
+                     commandTypeName((CommandType)i), (unsigned long long)_counts[i], _latency[i].percentile(50) / 1000.0,
+                     _latency[i].percentile(99) / 1000.0, _latency[i].max() / 1000.0);
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "  %-10s %10llu\n", commandTypeName((CommandType)i), (unsigned long long)_counts[i]);
+        }
+        std::cout << line;
+    }
+    if (!_timing)
+    {
+        std::cout << "  (latency not tracked, start with --latency)" << std::endl;
+    }
+}
+
+// One line per entry point that was timed: p50, p99 and max in nanoseconds
+static void printLatency(const char *entry_point, LatencyHistogram& latency)
+{
+    if (latency.count() == 0)
+    {
+        return;
+    }
+    char line[160];
+    snprintf(line, sizeof(line), "  latency    %-18s p50 %8llu ns   p99 %8llu ns   max %8llu ns\n", entry_point,
+             (unsigned long long)latency.percentile(50), (unsigned long long)latency.percentile(99),
+             (unsigned long long)latency.max());
+    std::cout << line;
+}
+
+/*
+    print stats: command counts/latency, frame and page table usage, entry point call
+    counts (and latencies with --latency) and fragmentation of the live processes
+*/
+void printStats(Mmu *mmu, PageTable *page_table)
+{
+    command_stats.print();
+
+    char line[160];
+    PageTableStats pt = page_table->getStats();
+    uint32_t frames = page_table->numFrames();
+    uint32_t free_frames = page_table->numFreeFrames();
+    std::cout << "Page table:" << std::endl;
+    snprintf(line, sizeof(line), "  frames     %u mapped / %u free (of %u)\n", frames - free_frames, free_frames, frames);
+    std::cout << line;
+    snprintf(line, sizeof(line), "  entries    %u\n", page_table->numEntries());
+    std::cout << line;
+    snprintf(line, sizeof(line), "  tree       %d levels, %u nodes (%llu KB) over %llu MB of virtual space per process\n",
+             page_table->numLevels(), page_table->numNodes(), (unsigned long long)(page_table->nodeBytes() >> 10),
+             (unsigned long long)(mmu->virtualSize() >> 20));
+    std::cout << line;
+    snprintf(line, sizeof(line), "  calls      addEntry %llu (%llu out of frames), getPhysicalAddress %llu, removeEntry %llu\n",
+             (unsigned long long)pt.adds, (unsigned long long)pt.failed_adds, (unsigned long long)pt.translations,
+             (unsigned long long)pt.removes);
+    std::cout << line;
+    if (command_stats.timing())
+    {
+        PageTableLatency latency = page_table->getLatency();
+        printLatency("addEntry", latency.add);
+        printLatency("getPhysicalAddress", latency.translate);
+        printLatency("removeEntry", latency.remove);
+    }
+    page_table->printPaging();
+    page_table->printSharing();
+    page_table->printHuge();
+    PhysicalMemory *physical = page_table->physicalMemory();
+    if (physical != NULL)
+    {
+        static const char *backing[] = {"4K pages", "transparent huge pages", "hugetlbfs"};
+        snprintf(line, sizeof(line), "  memory     %llu KB mapped on %s, %llu KB resident, %llu KB discarded in %llu calls\n",
+                 (unsigned long long)(physical->size() >> 10), backing[physical->hugePages()],
+                 (unsigned long long)(physical->residentBytes() >> 10), (unsigned long long)(physical->discardedBytes() >> 10),
+                 (unsigned long long)physical->discards());
+        std::cout << line;
+    }
+
+    MmuStats mm = mmu->getStats();
+    std::cout << "Mmu:" << std::endl;
+    snprintf(line, sizeof(line), "  processes  %u, %llu bytes in use\n", mmu->numProcesses(), (unsigned long long)mmu->bytesUsed());
+    std::cout << line;
+    if (mm.segments > 0)
+    {
+        snprintf(line, sizeof(line), "  shared     %llu segments (%llu KB), %llu attachments, %llu KB of physical memory saved\n",
+                 (unsigned long long)mm.segments, (unsigned long long)(mm.segment_bytes >> 10),
+                 (unsigned long long)mm.attachments, (unsigned long long)(mm.segment_bytes_saved >> 10));
+        std::cout << line;
+    }
+    snprintf(line, sizeof(line), "  calls      placeVariable %llu, getVariable %llu, removeVariable %llu, mergeFreeSpace %llu\n",
+             (unsigned long long)mm.placements, (unsigned long long)mm.lookups, (unsigned long long)mm.removals,
+             (unsigned long long)mm.merges);
+    std::cout << line;
+    if (command_stats.timing())
+    {
+        MmuLatency latency = mmu->getLatency();
+        printLatency("placeVariable", latency.place);
+        printLatency("getVariable", latency.lookup);
+        printLatency("removeVariable", latency.remove);
+        printLatency("mergeFreeSpace", latency.merge);
+    }
+
+    std::cout << "Fragmentation:" << std::endl;
+    snprintf(line, sizeof(line), "  internal   %llu bytes of page-boundary padding in %llu live variables\n",
+             (unsigned long long)mm.padding_bytes, (unsigned long long)mm.padded_variables);
+    std::cout << line;
+    if (mm.aligned_allocations > 0)
+    {
+        snprintf(line, sizeof(line), "  alignment  %llu bytes skipped to align %llu huge page variables or shared segments (kept as holes)\n",
+                 (unsigned long long)mm.alignment_bytes, (unsigned long long)mm.aligned_allocations);
+        std::cout << line;
+    }
+    snprintf(line, sizeof(line), "  external   %llu holes, %llu bytes free, largest %llu, average %llu\n",
+             (unsigned long long)mm.holes, (unsigned long long)mm.hole_bytes, (unsigned long long)mm.largest_hole,
+             (unsigned long long)(mm.holes > 0 ? mm.hole_bytes / mm.holes : 0));
+    std::cout << line;
+    snprintf(line, sizeof(line), "  compaction %llu runs, %llu frames reclaimed, %llu bytes moved\n",
+             (unsigned long long)mm.compactions, (unsigned long long)mm.frames_reclaimed,
+             (unsigned long long)mm.compaction_bytes);
+    std::cout << line;
+}
@@ -0,0 +1,67 @@
+#include "swapfile.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+SwapFile::SwapFile(std::string path, int page_size, uint32_t num_slots)
+{
+    _path = path;
+    _page_size = page_size;
+    _num_slots = num_slots;
+    _next_slot = 0;
+    _fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+}
+
+SwapFile::~SwapFile()
+{
+    if (_fd >= 0)
+    {
+        close(_fd);
+        unlink(_path.c_str());
+    }
+}
+
+bool SwapFile::isOpen()
+{
+    return _fd >= 0;
+}
+
+// Returns a free slot, or -1 once every slot holds a page
+int32_t SwapFile::allocate()
+{
+    if (!_free_slots.empty())
+    {
+        uint32_t slot = _free_slots.back();
+        _free_slots.pop_back();
+        return slot;
+    }
+    if (_next_slot == _num_slots)
+    {
+        return -1;
+    }
+    return _next_slot++;
+}
+
+void SwapFile::release(uint32_t slot)
+{
+    _free_slots.push_back(slot);
+}
+
+bool SwapFile::write(uint32_t slot, const void *data)
+{
+    return pwrite(_fd, data, _page_size, (off_t)slot * _page_size) == _page_size;
+}
+
+bool SwapFile::read(uint32_t slot, void *data)
+{
+    return pread(_fd, data, _page_size, (off_t)slot * _page_size) == _page_size;
+}
+
+uint32_t SwapFile::numSlots()
+{
+    return _num_slots;
+}
+
+uint32_t SwapFile::numUsed()
+{
+    return _next_slot - _free_slots.size();
+}
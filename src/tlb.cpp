@@ -0,0 +1,257 @@
+#include "tlb.h"
+
+Tlb::Tlb(TlbConfig config)
+{
+    _config = config;
+    _ways = (config.ways == 0 || config.ways > config.entries) ? config.entries : config.ways;
+    _num_sets = (_ways == 0) ? 0 : config.entries / _ways;
+    _entries.assign(_num_sets * _ways, TlbEntry());
+    _clock = 0;
+    _random_state = 2463534242u;
+    _current_pid = 0;
+    _hits = 0;
+    _misses = 0;
+    _evictions = 0;
+    _flushes = 0;
+    _huge_hits = 0;
+}
+
+Tlb::~Tlb()
+{
+}
+
+TlbConfig Tlb::defaultConfig()
+{
+    TlbConfig config;
+    config.entries = 64;
+    config.ways = 4;
+    config.policy = TlbPolicy::Lru;
+    config.asid = true;
+    config.huge_shift = 0;
+    return config;
+}
+
+uint32_t Tlb::setIndex(uint32_t pid, uint64_t page)
+{
+    // mix in the pid so page 0 of every process doesn't land in the same set, and fold
+    // the high half of the page number so far-apart regions don't all share set 0
+    return ((uint32_t)(page ^ (page >> 32)) ^ (pid * 2654435761u)) % _num_sets;
+}
+
+// Without ASID tags the whole TLB belongs to one address space at a time
+void Tlb::contextSwitch(uint32_t pid)
+{
+    if (!_config.asid && pid != _current_pid)
+    {
+        flushAll();
+        _current_pid = pid;
+    }
+}
+
+// Valid entry of the set for (pid, page) that caches a base page, or with huge set the huge
+// page numbered page; NULL if there is none
+TlbEntry* Tlb::find(uint32_t pid, uint64_t page, bool huge)
+{
+    TlbEntry *set = &_entries[setIndex(pid, page) * _ways];
+    for (uint32_t i = 0; i < _ways; i++)
+    {
+        if (set[i].valid && set[i].page == page && set[i].pid == pid && set[i].huge == huge)
+        {
+            return &set[i];
+        }
+    }
+    return NULL;
+}
+
+bool Tlb::lookup(uint32_t pid, uint64_t page, int32_t *frame)
+{
+    if (_num_sets == 0)
+    {
+        return false;
+    }
+    contextSwitch(pid);
+
+    // an entry for the base page itself, else one for the huge page around it
+    TlbEntry *entry = find(pid, page, false);
+    if (entry == NULL && _config.huge_shift > 0)
+    {
+        entry = find(pid, page >> _config.huge_shift, true);
+    }
+    if (entry == NULL)
+    {
+        _misses++;
+        return false;
+    }
+    entry->last_used = ++_clock;
+    *frame = entry->frame;
+    if (entry->huge)
+    {
+        *frame += page & ((1ull << _config.huge_shift) - 1);
+        _huge_hits++;
+    }
+    _hits++;
+    return true;
+}
+
+void Tlb::insert(uint32_t pid, uint64_t page, int32_t frame)
+{
+    if (_num_sets == 0)
+    {
+        return;
+    }
+    contextSwitch(pid);
+    fill(pid, page, frame, false);
+}
+
+// page: any base page of a huge page, frame: the huge page's first frame
+void Tlb::insertHuge(uint32_t pid, uint64_t page, int32_t frame)
+{
+    if (_num_sets == 0)
+    {
+        return;
+    }
+    contextSwitch(pid);
+    fill(pid, page >> _config.huge_shift, frame, true);
+}
+
+void Tlb::fill(uint32_t pid, uint64_t page, int32_t frame, bool huge)
+{
+    TlbEntry *set = &_entries[setIndex(pid, page) * _ways];
+    TlbEntry *victim = NULL;
+    for (uint32_t i = 0; i < _ways && victim == NULL; i++)
+    {
+        if (!set[i].valid || (set[i].page == page && set[i].pid == pid && set[i].huge == huge))
+        {
+            victim = &set[i];
+        }
+    }
+    if (victim == NULL)
+    {
+        if (_config.policy == TlbPolicy::Random)
+        {
+            _random_state ^= _random_state << 13;
+            _random_state ^= _random_state >> 17;
+            _random_state ^= _random_state << 5;
+            victim = &set[_random_state % _ways];
+        }
+        else
+        {
+            victim = &set[0];
+            for (uint32_t i = 1; i < _ways; i++)
+            {
+                if (set[i].last_used < victim->last_used)
+                {
+                    victim = &set[i];
+                }
+            }
+        }
+        _evictions++;
+    }
+
+    victim->pid = pid;
+    victim->page = page;
+    victim->frame = frame;
+    victim->valid = true;
+    victim->huge = huge;
+    victim->last_used = ++_clock;
+}
+
+// Drops the translation of the page, whether cached for the page or for its huge page
+void Tlb::invalidate(uint32_t pid, uint64_t page)
+{
+    if (_num_sets == 0)
+    {
+        return;
+    }
+    TlbEntry *entry = find(pid, page, false);
+    if (entry != NULL)
+    {
+        entry->valid = false;
+    }
+    if (_config.huge_shift > 0 && (entry = find(pid, page >> _config.huge_shift, true)) != NULL)
+    {
+        entry->valid = false;
+    }
+}
+
+void Tlb::flush(uint32_t pid)
+{
+    for (size_t i = 0; i < _entries.size(); i++)
+    {
+        if (_entries[i].pid == pid)
+        {
+            _entries[i].valid = false;
+        }
+    }
+    _flushes++;
+}
+
+void Tlb::flushAll()
+{
+    for (size_t i = 0; i < _entries.size(); i++)
+    {
+        _entries[i].valid = false;
+    }
+    _flushes++;
+}
+
+void Tlb::print()
+{
+    uint64_t lookups = _hits + _misses;
+    double hit_rate = (lookups == 0) ? 0.0 : (100.0 * _hits) / lookups;
+
+    // entries is rounded down to whole sets
+    std::cout << "TLB: " << _num_sets * _ways << " entries, " << _ways << "-way, "
+              << (_config.policy == TlbPolicy::Lru ? "LRU" : "random") << " replacement, ASID "
+              << (_config.asid ? "on" : "off") << std::endl;
+    char rate[32];
+    snprintf(rate, sizeof(rate), "%.2f%%", hit_rate);
+    std::cout << "  hits:      " << _hits << std::endl;
+    std::cout << "  misses:    " << _misses << std::endl;
+    std::cout << "  evictions: " << _evictions << std::endl;
+    std::cout << "  flushes:   " << _flushes << std::endl;
+    if (_config.huge_shift > 0)
+    {
+        std::cout << "  huge hits: " << _huge_hits << std::endl;
+    }
+    std::cout << "  hit rate:  " << rate << std::endl;
+}
+
+uint64_t Tlb::getHits()
+{
+    return _hits;
+}
+
+uint64_t Tlb::getMisses()
+{
+    return _misses;
+}
+
+uint64_t Tlb::getEvictions()
+{
+    return _evictions;
+}
+
+// Base pages the valid entries translate (a huge page entry covers all of its base pages)
+uint64_t Tlb::reachPages()
+{
+    uint64_t pages = 0;
+    for (size_t i = 0; i < _entries.size(); i++)
+    {
+        if (_entries[i].valid)
+        {
+            pages += _entries[i].huge ? (1ull << _config.huge_shift) : 1;
+        }
+    }
+    return pages;
+}
+
+uint32_t Tlb::numValid()
+{
+    uint32_t valid = 0;
+    for (size_t i = 0; i < _entries.size(); i++)
+    {
+        valid += _entries[i].valid;
+    }
+    return valid;
+}
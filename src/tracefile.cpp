@@ -0,0 +1,966 @@
+#include "tracefile.h"
+#include "stats.h"
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static void putVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+static void putZigzag(std::string& out, int64_t value)
+{
+    putVarint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static void putRaw(std::string& out, const void *data, size_t size)
+{
+    out.append((const char*)data, size);
+}
+
+// Bounds-checked cursor over the mapped trace, `ok` turns false once a read runs past the end
+typedef struct TraceReader {
+    const uint8_t *pos;
+    const uint8_t *end;
+    bool ok;
+
+    uint64_t varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (pos == end)
+            {
+                ok = false;
+                return 0;
+            }
+            uint8_t b = *pos++;
+            value |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+            {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    int64_t zigzag()
+    {
+        uint64_t value = varint();
+        return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+    }
+
+    uint8_t byte()
+    {
+        if (pos == end)
+        {
+            ok = false;
+            return 0;
+        }
+        return *pos++;
+    }
+
+    void raw(void *data, size_t size)
+    {
+        if ((size_t)(end - pos) < size)
+        {
+            ok = false;
+            pos = end;
+            return;
+        }
+        memcpy(data, pos, size);
+        pos += size;
+    }
+} TraceReader;
+
+// Id of name in the trace's name table, adding it if it is new
+static uint32_t traceName(const std::string& name, std::vector<std::string>& names, std::unordered_map<std::string, uint32_t>& name_ids)
+{
+    std::unordered_map<std::string, uint32_t>::iterator it = name_ids.find(name);
+    if (it != name_ids.end())
+    {
+        return it->second;
+    }
+    name_ids[name] = names.size();
+    names.push_back(name);
+    return names.size() - 1;
+}
+
+// Writes the pid and name id of a "<pid>:<var_name>" operand
+static void putVariableRef(std::string& body, const std::string& object, std::vector<std::string>& names, std::unordered_map<std::string, uint32_t>& name_ids)
+{
+    size_t position = object.find(":");
+    std::string var_name = (position == std::string::npos) ? "" : object.substr(position + 1);
+    putVarint(body, (uint32_t)allNums(object.substr(0, position)));
+    putVarint(body, traceName(var_name, names, name_ids));
+}
+
+// What the converter knows about the variables of a trace at a save, for the loads of it
+typedef struct TraceSnapshot {
+    std::map<std::pair<uint32_t, uint32_t>, DataType> types;
+    std::set<uint32_t> live_pids;
+    uint32_t next_pid;
+} TraceSnapshot;
+
+/*
+    text_file: trace in the prompt's command syntax
+    binary_file: where to write the compact binary form (see tracefile.h)
+    returns 0 on success
+*/
+int convertTrace(std::string text_file, std::string binary_file)
+{
+    std::ifstream in(text_file.c_str());
+    if (!in.is_open())
+    {
+        fprintf(stderr, "Error: cannot open trace file %s\n", text_file.c_str());
+        return 1;
+    }
+
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint32_t> name_ids;
+    // types of the variables that exist at each point of the trace, so set values can be
+    // stored already converted (pids follow the simulator's numbering from 1024)
+    std::map<std::pair<uint32_t, uint32_t>, DataType> types;
+    std::set<uint32_t> live_pids;       // a fork only takes a pid if its parent is alive
+    uint32_t next_pid = 1024;
+    std::map<std::string, TraceSnapshot> snapshots;     // the above as of each save in the trace
+
+    std::string body;
+    std::string line;
+    std::vector<std::string> commandSplit;
+    int line_number = 0;
+    while (std::getline(in, line))
+    {
+        line_number++;
+        splitString(line, ' ', commandSplit);
+        if (commandSplit.empty())
+        {
+            continue;
+        }
+
+        try
+        {
+            const std::string& command = commandSplit.at(0);
+            const CommandSyntax *syntax = commandSyntax(command);
+            if (syntax != NULL && commandSplit.size() < syntax->words)
+            {
+                // replays as the same usage error the text trace prints
+                body.push_back(TraceOp::OpUsage);
+                putVarint(body, command.size());
+                body += command;
+                continue;
+            }
+            uint32_t name = 0;
+            if (command == "allocate" || command == "set" || command == "free" || command == "fill" ||
+                command == "shm_attach" || command == "shm_detach")
+            {
+                name = traceName(commandSplit.at(2), names, name_ids);
+            }
+
+            if (command == "exit")
+            {
+                body.push_back(TraceOp::OpExit);
+                break;
+            }
+            else if (command == "create")
+            {
+                body.push_back(TraceOp::OpCreate);
+                putVarint(body, (uint32_t)allNums(commandSplit.at(1)));
+                putVarint(body, (uint32_t)allNums(commandSplit.at(2)));
+                live_pids.insert(next_pid);
+                next_pid++;
+            }
+            else if (command == "allocate")
+            {
+                uint32_t pid = allNums(commandSplit.at(1));
+                DataType type = parseDataType(commandSplit.at(3));
+                body.push_back(TraceOp::OpAllocate);
+                putVarint(body, pid);
+                putVarint(body, name);
+                body.push_back(type);
+                putVarint(body, (uint64_t)allNums(commandSplit.at(4)));
+                if (type != DataType::FreeSpace && pid < next_pid && types.count(std::make_pair(pid, name)) == 0)
+                {
+                    types[std::make_pair(pid, name)] = type;
+                }
+            }
+            else if (command == "set")
+            {
+                uint32_t pid = allNums(commandSplit.at(1));
+                uint64_t offset = allNums(commandSplit.at(3));
+                std::map<std::pair<uint32_t, uint32_t>, DataType>::iterator it = types.find(std::make_pair(pid, name));
+                DataType type = (it == types.end()) ? DataType::FreeSpace : it->second;
+                uint32_t count = (type == DataType::FreeSpace) ? 0 : commandSplit.size() - 4;
+
+                body.push_back(TraceOp::OpSet);
+                putVarint(body, pid);
+                putVarint(body, name);
+                putVarint(body, offset);
+                body.push_back(type);
+                putVarint(body, count);
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    const char *value = commandSplit[4 + i].c_str();
+                    if (type == DataType::Char)
+                    {
+                        body.push_back(value[0]);
+                    }
+                    else if (type == DataType::Float)
+                    {
+                        float f = strtof(value, NULL);
+                        putRaw(body, &f, sizeof(f));
+                    }
+                    else if (type == DataType::Double)
+                    {
+                        double d = strtod(value, NULL);
+                        putRaw(body, &d, sizeof(d));
+                    }
+                    else
+                    {
+                        putZigzag(body, strtoll(value, NULL, 10));
+                    }
+                }
+            }
+            else if (command == "print")
+            {
+                const std::string& object = commandSplit.at(1);
+                if ((object == "mmu" || object == "page") && commandSplit.size() > 2)
+                {
+                    uint64_t first = 0;
+                    uint64_t last = UINT64_MAX;
+                    if (commandSplit.size() > 3 && !parseRange(commandSplit.at(3), &first, &last))
+                    {
+                        first = 1;
+                        last = 0;
+                    }
+                    body.push_back((object == "mmu") ? TraceOp::OpPrintMmuRange : TraceOp::OpPrintPageRange);
+                    putVarint(body, (uint32_t)allNums(commandSplit.at(2)));
+                    putVarint(body, first);
+                    putVarint(body, last);
+                }
+                else if (object == "mmu")
+                {
+                    body.push_back(TraceOp::OpPrintMmu);
+                }
+                else if (object == "page")
+                {
+                    body.push_back(TraceOp::OpPrintPage);
+                }
+                else if (object == "processes")
+                {
+                    body.push_back(TraceOp::OpPrintProcesses);
+                }
+                else if (object == "tlb")
+                {
+                    body.push_back(TraceOp::OpPrintTlb);
+                }
+                else if (object == "stats")
+                {
+                    body.push_back(TraceOp::OpPrintStats);
+                }
+                else
+                {
+                    body.push_back(TraceOp::OpPrintVariable);
+                    putVariableRef(body, object, names, name_ids);
+                }
+            }
+            else if (command == "free")
+            {
+                uint32_t pid = allNums(commandSplit.at(1));
+                body.push_back(TraceOp::OpFree);
+                putVarint(body, pid);
+                putVarint(body, name);
+                types.erase(std::make_pair(pid, name));
+            }
+            else if (command == "terminate")
+            {
+                uint32_t pid = allNums(commandSplit.at(1));
+                body.push_back(TraceOp::OpTerminate);
+                putVarint(body, pid);
+                types.erase(types.lower_bound(std::make_pair(pid, 0u)), types.lower_bound(std::make_pair(pid + 1, 0u)));
+                live_pids.erase(pid);
+            }
+            else if (command == "fork")
+            {
+                uint32_t pid = allNums(commandSplit.at(1));
+                body.push_back(TraceOp::OpFork);
+                putVarint(body, pid);
+                if (live_pids.count(pid) > 0)
+                {
+                    // the child starts with the parent's variables
+                    std::map<std::pair<uint32_t, uint32_t>, DataType>::iterator it = types.lower_bound(std::make_pair(pid, 0u));
+                    for (; it != types.end() && it->first.first == pid; it++)
+                    {
+                        types[std::make_pair(next_pid, it->first.second)] = it->second;
+                    }
+                    live_pids.insert(next_pid);
+                    next_pid++;
+                }
+            }
+            else if (command == "shm_create")
+            {
+                body.push_back(TraceOp::OpShmCreate);
+                putVarint(body, traceName(commandSplit.at(1), names, name_ids));
+                putVarint(body, (uint64_t)allNums(commandSplit.at(2)));
+            }
+            else if (command == "shm_attach")
+            {
+                // the segment shows up as a variable of chars
+                uint32_t pid = allNums(commandSplit.at(1));
+                body.push_back(TraceOp::OpShmAttach);
+                putVarint(body, pid);
+                putVarint(body, name);
+                if (pid < next_pid && types.count(std::make_pair(pid, name)) == 0)
+                {
+                    types[std::make_pair(pid, name)] = DataType::Char;
+                }
+            }
+            else if (command == "shm_detach")
+            {
+                uint32_t pid = allNums(commandSplit.at(1));
+                body.push_back(TraceOp::OpShmDetach);
+                putVarint(body, pid);
+                putVarint(body, name);
+                types.erase(std::make_pair(pid, name));
+            }
+            else if (command == "save" || command == "checkpoint" || command == "load")
+            {
+                const std::string& file = commandSplit.at(1);
+                body.push_back((command == "save") ? TraceOp::OpSave :
+                               (command == "checkpoint") ? TraceOp::OpCheckpoint : TraceOp::OpLoad);
+                putVarint(body, file.size());
+                body += file;
+                if (command != "load")
+                {
+                    TraceSnapshot& saved = snapshots[file];
+                    saved.types = types;
+                    saved.live_pids = live_pids;
+                    saved.next_pid = next_pid;
+                }
+                else if (snapshots.count(file) > 0)
+                {
+                    types = snapshots[file].types;
+                    live_pids = snapshots[file].live_pids;
+                    next_pid = snapshots[file].next_pid;
+                }
+                else
+                {
+                    // a snapshot from before this trace: the variables that exist from here
+                    // on are the ones in it, if it is already there to read
+                    std::vector<uint32_t> pids;
+                    std::vector<SnapshotListing> listing;
+                    uint32_t snapshot_next_pid;
+                    if (listSnapshot(file, &snapshot_next_pid, pids, listing))
+                    {
+                        types.clear();
+                        live_pids = std::set<uint32_t>(pids.begin(), pids.end());
+                        for (size_t i = 0; i < listing.size(); i++)
+                        {
+                            types[std::make_pair(listing[i].pid, traceName(listing[i].name, names, name_ids))] = listing[i].type;
+                        }
+                        next_pid = snapshot_next_pid;
+                    }
+                    else
+                    {
+                        fprintf(stderr, "Warning: %s:%d: cannot read snapshot %s, set values after it are stored untyped\n",
+                                text_file.c_str(), line_number, file.c_str());
+                    }
+                }
+            }
+            else if (command == "compact")
+            {
+                if (commandSplit.size() > 1)
+                {
+                    body.push_back(TraceOp::OpCompact);
+                    putVarint(body, (uint32_t)allNums(commandSplit[1]));
+                }
+                else
+                {
+                    body.push_back(TraceOp::OpCompactAll);
+                }
+            }
+            else if (command == "fill")
+            {
+                body.push_back(TraceOp::OpFill);
+                putVarint(body, (uint32_t)allNums(commandSplit.at(1)));
+                putVarint(body, name);
+                putVarint(body, commandSplit.at(3).size());
+                body += commandSplit[3];
+            }
+            else if (command == "copy")
+            {
+                const std::string& destination = commandSplit.at(2);
+                body.push_back(TraceOp::OpCopy);
+                putVariableRef(body, commandSplit[1], names, name_ids);
+                putVariableRef(body, destination, names, name_ids);
+            }
+            else if (command == "sum" || command == "min" || command == "max")
+            {
+                const std::string& object = commandSplit.at(1);
+                body.push_back((command == "sum") ? TraceOp::OpSum : (command == "min") ? TraceOp::OpMin : TraceOp::OpMax);
+                putVariableRef(body, object, names, name_ids);
+            }
+            else
+            {
+                body.push_back(TraceOp::OpUnknown);
+            }
+        }
+        catch (std::out_of_range& e)
+        {
+            fprintf(stderr, "Error: %s:%d: missing operands for '%s'\n", text_file.c_str(), line_number, commandSplit[0].c_str());
+            return 1;
+        }
+    }
+
+    std::string header(TRACE_MAGIC);
+    header.push_back(TRACE_VERSION);
+    putVarint(header, names.size());
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        putVarint(header, names[i].size());
+        header += names[i];
+    }
+
+    std::ofstream out(binary_file.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        fprintf(stderr, "Error: cannot write %s\n", binary_file.c_str());
+        return 1;
+    }
+    out.write(header.data(), header.size());
+    out.write(body.data(), body.size());
+    return out.good() ? 0 : 1;
+}
+
+/*
+    binary_file: trace produced by convertTrace
+    maps the file and runs each record directly against the Mmu / PageTable, output
+    matches running the original text trace; per-type command counts are added to counts
+    returns 0 on success
+*/
+int replayTrace(std::string binary_file, Mmu *mmu, PageTable *page_table, void *memory, uint64_t counts[CmdCount])
+{
+    int fd = open(binary_file.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        fprintf(stderr, "Error: cannot open trace file %s\n", binary_file.c_str());
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    size_t length = info.st_size;
+    void *data = (length == 0) ? MAP_FAILED : mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: cannot map trace file %s\n", binary_file.c_str());
+        return 1;
+    }
+    madvise(data, length, MADV_SEQUENTIAL);
+
+    TraceReader in;
+    in.pos = (const uint8_t*)data;
+    in.end = in.pos + length;
+    in.ok = true;
+
+    char magic[4];
+    in.raw(magic, sizeof(magic));
+    if (!in.ok || memcmp(magic, TRACE_MAGIC, 4) != 0 || in.byte() != TRACE_VERSION)
+    {
+        fprintf(stderr, "Error: %s is not a memsim binary trace\n", binary_file.c_str());
+        munmap(data, length);
+        return 1;
+    }
+
+    // resolve the trace's name table to the Mmu's interned ids once, up front
+    uint64_t num_names = in.varint();
+    std::vector<uint32_t> names;
+    for (uint64_t i = 0; i < num_names && in.ok; i++)
+    {
+        uint64_t size = in.varint();
+        if (size > (uint64_t)(in.end - in.pos))
+        {
+            in.ok = false;
+            break;
+        }
+        names.push_back(mmu->internName(std::string((const char*)in.pos, size)));
+        in.pos += size;
+    }
+
+    std::vector<uint8_t> staging;
+    bool done = false;
+    while (in.ok && !done && in.pos < in.end)
+    {
+        uint64_t op_start = command_stats.timing() ? statsNow() : 0;
+        CommandType command = CommandType::CmdUnknown;
+        uint8_t op = in.byte();
+        if (op == TraceOp::OpCreate)
+        {
+            int text_size = (int)(uint32_t)in.varint();
+            int data_size = (int)(uint32_t)in.varint();
+            if (!in.ok)
+            {
+                break;
+            }
+            createProcess(text_size, data_size, mmu, page_table);
+            std::cout << std::endl;
+            command = CommandType::CmdCreate;
+        }
+        else if (op == TraceOp::OpAllocate)
+        {
+            uint32_t pid = in.varint();
+            uint64_t name = in.varint();
+            DataType type = (DataType)in.byte();
+            uint64_t num_elements = in.varint();
+            if (!in.ok || name >= names.size() || type > DataType::Double)
+            {
+                in.ok = false;
+                break;
+            }
+            if (!mmu->processExists(pid))
+            {
+                std::cout << "error: process not found";
+            }
+            else if (mmu->getVariable(pid, names[name]) != NULL)
+            {
+                std::cout << "error: variable already exists";
+            }
+            else if (type == DataType::FreeSpace)
+            {
+                std::cout << "error: data type not recognized";
+            }
+            else
+            {
+                allocateVariable(pid, names[name], type, num_elements, mmu, page_table);
+            }
+            std::cout << std::endl;
+            command = CommandType::CmdAllocate;
+        }
+        else if (op == TraceOp::OpSet)
+        {
+            uint32_t pid = in.varint();
+            uint64_t name = in.varint();
+            uint64_t offset = in.varint();
+            DataType type = (DataType)in.byte();
+            uint64_t count = in.varint();
+            // every value takes at least one byte
+            if (!in.ok || name >= names.size() || type > DataType::Double || count > (uint64_t)(in.end - in.pos))
+            {
+                in.ok = false;
+                break;
+            }
+            Variable *var = mmu->processExists(pid) ? mmu->getVariable(pid, names[name]) : NULL;
+            if (!mmu->processExists(pid))
+            {
+                std::cout << "error: process not found" << std::endl;
+            }
+            else if (var == NULL)
+            {
+                std::cout << "error: variable not found" << std::endl;
+            }
+            // decode every value first, in the stored type, narrowing/converting to the
+            // variable's type if they differ, then write them all at once
+            staging.resize(count * (var != NULL ? dataTypeSize(var->type) : 0));
+            uint8_t *element = staging.data();
+            for (uint64_t i = 0; i < count && in.ok; i++)
+            {
+                int64_t integer = 0;
+                double real = 0;
+                bool is_real = false;
+                if (type == DataType::Char)
+                {
+                    integer = (char)in.byte();
+                }
+                else if (type == DataType::Float)
+                {
+                    float f;
+                    in.raw(&f, sizeof(f));
+                    real = f;
+                    is_real = true;
+                }
+                else if (type == DataType::Double)
+                {
+                    in.raw(&real, sizeof(real));
+                    is_real = true;
+                }
+                else
+                {
+                    integer = in.zigzag();
+                }
+                if (var == NULL)
+                {
+                    continue;
+                }
+
+                union {
+                    char c;
+                    short s;
+                    int i;
+                    float f;
+                    long l;
+                    double d;
+                } value;
+                switch (var->type)
+                {
+                    case DataType::Char:   value.c = is_real ? (char)real : (char)integer; break;
+                    case DataType::Short:  value.s = is_real ? (short)real : (short)integer; break;
+                    case DataType::Int:    value.i = is_real ? (int)real : (int)integer; break;
+                    case DataType::Float:  value.f = is_real ? (float)real : (float)integer; break;
+                    case DataType::Long:   value.l = is_real ? (long)real : (long)integer; break;
+                    case DataType::Double: value.d = is_real ? real : (double)integer; break;
+                    default: break;
+                }
+                memcpy(element, &value, dataTypeSize(var->type));
+                element += dataTypeSize(var->type);
+            }
+            if (var != NULL && in.ok && !writeVariable(pid, var, offset, staging.data(), count, page_table, memory))
+            {
+                std::cout << "error: values past the end of the variable" << std::endl;
+            }
+            command = CommandType::CmdSet;
+        }
+        else if ((op >= TraceOp::OpPrintMmu && op <= TraceOp::OpPrintVariable) || op == TraceOp::OpPrintStats)
+        {
+            if (op == TraceOp::OpPrintStats)
+            {
+                printStats(mmu, page_table);
+            }
+            else if (op == TraceOp::OpPrintMmu)
+            {
+                mmu->print();
+            }
+            else if (op == TraceOp::OpPrintPage)
+            {
+                page_table->print();
+            }
+            else if (op == TraceOp::OpPrintProcesses)
+            {
+                mmu->printProcesses();
+            }
+            else if (op == TraceOp::OpPrintTlb)
+            {
+                page_table->printTlb();
+            }
+            else
+            {
+                uint32_t pid = in.varint();
+                uint64_t name = in.varint();
+                if (!in.ok || name >= names.size())
+                {
+                    in.ok = false;
+                    break;
+                }
+                Variable *var = mmu->getVariable(pid, names[name]);
+                if (var == NULL)
+                {
+                    std::cout << "error: variable not found" << std::endl;
+                }
+                else
+                {
+                    printVariable(pid, var, page_table, memory);
+                }
+            }
+            command = CommandType::CmdPrint;
+        }
+        else if (op == TraceOp::OpPrintMmuRange || op == TraceOp::OpPrintPageRange)
+        {
+            uint32_t pid = in.varint();
+            uint64_t first = in.varint();
+            uint64_t last = in.varint();
+            if (!in.ok)
+            {
+                break;
+            }
+            printTableRange(op == TraceOp::OpPrintPageRange, pid, first, last, mmu, page_table);
+            command = CommandType::CmdPrint;
+        }
+        else if (op == TraceOp::OpFree)
+        {
+            uint32_t pid = in.varint();
+            uint64_t name = in.varint();
+            if (!in.ok || name >= names.size())
+            {
+                in.ok = false;
+                break;
+            }
+            if (!mmu->processExists(pid))
+            {
+                std::cout << "error: process not found" << std::endl;
+            }
+            else
+            {
+                Variable *var = mmu->getVariable(pid, names[name]);
+                if (var != NULL)
+                {
+                    freeVariable(pid, var, mmu, page_table);
+                    autoCompact(pid, mmu, page_table, memory);
+                }
+                else
+                {
+                    std::cout << "error: variable not found" << std::endl;
+                }
+            }
+            command = CommandType::CmdFree;
+        }
+        else if (op == TraceOp::OpTerminate)
+        {
+            uint32_t pid = in.varint();
+            if (!in.ok)
+            {
+                break;
+            }
+            if (mmu->processExists(pid))
+            {
+                terminateProcess(pid, mmu, page_table);
+            }
+            else
+            {
+                std::cout << "error: process not found" << std::endl;
+            }
+            command = CommandType::CmdTerminate;
+        }
+        else if (op == TraceOp::OpFork)
+        {
+            uint32_t pid = in.varint();
+            if (!in.ok)
+            {
+                break;
+            }
+            if (mmu->processExists(pid))
+            {
+                forkProcess(pid, mmu, page_table);
+            }
+            else
+            {
+                std::cout << "error: process not found";
+            }
+            std::cout << std::endl;
+            command = CommandType::CmdFork;
+        }
+        else if (op == TraceOp::OpShmCreate)
+        {
+            uint64_t name = in.varint();
+            uint64_t size = in.varint();
+            if (!in.ok || name >= names.size())
+            {
+                in.ok = false;
+                break;
+            }
+            createSegment(names[name], size, mmu, page_table);
+            std::cout << std::endl;
+            command = CommandType::CmdShm;
+        }
+        else if (op == TraceOp::OpShmAttach || op == TraceOp::OpShmDetach)
+        {
+            uint32_t pid = in.varint();
+            uint64_t name = in.varint();
+            if (!in.ok || name >= names.size())
+            {
+                in.ok = false;
+                break;
+            }
+            if (!mmu->processExists(pid))
+            {
+                std::cout << "error: process not found" << std::endl;
+            }
+            else if (op == TraceOp::OpShmAttach)
+            {
+                attachSegment(pid, names[name], mmu, page_table);
+                std::cout << std::endl;
+            }
+            else
+            {
+                detachSegment(pid, mmu->getVariable(pid, names[name]), mmu, page_table);
+            }
+            command = CommandType::CmdShm;
+        }
+        else if (op == TraceOp::OpCompact || op == TraceOp::OpCompactAll)
+        {
+            if (op == TraceOp::OpCompactAll)
+            {
+                printCompaction(compactProcesses(mmu->getPids(), mmu, page_table, memory, true));
+            }
+            else
+            {
+                uint32_t pid = in.varint();
+                if (!in.ok)
+                {
+                    break;
+                }
+                if (mmu->processExists(pid))
+                {
+                    printCompaction(compactProcesses(std::vector<uint32_t>(1, pid), mmu, page_table, memory, true));
+                }
+                else
+                {
+                    std::cout << "error: process not found" << std::endl;
+                }
+            }
+            command = CommandType::CmdCompact;
+        }
+        else if (op == TraceOp::OpFill)
+        {
+            uint32_t pid = in.varint();
+            uint64_t name = in.varint();
+            uint64_t length = in.varint();
+            if (!in.ok || name >= names.size() || length > (uint64_t)(in.end - in.pos))
+            {
+                in.ok = false;
+                break;
+            }
+            std::string value((const char*)in.pos, length);
+            in.pos += length;
+            Variable *var = mmu->processExists(pid) ? mmu->getVariable(pid, names[name]) : NULL;
+            if (!mmu->processExists(pid))
+            {
+                std::cout << "error: process not found" << std::endl;
+            }
+            else if (var == NULL)
+            {
+                std::cout << "error: variable not found" << std::endl;
+            }
+            else
+            {
+                fillVariable(pid, var, value, page_table, memory);
+            }
+            command = CommandType::CmdFill;
+        }
+        else if (op == TraceOp::OpCopy || (op >= TraceOp::OpSum && op <= TraceOp::OpMax))
+        {
+            // one or two "<pid>:<var_name>" operands, reported like the text commands do
+            uint32_t pids[2];
+            Variable *vars[2] = {NULL, NULL};
+            int operands = (op == TraceOp::OpCopy) ? 2 : 1;
+            for (int i = 0; i < operands; i++)
+            {
+                pids[i] = in.varint();
+                uint64_t name = in.varint();
+                if (!in.ok || name >= names.size())
+                {
+                    in.ok = false;
+                    break;
+                }
+                if (i > 0 && vars[i - 1] == NULL)
+                {
+                    continue;
+                }
+                if (!mmu->processExists(pids[i]))
+                {
+                    std::cout << "error: process not found" << std::endl;
+                }
+                else if ((vars[i] = mmu->getVariable(pids[i], names[name])) == NULL)
+                {
+                    std::cout << "error: variable not found" << std::endl;
+                }
+            }
+            if (!in.ok)
+            {
+                break;
+            }
+            if (op == TraceOp::OpCopy)
+            {
+                if (vars[1] != NULL)
+                {
+                    copyVariable(pids[0], vars[0], pids[1], vars[1], page_table, memory);
+                }
+                command = CommandType::CmdCopy;
+            }
+            else
+            {
+                if (vars[0] != NULL)
+                {
+                    printReduction((Reduction)(op - TraceOp::OpSum), pids[0], vars[0], page_table, memory);
+                }
+                command = CommandType::CmdReduce;
+            }
+        }
+        else if (op == TraceOp::OpSave || op == TraceOp::OpCheckpoint || op == TraceOp::OpLoad)
+        {
+            uint64_t size = in.varint();
+            if (!in.ok || size > (uint64_t)(in.end - in.pos))
+            {
+                in.ok = false;
+                break;
+            }
+            std::string file((const char*)in.pos, size);
+            in.pos += size;
+            SnapshotInfo info;
+            if (op == TraceOp::OpSave)
+            {
+                printSnapshot("saved", file, saveSnapshot(file, mmu, page_table, memory, &info), info);
+            }
+            else if (op == TraceOp::OpCheckpoint)
+            {
+                printSnapshot("checkpointed", file, checkpointSnapshot(file, mmu, page_table, memory, &info), info);
+            }
+            else
+            {
+                printSnapshot("loaded", file, loadSnapshot(file, mmu, page_table, memory, &info), info);
+            }
+            command = CommandType::CmdSnapshot;
+        }
+        else if (op == TraceOp::OpUsage)
+        {
+            uint64_t size = in.varint();
+            if (!in.ok || size > (uint64_t)(in.end - in.pos))
+            {
+                in.ok = false;
+                break;
+            }
+            const CommandSyntax *syntax = commandSyntax(std::string((const char*)in.pos, size));
+            in.pos += size;
+            if (syntax == NULL)
+            {
+                in.ok = false;
+                break;
+            }
+            std::cout << "error: usage is " << syntax->usage << std::endl;
+            command = syntax->type;
+        }
+        else if (op == TraceOp::OpExit)
+        {
+            command = CommandType::CmdExit;
+            done = true;
+        }
+        else if (op == TraceOp::OpUnknown)
+        {
+            std::cout << "error: command not recognized" << std::endl;
+            command = CommandType::CmdUnknown;
+        }
+        else
+        {
+            in.ok = false;
+        }
+
+        if (in.ok)
+        {
+            counts[command]++;
+            command_stats.record(command, command_stats.timing() ? statsNow() - op_start : 0);
+        }
+    }
+
+    munmap(data, length);
+    if (!in.ok)
+    {
+        fprintf(stderr, "Error: %s is truncated or corrupt\n", binary_file.c_str());
+        return 1;
+    }
+    return 0;
+}
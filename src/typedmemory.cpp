@@ -0,0 +1,102 @@
+#include "typedmemory.h"
+#include <cctype>
+#include <cstdlib>
+
+/*
+    Copy size bytes between a process's virtual range and a flat buffer, one page run at a
+    time; unmapped pages are skipped on writes and read as zeros, and writes to a page shared
+    since a fork give it its own copy first
+*/
+void transferVirtual(uint32_t pid, uint64_t address, uint8_t *buffer, uint64_t size, bool to_memory, PageTable *page_table, void *memory)
+{
+    int page_size = page_table->getPageSize();
+    while (size > 0)
+    {
+        uint64_t run = std::min<uint64_t>(size, page_size - address % page_size);
+        int64_t physicalAddress = to_memory ? page_table->getWritableAddress(pid, address) : page_table->getPhysicalAddress(pid, address);
+        if (physicalAddress < 0)
+        {
+            if (!to_memory)
+            {
+                memset(buffer, 0, run);
+            }
+        }
+        else if (to_memory)
+        {
+            memcpy((uint8_t*)memory + physicalAddress, buffer, run);
+        }
+        else
+        {
+            memcpy(buffer, (uint8_t*)memory + physicalAddress, run);
+        }
+        address += run;
+        buffer += run;
+        size -= run;
+    }
+}
+
+static bool parseInteger(const char *text, int64_t *value)
+{
+    const char *p = text;
+    bool negative = (*p == '-');
+    if (*p == '-' || *p == '+')
+    {
+        p++;
+    }
+    if (!isdigit((unsigned char)*p))
+    {
+        return false;
+    }
+    uint64_t result = 0;
+    while (isdigit((unsigned char)*p))
+    {
+        result = result * 10 + (*p - '0');
+        p++;
+    }
+    *value = negative ? -(int64_t)result : (int64_t)result;
+    return true;
+}
+
+bool parseElement(const char *text, char *value)
+{
+    *value = text[0];
+    return true;
+}
+
+bool parseElement(const char *text, short *value)
+{
+    int64_t integer = 0;
+    bool ok = parseInteger(text, &integer);
+    *value = (short)integer;
+    return ok;
+}
+
+bool parseElement(const char *text, int *value)
+{
+    int64_t integer = 0;
+    bool ok = parseInteger(text, &integer);
+    *value = (int)integer;
+    return ok;
+}
+
+bool parseElement(const char *text, long *value)
+{
+    int64_t integer = 0;
+    bool ok = parseInteger(text, &integer);
+    *value = (long)integer;
+    return ok;
+}
+
+bool parseElement(const char *text, float *value)
+{
+    char *end;
+    *value = strtof(text, &end);
+    return end != text;
+}
+
+bool parseElement(const char *text, double *value)
+{
+    char *end;
+    *value = strtod(text, &end);
+    return end != text;
+}
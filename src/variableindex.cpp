@@ -0,0 +1,130 @@
+#include "variableindex.h"
+#include "mmu.h"
+
+VariableIndex::VariableIndex()
+{
+    _size = 0;
+    _used = 0;
+}
+
+VariableIndex::~VariableIndex()
+{
+}
+
+Variable* VariableIndex::tombstone()
+{
+    static Variable erased;
+    return &erased;
+}
+
+// Multiplicative hash, ids are dense so consecutive names land in distinct slots
+uint32_t VariableIndex::hash(uint32_t name)
+{
+    return name * 2654435769u;
+}
+
+void VariableIndex::rehash(uint32_t capacity)
+{
+    std::vector<Variable*> old;
+    old.swap(_slots);
+    _slots.assign(capacity, NULL);
+    _size = 0;
+    _used = 0;
+    for (size_t i = 0; i < old.size(); i++)
+    {
+        if (old[i] != NULL && old[i] != tombstone())
+        {
+            insert(old[i]);
+        }
+    }
+}
+
+void VariableIndex::insert(Variable *var)
+{
+    // keep the table at most 70% full (tombstones included) so probe chains stay short
+    if ((_used + 1) * 10 > _slots.size() * 7)
+    {
+        uint32_t capacity = _slots.empty() ? 16 : _slots.size();
+        while ((_size + 1) * 10 > capacity * 5)
+        {
+            capacity *= 2;
+        }
+        rehash(capacity);
+    }
+
+    uint32_t mask = _slots.size() - 1;
+    uint32_t i = hash(var->name) & mask;
+    int64_t reuse = -1;
+    while (_slots[i] != NULL)
+    {
+        if (_slots[i] == tombstone())
+        {
+            if (reuse < 0)
+            {
+                reuse = i;
+            }
+        }
+        else if (_slots[i]->name == var->name)
+        {
+            _slots[i] = var;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    if (reuse >= 0)
+    {
+        _slots[reuse] = var;
+    }
+    else
+    {
+        _slots[i] = var;
+        _used++;
+    }
+    _size++;
+}
+
+Variable* VariableIndex::find(uint32_t name)
+{
+    if (_size == 0)
+    {
+        return NULL;
+    }
+    uint32_t mask = _slots.size() - 1;
+    uint32_t i = hash(name) & mask;
+    while (_slots[i] != NULL)
+    {
+        if (_slots[i] != tombstone() && _slots[i]->name == name)
+        {
+            return _slots[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+bool VariableIndex::erase(uint32_t name)
+{
+    if (_size == 0)
+    {
+        return false;
+    }
+    uint32_t mask = _slots.size() - 1;
+    uint32_t i = hash(name) & mask;
+    while (_slots[i] != NULL)
+    {
+        if (_slots[i] != tombstone() && _slots[i]->name == name)
+        {
+            _slots[i] = tombstone();
+            _size--;
+            return true;
+        }
+        i = (i + 1) & mask;
+    }
+    return false;
+}
+
+uint32_t VariableIndex::size()
+{
+    return _size;
+}